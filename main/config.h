@@ -37,6 +37,8 @@
     - support for non-standard character types or file encodings
       via user-written converter classes
     - support for adding/modifying values programmatically
+    - typed access to numbers, booleans, lists of numbers and colors
+    - comparing two versions of the data and applying the differences
     - should compile cleanly without warning usually at the strictest warning level
     - it has been tested with the following compilers:
         - Windows/VC6 (warning level 3)
@@ -94,6 +96,7 @@
             <tr><td>GetAllSections  <td>Return all section names
             <tr><td>GetAllKeys      <td>Return all key names within a section
             <tr><td>GetAllValues    <td>Return all values within a section & key
+            <tr><td>Sections, Keys, Values <td>Iterate over the same without copying
             <tr><td>GetSection      <td>Return all key names and values in a section
             <tr><td>GetSectionSize  <td>Return the number of keys in a section
             <tr><td>GetValue        <td>Return a value for a section & key
@@ -112,6 +115,120 @@
     ofstream) then the flag ios_base::binary has been used when the file was
     opened.
 
+    @section mmap MEMORY MAPPED FILES
+
+    On POSIX systems LoadFile() can map the file instead of reading it into
+    a heap buffer. Enable this with SetMemoryMapped(). The file is mapped
+    privately (copy-on-write) and parsed in place, so the only pages copied
+    are the ones modified by the parser. This is only used when no character
+    conversion is required (SI_CHAR == char with SI_ConvertA), otherwise the
+    normal load is used. While the data is loaded the file must not be
+    truncated or rewritten in place (write a new file and rename it over the
+    old one instead). Define SI_NO_MMAP to disable the support entirely.
+
+    @section parallel PARALLEL LOADING
+
+    Large files can be parsed by several threads, enable this with
+    SetLoadThreads(). The data is split into chunks at section headers (any
+    comment before a header stays with it), each chunk is parsed into its own
+    table, and the tables are then merged in file order. The result is the
+    same as a normal load, including load order and multi-key values. Only
+    the first load into an empty object is split, and only when multi-line
+    values are disabled and the data is at least SI_PARALLEL_CHUNK_SIZE
+    characters per chunk. Define SI_NO_THREADS to disable the support entirely.
+
+    Many small files are better loaded a whole file per thread. LoadFiles()
+    loads each file into its own object, and LoadFilesMerged() loads them all
+    into one object with the same result as calling LoadFile() for each of
+    them in turn.
+
+    @section lazy LAZY LOADING
+
+    With SetLazyLoad() the first load into an empty object only finds the
+    section headers, and the keys of a section are parsed the first time
+    they are read or changed. Sections(), GetAllSections() and
+    SectionExists() don't parse anything. Keys are numbered for load order
+    when their section is parsed, so they are in file order within each
+    section only. Reading a section modifies the object, call
+    ParseLazySections() before sharing it between threads, as
+    CSimpleIniShared does when it publishes a version. Saving, loading
+    more data, freezing and copying parse every remaining section. Lazy
+    loading is used instead of parallel loading when both are enabled, and
+    is not used when multi-line values are enabled.
+
+    @section snapshot BINARY SNAPSHOTS
+
+    SaveSnapshot() writes the loaded data in a compact binary form that
+    LoadSnapshot() can load without parsing any text. The file holds a string
+    table followed by the sections and keys in sorted order, so they can be
+    inserted without any comparisons. When a source file is given, its size,
+    modification time and a hash of its contents are recorded, and the
+    snapshot is rejected if the source no longer matches. A snapshot can only
+    be loaded by a build with the same SI_CHAR type, byte order, multi-key
+    setting and case sensitivity, and is otherwise rejected with SI_FAIL, in
+    which case the source should be loaded as text.
+
+    @section streaming STREAMING
+
+    ParseStream() parses a file or stream without loading it. The entries are
+    passed to a ParseHandler as they are found and nothing is stored, so the
+    memory used depends only on SI_STREAM_CHUNK_SIZE and the longest entry,
+    and the file may be larger than SI_MAX_FILE_SIZE. The entries are the
+    same as a load would add, in file order, including each repeated section
+    header and key.
+
+    @section shared SHARING BETWEEN THREADS
+
+    The const methods of an object may be called from several threads as
+    long as no thread modifies it (and the typed cache is off).
+    CSimpleIniShared holds immutable versions of the data instead, so that
+    readers on any thread can keep reading while a writer prepares the next
+    version. Readers never take a lock. A version is deleted once the last
+    reader holding it has released it. Define SI_NO_THREADS to remove it.
+
+    @section layered LAYERED DATA
+
+    CSimpleIniLayered looks up values through a stack of objects, such as
+    the user's settings over the defaults, without copying any of them. Each
+    lookup uses the highest layer that has the key. Changes and saves only
+    affect the top layer, and Flatten() copies the combined data into a
+    single object when one is needed.
+
+    @section frozen FROZEN DATA
+
+    Data that is no longer changed can be frozen with Freeze(). The sections
+    and values are moved into flat arrays sorted like the data table, plus a
+    minimal perfect hash (hash and displace) over the section and key names,
+    and the data table, hash index and load order links are released. A
+    lookup then reads a bucket seed, a hash slot and the entry it refers to.
+    All of the getters, the views, Save(), SaveSnapshot() and CopyFrom() work
+    as before, except that GetSection() returns NULL as there is no table to
+    return. Loading, SetValue(), Delete() and CompactStrings() fail until the
+    data is thawed with Thaw(). Reset() and LoadSnapshot() discard the frozen
+    data. When the hash can't match SI_STRLESS (see SI_HashFold) the names
+    are found by a binary search instead.
+
+    @section schema SETTINGS SCHEMA
+
+    A settings struct can be described by a constexpr schema of
+    SI_MakeSetting() entries, each giving the section, key, member and
+    default of one setting. ReadSettings() fills the struct in one call,
+    converting each value to the type of its member, and WriteSettings() and
+    WriteDefaults() store it. The hashes of the names are computed at compile
+    time and the defaults are part of the program, so no names are built or
+    hashed and no file of defaults is needed.
+
+    @section memory MEMORY RESOURCES
+
+    Define SI_USE_PMR to make the data table of std::pmr containers, where
+    std::pmr is available (SI_HAS_PMR). A memory resource can then be given
+    to the constructor, and the sections, keys, values and copied strings
+    are allocated from it, so that an object can use a
+    std::pmr::monotonic_buffer_resource which is released in one go, or a
+    resource that counts its allocations. TNamesDepend is then a
+    std::pmr::list, so the lists passed to GetAllSections(), GetAllKeys()
+    and GetAllValues() must be declared with that type.
+
     @section multiline MULTI-LINE VALUES
 
     Values that span multiple lines are created using the following format.
@@ -151,6 +268,11 @@
       delete that entry and recreate it with the new comment. There is no
       way to change the file comment.
 
+    Read-only consumers can skip comments when loading with
+    SetStripComments(). Defining SI_NO_COMMENTS removes the comment from
+    every entry, which makes each section and key entry a pointer smaller,
+    and discards all comments including those given to SetValue().
+
     @section save SAVE ORDER
 
     The sections and keys are written out in the same order as they were
@@ -159,6 +281,10 @@
     written. There is no way to specify the location of a section or key
     other than in first-created, first-saved order.
 
+    SaveFileAtomic() writes to a temporary file and renames it over the
+    original, so that a file which is loaded while it is being saved (or
+    memory mapped by another object) is never seen half written.
+
     @section notes NOTES
 
     - The maximum supported file size is 1 GiB (SI_MAX_FILE_SIZE). Files larger
@@ -233,12 +359,24 @@
 #endif
 
 #include <cstring>
+#include <cstddef>
+#include <cmath>
 #include <cstdlib>
 #include <string>
 #include <map>
 #include <list>
+#include <iterator>
+#include <vector>
 #include <algorithm>
+#include <climits>
+#include <charconv>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <limits>
+#include <unordered_map>
 #include <stdio.h>
+#include <sys/stat.h>
 
 #ifdef SI_SUPPORT_IOSTREAMS
 # include <iostream>
@@ -268,7 +406,20 @@ constexpr int SI_FILE = -3;     //!< File error (see errno for detail error)
 //! to prevent excessive memory allocation and potential denial of service.
 constexpr size_t SI_MAX_FILE_SIZE = 1024ULL * 1024ULL * 1024ULL;
 
+//! Minimum number of characters parsed by each thread of a parallel load.
+constexpr size_t SI_PARALLEL_CHUNK_SIZE = 256 * 1024;
+
+//! Size of the buffer used by SaveFile().
+constexpr size_t SI_WRITE_BUFFER_SIZE = 64 * 1024;
+
+//! Number of bytes read at a time by ParseStream().
+constexpr size_t SI_STREAM_CHUNK_SIZE = 256 * 1024;
+
+//! Default number of readers that can hold a version of CSimpleIniShared.
+constexpr size_t SI_SHARED_READERS = 64;
+
 #define SI_UTF8_SIGNATURE     "\xEF\xBB\xBF"
+#define SI_SNAPSHOT_MAGIC     "SIMPLINI"
 
 #ifdef _WIN32
 # define SI_NEWLINE_A   "\r\n"
@@ -290,6 +441,569 @@ constexpr size_t SI_MAX_FILE_SIZE = 1024ULL * 1024ULL * 1024ULL;
 # define SI_WCHAR_T     UChar
 #endif
 
+#ifdef _WIN32
+# include <io.h>        // _commit() for SaveFileAtomic()
+# include <windows.h>   // MoveFileExA() for SaveFileAtomic()
+#else
+# include <unistd.h>    // fsync() for SaveFileAtomic()
+#endif
+
+#if !defined(SI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+# define SI_HAS_MMAP
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+#if !defined(SI_NO_THREADS)
+# define SI_HAS_THREADS
+# include <thread>
+# include <atomic>
+# include <memory>
+# include <mutex>
+#endif
+
+#if defined(SI_USE_PMR) && defined(__has_include)
+# if __has_include(<memory_resource>)
+#  define SI_HAS_PMR
+#  include <memory_resource>
+# endif
+#endif
+
+#if !defined(SI_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define SI_HAS_SSE2
+# include <emmintrin.h>
+# if defined(__AVX2__)
+#  define SI_HAS_AVX2
+#  include <immintrin.h>
+# endif
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# endif
+#endif
+
+// The vectorized scanners use aligned loads which may read past the end of
+// the string, but never past the end of the page containing it. During a
+// parallel load those characters may be written by another thread, but the
+// values read from past the end are never used.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+# define SI_NO_SANITIZE __attribute__((no_sanitize("address", "thread")))
+#elif defined(__has_feature)
+# if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#  define SI_NO_SANITIZE __attribute__((no_sanitize("address", "thread")))
+# endif
+#endif
+#ifndef SI_NO_SANITIZE
+# define SI_NO_SANITIZE
+#endif
+
+/** Find the first character in a line of text that is either the NULL
+    terminator, a newline character, a_c1 or a_c2. Pass a NULL character for
+    a_c1/a_c2 to find just the end of the line.
+ */
+template<class SI_CHAR>
+inline SI_CHAR * SI_ScanLine(SI_CHAR * a_pData, SI_CHAR a_c1, SI_CHAR a_c2) {
+    while (*a_pData && *a_pData != '\n' && *a_pData != '\r'
+        && *a_pData != a_c1 && *a_pData != a_c2)
+    {
+        ++a_pData;
+    }
+    return a_pData;
+}
+
+#ifdef SI_HAS_SSE2
+/** Index of the lowest set bit, a_uMask must not be 0 */
+inline unsigned SI_LowestBit(unsigned a_uMask) {
+#if defined(_MSC_VER)
+    unsigned long uIndex;
+    _BitScanForward(&uIndex, a_uMask);
+    return (unsigned) uIndex;
+#else
+    return (unsigned) __builtin_ctz(a_uMask);
+#endif
+}
+
+/** Vectorized SI_ScanLine for char data. Each aligned block of 16 (SSE2) or
+    32 (AVX2) bytes is compared against all of the stop characters at once.
+ */
+SI_NO_SANITIZE
+inline char * SI_ScanLine(char * a_pData, char a_c1, char a_c2) {
+#ifdef SI_HAS_AVX2
+    const size_t uWidth = 32;
+    const __m256i vNull = _mm256_setzero_si256();
+    const __m256i vLF   = _mm256_set1_epi8('\n');
+    const __m256i vCR   = _mm256_set1_epi8('\r');
+    const __m256i vC1   = _mm256_set1_epi8(a_c1);
+    const __m256i vC2   = _mm256_set1_epi8(a_c2);
+#else
+    const size_t uWidth = 16;
+    const __m128i vNull = _mm_setzero_si128();
+    const __m128i vLF   = _mm_set1_epi8('\n');
+    const __m128i vCR   = _mm_set1_epi8('\r');
+    const __m128i vC1   = _mm_set1_epi8(a_c1);
+    const __m128i vC2   = _mm_set1_epi8(a_c2);
+#endif
+
+    size_t uOffset = (size_t) a_pData & (uWidth - 1);
+    const char * pBlock = a_pData - uOffset;
+    unsigned uMask;
+    for (;;) {
+#ifdef SI_HAS_AVX2
+        __m256i v = _mm256_load_si256((const __m256i *) pBlock);
+        __m256i vStop = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, vNull), _mm256_cmpeq_epi8(v, vLF)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, vCR),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, vC1), _mm256_cmpeq_epi8(v, vC2))));
+        uMask = (unsigned) _mm256_movemask_epi8(vStop);
+#else
+        __m128i v = _mm_load_si128((const __m128i *) pBlock);
+        __m128i vStop = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, vNull), _mm_cmpeq_epi8(v, vLF)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, vCR),
+                _mm_or_si128(_mm_cmpeq_epi8(v, vC1), _mm_cmpeq_epi8(v, vC2))));
+        uMask = (unsigned) _mm_movemask_epi8(vStop);
+#endif
+        // ignore the bytes before the start of the data in the first block
+        uMask &= ~0u << uOffset;
+        if (uMask) {
+            return const_cast<char *>(pBlock) + SI_LowestBit(uMask);
+        }
+        pBlock += uWidth;
+        uOffset = 0;
+    }
+}
+#endif // SI_HAS_SSE2
+
+/** Copy the leading ASCII characters of UTF-8 data to a wide character type,
+    stopping at the first byte that isn't ASCII or at the end of either
+    buffer. Returns the number of characters copied.
+ */
+template<class SI_CHAR>
+inline size_t SI_WidenAscii(
+    const char *    a_pInput,
+    size_t          a_uInputLen,
+    SI_CHAR *       a_pOutput,
+    size_t          a_uOutputLen
+    )
+{
+    size_t uLen = a_uInputLen < a_uOutputLen ? a_uInputLen : a_uOutputLen;
+    size_t uPos = 0;
+#ifdef SI_HAS_SSE2
+    if (sizeof(SI_CHAR) == 2 || sizeof(SI_CHAR) == 4) {
+        const __m128i vZero = _mm_setzero_si128();
+        for (; uPos + 16 <= uLen; uPos += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (a_pInput + uPos));
+            if (_mm_movemask_epi8(v)) {
+                break;
+            }
+            __m128i vLo = _mm_unpacklo_epi8(v, vZero);
+            __m128i vHi = _mm_unpackhi_epi8(v, vZero);
+            __m128i * pOut = (__m128i *) (a_pOutput + uPos);
+            if (sizeof(SI_CHAR) == 2) {
+                _mm_storeu_si128(pOut,     vLo);
+                _mm_storeu_si128(pOut + 1, vHi);
+            }
+            else {
+                _mm_storeu_si128(pOut,     _mm_unpacklo_epi16(vLo, vZero));
+                _mm_storeu_si128(pOut + 1, _mm_unpackhi_epi16(vLo, vZero));
+                _mm_storeu_si128(pOut + 2, _mm_unpacklo_epi16(vHi, vZero));
+                _mm_storeu_si128(pOut + 3, _mm_unpackhi_epi16(vHi, vZero));
+            }
+        }
+    }
+#endif // SI_HAS_SSE2
+    for (; uPos < uLen && (unsigned char) a_pInput[uPos] < 0x80; ++uPos) {
+        a_pOutput[uPos] = (SI_CHAR) a_pInput[uPos];
+    }
+    return uPos;
+}
+
+/** Copy the leading ASCII characters of wide character data to UTF-8. This
+    is the reverse of SI_WidenAscii.
+ */
+template<class SI_CHAR>
+inline size_t SI_NarrowAscii(
+    const SI_CHAR * a_pInput,
+    size_t          a_uInputLen,
+    char *          a_pOutput,
+    size_t          a_uOutputLen
+    )
+{
+    size_t uLen = a_uInputLen < a_uOutputLen ? a_uInputLen : a_uOutputLen;
+    size_t uPos = 0;
+#ifdef SI_HAS_SSE2
+    if (sizeof(SI_CHAR) == 2 || sizeof(SI_CHAR) == 4) {
+        const __m128i vZero = _mm_setzero_si128();
+        const __m128i vHigh = (sizeof(SI_CHAR) == 2)
+            ? _mm_set1_epi16((short) 0xFF80) : _mm_set1_epi32((int) 0xFFFFFF80);
+        for (; uPos + 16 <= uLen; uPos += 16) {
+            // 16 characters take one load per byte of SI_CHAR
+            const __m128i * pIn = (const __m128i *) (a_pInput + uPos);
+            __m128i v[4], vAny = vZero;
+            for (size_t n = 0; n < sizeof(SI_CHAR); ++n) {
+                v[n] = _mm_loadu_si128(pIn + n);
+                vAny = _mm_or_si128(vAny, v[n]);
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(vAny, vHigh), vZero)) != 0xFFFF) {
+                break;
+            }
+
+            // every value is now below 0x80 so the saturation has no effect
+            if (sizeof(SI_CHAR) == 4) {
+                v[0] = _mm_packs_epi32(v[0], v[1]);
+                v[1] = _mm_packs_epi32(v[2], v[3]);
+            }
+            _mm_storeu_si128((__m128i *) (a_pOutput + uPos), _mm_packus_epi16(v[0], v[1]));
+        }
+    }
+#endif // SI_HAS_SSE2
+    for (; uPos < uLen && (unsigned long) a_pInput[uPos] < 0x80; ++uPos) {
+        a_pOutput[uPos] = (char) a_pInput[uPos];
+    }
+    return uPos;
+}
+
+template<class SI_CHAR> class SI_ConvertA;
+template<class SI_CHAR> struct SI_GenericCase;
+template<class SI_CHAR> struct SI_GenericNoCase;
+
+/** How names are hashed, which must treat names as equal whenever
+    SI_STRLESS does: 0 as they are, 1 ASCII case folded. It is -1 for a
+    comparison that the hash can't match, such as the Win32 SI_NoCase which
+    folds more than ASCII case, and then the hash index isn't used and
+    frozen data is searched instead. Specialise this for your own
+    comparison class to allow hashing.
+ */
+template<class SI_STRLESS>
+struct SI_HashFold { enum { value = -1 }; };
+
+template<class SI_CHAR>
+struct SI_HashFold< SI_GenericCase<SI_CHAR> > { enum { value = 0 }; };
+
+template<class SI_CHAR>
+struct SI_HashFold< SI_GenericNoCase<SI_CHAR> > { enum { value = 1 }; };
+
+/** FNV-1a hash of a NULL terminated string, optionally ASCII case folded.
+    The hash may be continued from a previous result with a_uHash.
+ */
+template<class SI_CHAR>
+inline constexpr unsigned long long SI_HashString(
+    const SI_CHAR *     a_pString,
+    bool                a_bFold,
+    unsigned long long  a_uHash = 14695981039346656037ULL
+    )
+{
+    for ( ; *a_pString; ++a_pString) {
+        unsigned long long ch = (unsigned long long) *a_pString;
+        if (a_bFold && ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+        a_uHash = (a_uHash ^ ch) * 1099511628211ULL;
+    }
+    return a_uHash;
+}
+
+#ifdef SI_HAS_PMR
+/** Memory resource that the data of an object is allocated from. */
+typedef std::pmr::memory_resource SI_MemoryResource;
+#else
+class SI_MemoryResource; // only NULL (the heap) can be used
+#endif
+
+/** Hash of a section name, or of a key within a section, as used by the hash
+    index and the frozen data. It is never 0, which marks an empty slot.
+ */
+template<class SI_CHAR>
+inline constexpr unsigned long long SI_HashName(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    bool            a_bFold
+    )
+{
+    unsigned long long uHash = SI_HashString(a_pSection, a_bFold);
+    if (a_pKey) {
+        uHash = SI_HashString(a_pKey, a_bFold, (uHash ^ 0xFF) * 1099511628211ULL);
+    }
+    return uHash ? uHash : 1;
+}
+
+/** Type of the default of a setting, strings are given as literals. */
+template<class SI_CHAR, class T>
+struct SI_SettingDefault { typedef T type; };
+
+template<class SI_CHAR, class TRAITS, class ALLOC>
+struct SI_SettingDefault< SI_CHAR, std::basic_string<SI_CHAR,TRAITS,ALLOC> > {
+    typedef const SI_CHAR * type;
+};
+
+/** One setting of a schema, see CSimpleIniTempl::ReadSettings(). It binds a
+    member of a settings struct to a key and holds the default used when the
+    key is missing. Both hashes of the name are computed when the schema is
+    constant initialised, so that it can be used with either case
+    sensitivity.
+ */
+template<class SI_CHAR, class TSettings, class T>
+struct SI_Setting {
+    typedef typename SI_SettingDefault<SI_CHAR,T>::type TDefault;
+
+    const SI_CHAR *     pSection;
+    const SI_CHAR *     pKey;
+    T TSettings::*      pMember;
+    TDefault            tDefault;
+    unsigned long long  uHash;      //!< hash of the name
+    unsigned long long  uHashFold;  //!< hash of the ASCII case folded name
+
+    constexpr SI_Setting(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        T TSettings::*  a_pMember,
+        TDefault        a_tDefault
+        )
+        : pSection(a_pSection), pKey(a_pKey), pMember(a_pMember)
+        , tDefault(a_tDefault)
+        , uHash(SI_HashName(a_pSection, a_pKey, false))
+        , uHashFold(SI_HashName(a_pSection, a_pKey, true))
+    { }
+};
+
+/** Create a setting of a schema, with the types taken from the member. A
+    schema is a std::tuple of settings, which can be constexpr:
+
+    <pre>
+        constexpr auto schema = std::make_tuple(
+            SI_MakeSetting("window", "width", &Settings::width, 800),
+            SI_MakeSetting("window", "title", &Settings::title, "Untitled"));
+    </pre>
+ */
+template<class SI_CHAR, class TSettings, class T, class TDefault>
+inline constexpr SI_Setting<SI_CHAR,TSettings,T> SI_MakeSetting(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    T TSettings::*  a_pMember,
+    TDefault        a_tDefault
+    )
+{
+    return SI_Setting<SI_CHAR,TSettings,T>(a_pSection, a_pKey, a_pMember,
+        static_cast<typename SI_SettingDefault<SI_CHAR,T>::type>(a_tDefault));
+}
+
+/** Parse a whole string as a decimal integer, or as hex if prefixed with
+    "0x". Leading whitespace and a leading '+' or '-' are skipped, a sign
+    may also follow the "0x" as strtol() allowed, so "-0x10" and "0x-10"
+    are both -16. Values out of range are clamped. Parsing doesn't depend
+    on the locale.
+ */
+inline bool SI_ParseLong(const char * a_pBegin, const char * a_pEnd, long & a_nValue) {
+    while (a_pBegin < a_pEnd && (*a_pBegin == ' ' || *a_pBegin == '\t')) ++a_pBegin;
+    bool bNegative = false;
+    if (a_pBegin < a_pEnd && (*a_pBegin == '+' || *a_pBegin == '-')) {
+        bNegative = *a_pBegin++ == '-';
+    }
+    int nBase = 10;
+    if (a_pEnd - a_pBegin > 2 && a_pBegin[0] == '0' && (a_pBegin[1] == 'x' || a_pBegin[1] == 'X')) {
+        a_pBegin += 2;
+        nBase = 16;
+        if (a_pEnd - a_pBegin > 1 && (*a_pBegin == '+' || *a_pBegin == '-')) {
+            bNegative = (*a_pBegin++ == '-') != bNegative;
+        }
+    }
+
+    // parse the magnitude, from_chars() doesn't take a sign when unsigned
+    unsigned long uValue = 0;
+    std::from_chars_result r = std::from_chars(a_pBegin, a_pEnd, uValue, nBase);
+    if (r.ptr != a_pEnd || r.ptr == a_pBegin) {
+        return false;
+    }
+    if (r.ec == std::errc::result_out_of_range) {
+        uValue = ULONG_MAX;
+    }
+    if (bNegative) {
+        a_nValue = uValue <= (unsigned long) LONG_MAX ? -(long) uValue : LONG_MIN;
+    }
+    else {
+        a_nValue = uValue <= (unsigned long) LONG_MAX ? (long) uValue : LONG_MAX;
+    }
+    return true;
+}
+
+/** Parse a whole string as a floating point number, including the hex
+    floats ("0x1.8p3") and "inf" and "nan" that strtod() takes. Leading
+    whitespace and a leading '+' or '-' are skipped. Parsing doesn't depend
+    on the locale, except where the standard library lacks floating point
+    std::from_chars.
+ */
+inline bool SI_ParseDouble(const char * a_pBegin, const char * a_pEnd, double & a_nValue) {
+    while (a_pBegin < a_pEnd && (*a_pBegin == ' ' || *a_pBegin == '\t')) ++a_pBegin;
+#if defined(__cpp_lib_to_chars)
+    bool bNegative = false;
+    if (a_pBegin < a_pEnd && (*a_pBegin == '+' || *a_pBegin == '-')) {
+        bNegative = *a_pBegin++ == '-';
+    }
+    const char * pDigits = a_pBegin;
+    std::chars_format eFormat = std::chars_format::general;
+    if (a_pEnd - pDigits > 2 && pDigits[0] == '0' && (pDigits[1] == 'x' || pDigits[1] == 'X')) {
+        pDigits += 2;
+        eFormat = std::chars_format::hex;
+    }
+
+    // parse the magnitude, so that a '-' before "0x" works as in strtod()
+    std::from_chars_result r = std::from_chars(pDigits, a_pEnd, a_nValue, eFormat);
+    if (r.ptr == pDigits || r.ptr != a_pEnd || *pDigits == '-') {
+        return false;
+    }
+    if (r.ec == std::errc::result_out_of_range) {
+        a_nValue = strtod(a_pBegin, NULL);
+    }
+    if (bNegative) {
+        a_nValue = -a_nValue;
+    }
+    return true;
+#else // !__cpp_lib_to_chars
+    if (a_pBegin < a_pEnd && *a_pBegin == '+') ++a_pBegin;
+    char * pSuffix = NULL;
+    a_nValue = strtod(a_pBegin, &pSuffix);
+    return pSuffix != a_pBegin && pSuffix == a_pEnd;
+#endif // __cpp_lib_to_chars
+}
+
+/** Can an integer type hold a value without changing it? */
+template<class T>
+inline bool SI_IsInRange(long a_nValue) {
+    if (std::is_signed<T>::value) {
+        return a_nValue >= (long long) std::numeric_limits<T>::min()
+            && a_nValue <= (long long) std::numeric_limits<T>::max();
+    }
+    return a_nValue >= 0
+        && (unsigned long long) a_nValue <= (unsigned long long) std::numeric_limits<T>::max();
+}
+
+/** Parse numbers separated by commas into at most a_uCount values, as
+    SI_ParseLong() or SI_ParseDouble() would parse each one. Whitespace
+    around a number is skipped. Parsing stops at the first item that isn't
+    a number or doesn't fit in T.
+
+    @param a_ppRest     Optionally receives the end of the last number
+                        stored, which is a_pEnd if the whole list was parsed
+
+    @return Number of values stored
+ */
+template<class T>
+inline size_t SI_ParseList(
+    const char *    a_pBegin,
+    const char *    a_pEnd,
+    T *             a_pValues,
+    size_t          a_uCount,
+    const char **   a_ppRest = NULL
+    )
+{
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+        "lists are of integer or floating point numbers");
+
+    size_t uStored = 0;
+    const char * pItem = a_pBegin;
+    const char * pRest = a_pBegin;
+    while (uStored < a_uCount) {
+        const char * pComma = (const char *) memchr(pItem, ',', (size_t) (a_pEnd - pItem));
+        const char * pItemEnd = pComma ? pComma : a_pEnd;
+        const char * pLast = pItemEnd;
+        while (pLast > pItem && (pLast[-1] == ' ' || pLast[-1] == '\t')) --pLast;
+
+        if constexpr (std::is_integral<T>::value) {
+            long nValue = 0;
+            if (!SI_ParseLong(pItem, pLast, nValue) || !SI_IsInRange<T>(nValue)) {
+                break;
+            }
+            a_pValues[uStored++] = (T) nValue;
+        }
+        else {
+            double nValue = 0;
+            if (!SI_ParseDouble(pItem, pLast, nValue)) {
+                break;
+            }
+            double nLimit = (double) std::numeric_limits<T>::max();
+            if (std::isfinite(nValue) && (nValue > nLimit || nValue < -nLimit)) {
+                break;
+            }
+            a_pValues[uStored++] = (T) nValue;
+        }
+
+        pRest = pItemEnd;
+        if (!pComma) {
+            break;
+        }
+        pItem = pComma + 1;
+    }
+    if (a_ppRest) {
+        *a_ppRest = pRest;
+    }
+    return uStored;
+}
+
+//! Longest number written by SI_FormatNumber().
+constexpr size_t SI_NUMBER_CHARS = 32;
+
+/** Format a number in its shortest form that parses back to the same value.
+    The buffer must have room for SI_NUMBER_CHARS characters. Returns the end
+    of the text, which is not NULL terminated.
+ */
+template<class T>
+inline char * SI_FormatNumber(char * a_pBuf, T a_nValue) {
+#if !defined(__cpp_lib_to_chars)
+    // only the integer std::to_chars() may be instantiated here
+    if constexpr (std::is_floating_point<T>::value) {
+        return a_pBuf + snprintf(a_pBuf, SI_NUMBER_CHARS, "%.*g",
+            std::numeric_limits<T>::max_digits10, (double) a_nValue);
+    }
+    else {
+        return std::to_chars(a_pBuf, a_pBuf + SI_NUMBER_CHARS, a_nValue).ptr;
+    }
+#else // __cpp_lib_to_chars
+    return std::to_chars(a_pBuf, a_pBuf + SI_NUMBER_CHARS, a_nValue).ptr;
+#endif // __cpp_lib_to_chars
+}
+
+/** Parse a color as "#RRGGBB", "#RRGGBBAA" or 3 or 4 numbers from 0 to 255
+    separated by commas. The alpha is 255 when it isn't given. a_rgba is
+    only changed if the whole color is valid.
+ */
+inline bool SI_ParseColor(const char * a_pBegin, const char * a_pEnd, unsigned char a_rgba[4]) {
+    while (a_pBegin < a_pEnd && (*a_pBegin == ' ' || *a_pBegin == '\t')) ++a_pBegin;
+    while (a_pEnd > a_pBegin && (a_pEnd[-1] == ' ' || a_pEnd[-1] == '\t')) --a_pEnd;
+
+    unsigned char rgba[4] = { 0, 0, 0, 255 };
+    if (a_pBegin < a_pEnd && *a_pBegin == '#') {
+        ++a_pBegin;
+        size_t uLen = (size_t) (a_pEnd - a_pBegin);
+        if (uLen != 6 && uLen != 8) {
+            return false;
+        }
+        for (size_t n = 0; n < uLen / 2; ++n) {
+            const char * pHex = a_pBegin + 2 * n;
+            if (std::from_chars(pHex, pHex + 2, rgba[n], 16).ptr != pHex + 2) {
+                return false;
+            }
+        }
+    }
+    else {
+        const char * pRest = NULL;
+        size_t uCount = SI_ParseList(a_pBegin, a_pEnd, rgba, 4, &pRest);
+        if (uCount < 3 || pRest != a_pEnd) {
+            return false;
+        }
+    }
+    memcpy(a_rgba, rgba, sizeof(rgba));
+    return true;
+}
+
+/** Does the converter copy the storage format through unchanged? Data loaded
+    with such a converter can be parsed directly from the file buffer.
+ */
+template<class SI_CONVERTER>
+struct SI_IsPassThrough { enum { value = 0 }; };
+
+template<>
+struct SI_IsPassThrough< SI_ConvertA<char> > { enum { value = 1 }; };
+
 
 // ---------------------------------------------------------------------------
 //                              MAIN TEMPLATE CLASS
@@ -323,23 +1037,37 @@ public:
     /** key entry */
     struct Entry {
         const SI_CHAR * pItem;
+#ifdef SI_NO_COMMENTS
+        static constexpr const SI_CHAR * pComment = NULL;   // never stored
+#else
         const SI_CHAR * pComment;
-        int             nOrder;
+#endif
+        mutable int     nOrder;     // renumbered in place, see CompactOrder()
 
         Entry(const SI_CHAR * a_pszItem = NULL, int a_nOrder = 0)
             : pItem(a_pszItem)
+#ifndef SI_NO_COMMENTS
             , pComment(NULL)
+#endif
             , nOrder(a_nOrder)
         { }
         Entry(const SI_CHAR * a_pszItem, const SI_CHAR * a_pszComment, int a_nOrder)
             : pItem(a_pszItem)
+#ifndef SI_NO_COMMENTS
             , pComment(a_pszComment)
+#endif
             , nOrder(a_nOrder)
-        { }
+        {
+#ifdef SI_NO_COMMENTS
+            (void) a_pszComment;
+#endif
+        }
         Entry(const Entry & rhs) { operator=(rhs); }
         Entry & operator=(const Entry & rhs) {
             pItem    = rhs.pItem;
+#ifndef SI_NO_COMMENTS
             pComment = rhs.pComment;
+#endif
             nOrder   = rhs.nOrder;
             return *this;
         }
@@ -369,6 +1097,18 @@ public:
         };
     };
 
+#ifdef SI_HAS_PMR
+    /** map keys to values */
+    typedef std::pmr::multimap<Entry,const SI_CHAR *,typename Entry::KeyOrder> TKeyVal;
+
+    /** map sections to key/value map */
+    typedef std::pmr::map<Entry,TKeyVal,typename Entry::KeyOrder> TSection;
+
+    /** set of dependent string pointers. Note that these pointers are
+        dependent on memory owned by CSimpleIni.
+    */
+    typedef std::pmr::list<Entry> TNamesDepend;
+#else
     /** map keys to values */
     typedef std::multimap<Entry,const SI_CHAR *,typename Entry::KeyOrder> TKeyVal;
 
@@ -379,61 +1119,358 @@ public:
         dependent on memory owned by CSimpleIni.
     */
     typedef std::list<Entry> TNamesDepend;
+#endif // SI_HAS_PMR
 
-    /** interface definition for the OutputWriter object to pass to Save()
-        in order to output the INI file data.
-    */
-    class OutputWriter {
-    public:
-        OutputWriter() { }
-        virtual ~OutputWriter() { }
-        virtual void Write(const char * a_pBuf) = 0;
-    private:
-        OutputWriter(const OutputWriter &);             // disable
-        OutputWriter & operator=(const OutputWriter &); // disable
+    /** Resolved reference to a value, see GetHandle(). A default
+        constructed handle is never valid.
+     */
+    struct Handle {
+        unsigned uSlot;
+        unsigned uGeneration;   //!< 0 is never used by a valid handle
+
+        Handle() : uSlot(0), uGeneration(0) { }
     };
 
-    /** OutputWriter class to write the INI data to a file */
-    class FileWriter : public OutputWriter {
-        FILE * m_file;
-    public:
-        FileWriter(FILE * a_file) : m_file(a_file) { }
-        void Write(const char * a_pBuf) {
-            fputs(a_pBuf, m_file);
-        }
-    private:
-        FileWriter(const FileWriter &);             // disable
-        FileWriter & operator=(const FileWriter &); // disable
+    /** Change made by ApplyBatch(). */
+    struct BatchOp {
+        const SI_CHAR * pSection;
+        const SI_CHAR * pKey;       //!< NULL for the section itself
+        const SI_CHAR * pValue;     //!< value to set, NULL for an empty value
+        bool            bDelete;    //!< delete the key or section instead
     };
 
-    /** OutputWriter class to write the INI data to a string */
-    class StringWriter : public OutputWriter {
-        std::string & m_string;
-    public:
-        StringWriter(std::string & a_string) : m_string(a_string) { }
-        void Write(const char * a_pBuf) {
-            m_string.append(a_pBuf);
-        }
-    private:
-        StringWriter(const StringWriter &);             // disable
-        StringWriter & operator=(const StringWriter &); // disable
+    /** Kind of difference found by Diff(). */
+    enum DiffType {
+        SI_DIFF_ADDED,      //!< key value or section only in the new data
+        SI_DIFF_REMOVED,    //!< key value or section only in the old data
+        SI_DIFF_CHANGED     //!< single value of a key that differs
     };
 
-#ifdef SI_SUPPORT_IOSTREAMS
-    /** OutputWriter class to write the INI data to an ostream */
-    class StreamWriter : public OutputWriter {
-        std::ostream & m_ostream;
+    /** Difference found by Diff(). The strings belong to the two objects
+        that were compared.
+     */
+    struct DiffEntry {
+        DiffType        eType;
+        const SI_CHAR * pSection;
+        const SI_CHAR * pKey;       //!< NULL for the section itself
+        const SI_CHAR * pOldValue;  //!< NULL unless removed or changed
+        const SI_CHAR * pNewValue;  //!< NULL unless added or changed
+    };
+
+    /** list of differences, see Diff() */
+    typedef std::vector<DiffEntry> TDiff;
+
+private:
+    struct FrozenSection;
+    struct FrozenKey;
+    struct FrozenSlot;
+    struct Subscription;
+
+public:
+    /** Iterator over the section names or the unique key names of a
+        section, see Sections() and Keys(). In key order it walks the data
+        table, in load order it follows the load order links. Any change to
+        the data invalidates it.
+     */
+    class NameIterator {
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef Entry                       value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef const Entry *               pointer;
+        typedef const Entry &               reference;
+
+        NameIterator()
+            : m_pIni(NULL), m_pKeys(NULL), m_iSection(), m_iKey(), m_nSlot(-1)
+            , m_bFrozen(false), m_pFrozen(NULL), m_uFrozen(0)
+        { }
+
+        reference operator*() const {
+            if (m_bFrozen) {
+                size_t uItem = m_nSlot < 0 ? m_uFrozen : m_pIni->m_frozenOrder[m_uFrozen];
+                return m_pFrozen ? m_pIni->m_frozenKeys[uItem].key
+                    : m_pIni->m_frozenSections[uItem].section;
+            }
+            if (m_nSlot < 0) {
+                return m_pKeys ? m_iKey->first : m_iSection->first;
+            }
+            const OrderSlot & slot = m_pIni->m_order[(size_t) m_nSlot];
+            return m_pKeys ? slot.iKey->first : slot.iSection->first;
+        }
+        pointer operator->() const { return &operator*(); }
+
+        NameIterator & operator++() {
+            if (m_bFrozen) {
+                ++m_uFrozen;
+                SkipRepeatedKeys();
+            }
+            else if (m_nSlot >= 0) {
+                m_nSlot = m_pIni->m_order[(size_t) m_nSlot].nNext;
+                SkipRepeatedKeys();
+            }
+            else if (!m_pKeys) {
+                ++m_iSection;
+            }
+            else {
+                // multiple values of a key are next to each other
+                const SI_CHAR * pKey = m_iKey->first.pItem;
+                do {
+                    ++m_iKey;
+                }
+                while (m_iKey != m_pKeys->end() && !m_pIni->IsLess(pKey, m_iKey->first.pItem));
+            }
+            return *this;
+        }
+        NameIterator operator++(int) {
+            NameIterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        bool operator==(const NameIterator & rhs) const {
+            if (m_bFrozen || rhs.m_bFrozen) {
+                return m_uFrozen == rhs.m_uFrozen;
+            }
+            if (m_nSlot >= 0 || rhs.m_nSlot >= 0) {
+                return m_nSlot == rhs.m_nSlot;
+            }
+            return m_pKeys ? m_iKey == rhs.m_iKey : m_iSection == rhs.m_iSection;
+        }
+        bool operator!=(const NameIterator & rhs) const { return !operator==(rhs); }
+
+    private:
+        friend class CSimpleIniTempl;
+
+        /** In load order every value of a key has its own link, only the
+            first one in the table is returned (as Save() does). */
+        void SkipRepeatedKeys() {
+            if (m_bFrozen) {
+                SkipRepeatedFrozenKeys();
+                return;
+            }
+            while (m_pKeys && m_nSlot > 0) {
+                typename TKeyVal::const_iterator iKey = m_pIni->m_order[(size_t) m_nSlot].iKey;
+                if (iKey == m_pKeys->begin()
+                    || m_pIni->IsLess(std::prev(iKey)->first.pItem, iKey->first.pItem))
+                {
+                    return;
+                }
+                m_nSlot = m_pIni->m_order[(size_t) m_nSlot].nNext;
+            }
+        }
+
+        /** The frozen keys are in the same order as the table, so in either
+            order a key is skipped if the one before it has the same name. */
+        void SkipRepeatedFrozenKeys() {
+            if (!m_pFrozen) {
+                return;
+            }
+            const size_t uOffset = m_nSlot < 0 ? 0 : m_pIni->m_frozenSections.size();
+            for ( ; m_uFrozen < uOffset + m_pFrozen->uEndKey; ++m_uFrozen) {
+                size_t uKey = m_nSlot < 0 ? m_uFrozen : m_pIni->m_frozenOrder[m_uFrozen];
+                if (uKey == m_pFrozen->uFirstKey
+                    || m_pIni->IsLess(m_pIni->m_frozenKeys[uKey - 1].key.pItem,
+                        m_pIni->m_frozenKeys[uKey].key.pItem))
+                {
+                    return;
+                }
+            }
+        }
+
+        const CSimpleIniTempl *             m_pIni;
+        const TKeyVal *                     m_pKeys;    //!< NULL for sections
+        typename TSection::const_iterator   m_iSection;
+        typename TKeyVal::const_iterator    m_iKey;
+        int                                 m_nSlot;    //!< load order slot, 0 at the end, -1 in key order
+        bool                                m_bFrozen;  //!< iterating the frozen data
+        const FrozenSection *               m_pFrozen;  //!< frozen section of the keys, NULL for sections
+        size_t                              m_uFrozen;  //!< frozen item, or position in m_frozenOrder in load order
+    };
+
+    /** Iterator over the values of a key, see Values(). Each value is
+        returned as an Entry in the same form as GetAllValues() uses.
+     */
+    class ValueIterator {
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef Entry                       value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef void                        pointer;
+        typedef Entry                       reference;
+
+        ValueIterator() : m_iKey(), m_pFrozen(NULL) { }
+
+        reference operator*() const {
+            if (m_pFrozen) {
+                return Entry(m_pFrozen->pValue, m_pFrozen->key.pComment, m_pFrozen->key.nOrder);
+            }
+            return Entry(m_iKey->second, m_iKey->first.pComment, m_iKey->first.nOrder);
+        }
+
+        ValueIterator & operator++() {
+            if (m_pFrozen) {
+                ++m_pFrozen;
+            }
+            else {
+                ++m_iKey;
+            }
+            return *this;
+        }
+        ValueIterator operator++(int) {
+            ValueIterator prev(*this);
+            ++*this;
+            return prev;
+        }
+
+        bool operator==(const ValueIterator & rhs) const {
+            if (m_pFrozen || rhs.m_pFrozen) {
+                return m_pFrozen == rhs.m_pFrozen;
+            }
+            return m_iKey == rhs.m_iKey;
+        }
+        bool operator!=(const ValueIterator & rhs) const { return !operator==(rhs); }
+
+    private:
+        friend class CSimpleIniTempl;
+        explicit ValueIterator(typename TKeyVal::const_iterator a_iKey) : m_iKey(a_iKey), m_pFrozen(NULL) { }
+        explicit ValueIterator(const FrozenKey * a_pFrozen) : m_iKey(), m_pFrozen(a_pFrozen) { }
+
+        typename TKeyVal::const_iterator    m_iKey;
+        const FrozenKey *                   m_pFrozen;  //!< frozen value, or NULL
+    };
+
+    /** A range of entries that can be used with range-for and std::ranges.
+        It holds no data of its own.
+     */
+    template<class SI_ITER>
+    class View {
+    public:
+        typedef SI_ITER iterator;
+        typedef SI_ITER const_iterator;
+
+        View() { }
+        View(SI_ITER a_begin, SI_ITER a_end) : m_begin(a_begin), m_end(a_end) { }
+
+        SI_ITER begin() const { return m_begin; }
+        SI_ITER end() const { return m_end; }
+        bool empty() const { return m_begin == m_end; }
+
+    private:
+        SI_ITER m_begin;
+        SI_ITER m_end;
+    };
+
+    typedef View<NameIterator>  TNameView;
+    typedef View<ValueIterator> TValueView;
+
+    /** interface definition for the OutputWriter object to pass to Save()
+        in order to output the INI file data.
+    */
+    class OutputWriter {
+    public:
+        OutputWriter() { }
+        virtual ~OutputWriter() { }
+        virtual void Write(const char * a_pBuf) = 0;
+
+        /** Write the first a_uLen characters of a_pBuf, which need not be
+            NULL terminated. Writers should override this when they can avoid
+            the copy made here.
+         */
+        virtual void Write(const char * a_pBuf, size_t a_uLen) {
+            Write(std::string(a_pBuf, a_uLen).c_str());
+        }
+    private:
+        OutputWriter(const OutputWriter &);             // disable
+        OutputWriter & operator=(const OutputWriter &); // disable
+    };
+
+    /** OutputWriter class to write the INI data to a file */
+    class FileWriter : public OutputWriter {
+        FILE * m_file;
+    public:
+        FileWriter(FILE * a_file) : m_file(a_file) { }
+        void Write(const char * a_pBuf) {
+            fputs(a_pBuf, m_file);
+        }
+        void Write(const char * a_pBuf, size_t a_uLen) {
+            fwrite(a_pBuf, 1, a_uLen, m_file);
+        }
+    private:
+        FileWriter(const FileWriter &);             // disable
+        FileWriter & operator=(const FileWriter &); // disable
+    };
+
+    /** OutputWriter class to write the INI data to a string */
+    class StringWriter : public OutputWriter {
+        std::string & m_string;
+    public:
+        StringWriter(std::string & a_string) : m_string(a_string) { }
+        void Write(const char * a_pBuf) {
+            m_string.append(a_pBuf);
+        }
+        void Write(const char * a_pBuf, size_t a_uLen) {
+            m_string.append(a_pBuf, a_uLen);
+        }
+    private:
+        StringWriter(const StringWriter &);             // disable
+        StringWriter & operator=(const StringWriter &); // disable
+    };
+
+#ifdef SI_SUPPORT_IOSTREAMS
+    /** OutputWriter class to write the INI data to an ostream */
+    class StreamWriter : public OutputWriter {
+        std::ostream & m_ostream;
     public:
         StreamWriter(std::ostream & a_ostream) : m_ostream(a_ostream) { }
         void Write(const char * a_pBuf) {
             m_ostream << a_pBuf;
         }
+        void Write(const char * a_pBuf, size_t a_uLen) {
+            m_ostream.write(a_pBuf, (std::streamsize) a_uLen);
+        }
     private:
         StreamWriter(const StreamWriter &);             // disable
         StreamWriter & operator=(const StreamWriter &); // disable
     };
 #endif // SI_SUPPORT_IOSTREAMS
 
+    /** interface definition for the ParseHandler object to pass to
+        ParseStream(). Each method is called as the entry is parsed and the
+        strings are only valid during the call. Return false from any of them
+        to stop parsing.
+    */
+    class ParseHandler {
+    public:
+        ParseHandler() { }
+        virtual ~ParseHandler() { }
+
+        /** The file comment, if there is one. */
+        virtual bool OnFileComment(const SI_CHAR * a_pComment) {
+            (void)a_pComment;
+            return true;
+        }
+
+        /** A section header, with the comment before it or NULL. */
+        virtual bool OnSection(const SI_CHAR * a_pSection, const SI_CHAR * a_pComment) {
+            (void)a_pSection;
+            (void)a_pComment;
+            return true;
+        }
+
+        /** A key, with the comment before it or NULL. Keys before the first
+            section header are in the section "".
+         */
+        virtual bool OnKey(
+            const SI_CHAR * a_pSection,
+            const SI_CHAR * a_pKey,
+            const SI_CHAR * a_pValue,
+            const SI_CHAR * a_pComment
+            ) = 0;
+    private:
+        ParseHandler(const ParseHandler &);             // disable
+        ParseHandler & operator=(const ParseHandler &); // disable
+    };
+
     /** Characterset conversion utility class to convert strings to the
         same format as is used for the storage.
     */
@@ -461,6 +1498,17 @@ public:
                 m_scratch.size());
         }
         const char * Data() { return m_scratch.data(); }
+
+        /** Convert a string and return the converted data, or NULL if it
+            can't be converted. Strings that don't need any conversion are
+            returned as they are instead of being copied.
+         */
+        const char * Convert(const SI_CHAR * a_pszString) {
+            if (SI_IsPassThrough<SI_CONVERTER>::value) {
+                return reinterpret_cast<const char *>(a_pszString);
+            }
+            return ConvertToStore(a_pszString) ? Data() : NULL;
+        }
     private:
         std::string m_scratch;
     };
@@ -473,11 +1521,15 @@ public:
         @param a_bIsUtf8     See the method SetUnicode() for details.
         @param a_bMultiKey   See the method SetMultiKey() for details.
         @param a_bMultiLine  See the method SetMultiLine() for details.
+        @param a_pResource   Memory resource for the data table and the copied
+                             strings, NULL for the default resource. It must
+                             outlive this object. See GetMemoryResource().
      */
     CSimpleIniTempl(
-        bool a_bIsUtf8    = false,
-        bool a_bMultiKey  = false,
-        bool a_bMultiLine = false
+        bool                a_bIsUtf8    = false,
+        bool                a_bMultiKey  = false,
+        bool                a_bMultiLine = false,
+        SI_MemoryResource * a_pResource  = NULL
         );
 
     /** Destructor */
@@ -486,8 +1538,74 @@ public:
     /** Deallocate all memory stored by this object */
     void Reset();
 
+    /** Memory resource that the sections, keys and values and the strings
+        copied into this object are allocated from, which is set when the
+        object is created. The data block of a load, the hash index, the
+        load order and frozen data are allocated from the heap. Loading in
+        parallel is only used with the heap resource (std::pmr::new_delete_
+        resource()), as other resources need not be thread-safe.
+
+        @return NULL        Memory resources are not supported (SI_HAS_PMR
+                            is not defined), everything is on the heap
+     */
+    SI_MemoryResource * GetMemoryResource() const {
+#ifdef SI_HAS_PMR
+        return m_data.get_allocator().resource();
+#else
+        return NULL;
+#endif
+    }
+
+    /** Compact the storage used by strings that were copied into this object
+        by SetValue() or by merging loads. Space freed by deleted values is
+        normally reused by later strings of a similar size, this pass copies
+        all live strings into new contiguous blocks and releases the old
+        ones. Any sections left by a lazy load are parsed first. Any string
+        pointers previously returned by this object, and the data returned
+        by GetSection(), are invalid after this call.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error CompactStrings();
+
+    /** Replace the data and settings of this object with a copy of those of
+        another object. All strings are copied, so the source may be changed
+        or destroyed afterwards. The load order is preserved.
+
+        @param a_oSource    Object to copy.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error CopyFrom(const CSimpleIniTempl & a_oSource);
+
+    /** Make the data read-only and move it into flat arrays sorted in the
+        same order as the data table, with a minimal perfect hash over the
+        section and key names. This releases the data table, the hash index
+        and the load order links, which take most of the memory used for each
+        entry, and a lookup then costs a single probe. See the frozen data
+        section for which methods can be used while frozen. The strings are
+        not moved, so pointers previously returned remain valid.
+
+        @return SI_FAIL     The names could not be hashed, the data is not
+                            frozen. This needs two names with the same 64 bit
+                            hash.
+        @return SI_OK       The data is frozen.
+     */
+    SI_Error Freeze();
+
+    /** Rebuild the data table from the frozen data so that it can be
+        changed again. The load order is preserved. Does nothing if the data
+        is not frozen.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error Thaw();
+
+    /** Is the data frozen, see Freeze() */
+    bool IsFrozen() const { return m_bFrozen; }
+
     /** Has any data been loaded */
-    bool IsEmpty() const { return m_data.empty(); }
+    bool IsEmpty() const { return m_data.empty() && m_frozenSections.empty(); }
 
     /*-----------------------------------------------------------------------*/
     /** @{ @name Settings */
@@ -592,6 +1710,122 @@ public:
     /** Do we allow keys to exist without a value or equals sign? */
     bool GetAllowKeyOnly() const { return m_bAllowKeyOnly; }
 
+    /** Discard all comments when loading data, for consumers that only
+        read the values. Comment lines are skipped without being kept or
+        joined into blocks, and no file, section or key comment is stored,
+        so Save() writes none. Comments given to SetValue() are still
+        stored. This value may be changed at any time and affects the next
+        load. When SI_NO_COMMENTS is defined comments are always discarded
+        and this setting has no effect.
+
+        \param a_bStripComments  Discard comments when loading?
+     */
+    void SetStripComments(bool a_bStripComments = true) {
+        m_bStripComments = a_bStripComments;
+    }
+
+    /** Are comments discarded when loading? */
+    bool IsStripComments() const {
+#ifdef SI_NO_COMMENTS
+        return true;
+#else
+        return m_bStripComments;
+#endif
+    }
+
+    /** Should LoadFile() memory map the file and parse it in place rather
+        than reading it into an allocated buffer. This is only possible on
+        POSIX systems and when no character conversion is needed, otherwise
+        the file is read normally. See the memory mapped files section for
+        the restrictions on the file while it is loaded. This value may be
+        changed at any time and affects the next load.
+
+        \param a_bMemoryMap  Map files instead of reading them?
+     */
+    void SetMemoryMapped(bool a_bMemoryMap = true) {
+        m_bMemoryMap = a_bMemoryMap;
+    }
+
+    /** Are files memory mapped when possible? */
+    bool IsMemoryMapped() const { return m_bMemoryMap; }
+
+    /** Maintain a hash index of all sections and keys in addition to the
+        sorted tables. Lookups by section and key (GetValue and the typed
+        getters, GetSection, GetAllValues, etc) then cost a single hash
+        probe instead of two tree searches. Load order, multi-key values and
+        iteration order are unaffected as the tables are still used for
+        everything else. Costs one table slot per section and per unique key.
+        This value may be changed at any time.
+
+        The index is only kept when the hash can match SI_STRLESS, see
+        SI_HashFold. With any other comparison this does nothing and
+        IsHashIndex() stays false.
+
+        \param a_bHashIndex  Maintain the hash index?
+     */
+    void SetHashIndex(bool a_bHashIndex = true) {
+        m_bHashIndex = a_bHashIndex && SI_HashFold<SI_STRLESS>::value >= 0;
+        RebuildIndex();
+    }
+
+    /** Is the hash index being maintained? */
+    bool IsHashIndex() const { return m_bHashIndex; }
+
+    /** Set the number of threads used to parse large files. See the parallel
+        loading section for when the data is split. A value of 1 (the default)
+        parses on the calling thread only, 0 uses one thread per hardware
+        thread. This value may be changed at any time and affects the next
+        load. It has no effect if SI_NO_THREADS is defined.
+
+        \param a_uThreads  Number of threads including the calling thread.
+     */
+    void SetLoadThreads(unsigned a_uThreads = 0) {
+#ifdef SI_HAS_THREADS
+        if (a_uThreads == 0) {
+            a_uThreads = std::thread::hardware_concurrency();
+        }
+#endif
+        m_uLoadThreads = a_uThreads ? a_uThreads : 1;
+    }
+
+    /** Number of threads used to parse large files. */
+    unsigned GetLoadThreads() const { return m_uLoadThreads; }
+
+    /** Remember the parsed result of GetLongValue() and GetDoubleValue() for
+        each value so that repeated reads of the same value only cost a
+        lookup. A cached result is discarded when the value is changed or
+        deleted. Note that the getters then modify the cache, so they must
+        not be called concurrently even though they are const. Turning the
+        cache off releases it.
+
+        \param a_bTypedCache  Cache the parsed numeric values?
+     */
+    void SetTypedCache(bool a_bTypedCache = true) {
+        m_bTypedCache = a_bTypedCache;
+        if (!a_bTypedCache) {
+            TTypedCache().swap(m_typedCache);
+        }
+    }
+
+    /** Are parsed numeric values cached? */
+    bool IsTypedCache() const { return m_bTypedCache; }
+
+    /** Only find the section headers when data is loaded, and parse the
+        keys of a section the first time they are read or changed. See the
+        lazy loading section for details. Note that the getters then modify
+        the data, so they must not be called concurrently even though they
+        are const, unless ParseLazySections() has been called. This value may
+        be changed at any time and affects the next load.
+
+        \param a_bLazyLoad  Parse sections on demand?
+     */
+    void SetLazyLoad(bool a_bLazyLoad = true) {
+        m_bLazyLoad = a_bLazyLoad;
+    }
+
+    /** Are sections parsed on demand? */
+    bool IsLazyLoad() const { return m_bLazyLoad; }
+
 
 
     /*-----------------------------------------------------------------------*/
@@ -633,6 +1867,51 @@ public:
         FILE * a_fpFile
         );
 
+    /** Load several files at the same time, each into its own object. The
+        files are read and parsed by up to a_uThreads threads, including the
+        calling thread. Each object is loaded as by LoadFile() with its own
+        settings, so they can be set up first. Subscriptions of an object
+        are called on the thread that loaded it, and a memory resource that
+        is shared by several of the objects must be thread-safe.
+
+        @param a_pszFiles   Paths of the files
+        @param a_uCount     Number of files
+        @param a_pIni       One object for each file
+        @param a_pResults   Optionally receives the result of each load
+        @param a_uThreads   Maximum number of threads, 0 for one for each
+                            hardware thread. Only the calling thread is
+                            used if SI_NO_THREADS is defined.
+
+        @return SI_Error    Result of the first file in the list that failed
+        @return SI_OK       Every file was loaded
+     */
+    static SI_Error LoadFiles(
+        const char * const *    a_pszFiles,
+        size_t                  a_uCount,
+        CSimpleIniTempl *       a_pIni,
+        SI_Error *              a_pResults = NULL,
+        unsigned                a_uThreads = 0
+        );
+
+    /** Load several files into this object, with the same result as calling
+        LoadFile() for each of them in the order given. The files are loaded
+        at the same time by LoadFiles() into objects with the settings of
+        this one, and their entries are then added in order. Loading stops
+        at the first file that failed, after the files before it have been
+        added.
+
+        @param a_pszFiles   Paths of the files
+        @param a_uCount     Number of files
+        @param a_uThreads   Maximum number of threads, see LoadFiles()
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error LoadFilesMerged(
+        const char * const *    a_pszFiles,
+        size_t                  a_uCount,
+        unsigned                a_uThreads = 0
+        );
+
 #ifdef SI_SUPPORT_IOSTREAMS
     /** Load INI file data from an istream.
 
@@ -667,6 +1946,66 @@ public:
         size_t          a_uDataLen
         );
 
+    /** Load a binary snapshot written by SaveSnapshot(). Any existing data
+        is discarded first. The strings are used directly from the snapshot
+        data, which is memory mapped if SetMemoryMapped() is enabled.
+
+        @param a_pszFile    Path of the snapshot file.
+        @param a_pszSource  Path of the INI file that the snapshot was made
+                            from, or NULL to skip checking that it is current.
+
+        @return SI_FILE     The snapshot could not be read.
+        @return SI_FAIL     The snapshot is invalid, was made by an
+                            incompatible build, or the source file changed.
+                            Nothing was loaded.
+        @return SI_Error    See error definitions
+     */
+    SI_Error LoadSnapshot(
+        const char *    a_pszFile,
+        const char *    a_pszSource = NULL
+        );
+
+    /** Parse the keys of every section that a lazy load has not parsed
+        yet, see SetLazyLoad(). Afterwards the const methods no longer modify
+        the data. Does nothing if there are none.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error ParseLazySections() const;
+
+    /** Parse INI data from a file pointer without loading it, passing each
+        entry to a handler as it is found. The data is read in chunks of
+        SI_STREAM_CHUNK_SIZE bytes and only the entries that are still being
+        parsed are held in memory, so files of any size can be processed,
+        including those over SI_MAX_FILE_SIZE. The data of this object is
+        not used or changed, but its settings (multi-line, quotes, key-only,
+        storage format) apply as they would to a load.
+
+        @param a_fpFile     Valid file pointer to read the file data from.
+        @param a_oHandler   Handler that receives the entries.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error ParseStream(
+        FILE *          a_fpFile,
+        ParseHandler &  a_oHandler
+        ) const;
+
+#ifdef SI_SUPPORT_IOSTREAMS
+    /** Parse INI data from an istream without loading it. See
+        ParseStream(FILE *, ParseHandler &) for details.
+
+        @param a_istream    Stream to read from
+        @param a_oHandler   Handler that receives the entries.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error ParseStream(
+        std::istream &  a_istream,
+        ParseHandler &  a_oHandler
+        ) const;
+#endif // SI_SUPPORT_IOSTREAMS
+
     /*-----------------------------------------------------------------------*/
     /** @}
         @{ @name Saving INI Data */
@@ -705,6 +2044,27 @@ public:
         ) const;
 #endif // _WIN32
 
+    /** Save an INI file from memory to disk, replacing any existing file
+        atomically. The data is written to a temporary file named a_pszFile
+        with ".tmp" appended, flushed to disk, and then renamed over the
+        original. If anything fails the original file is left untouched and
+        the temporary file is removed. Readers of the file, including the
+        memory mapped loads of other objects, always see either the old or
+        the new data in full.
+
+        @param a_pszFile    Path of the file to be saved.
+
+        @param a_bAddSignature  Prepend the UTF-8 BOM if the output data is
+                            in UTF-8 format. If it is not UTF-8 then
+                            this parameter is ignored.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error SaveFileAtomic(
+        const char *    a_pszFile,
+        bool            a_bAddSignature = true
+        ) const;
+
     /** Save the INI data to a file. See Save() for details.
 
         @param a_pFile      Handle to a file. File should be opened for
@@ -800,6 +2160,23 @@ public:
         return Save(writer, a_bAddSignature);
     }
 
+    /** Save the data as a binary snapshot to be loaded by LoadSnapshot().
+        The snapshot is only valid for builds using the same SI_CHAR type,
+        byte order, multi-key setting and case sensitivity.
+
+        @param a_pszFile    Path of the snapshot file to be written.
+        @param a_pszSource  Path of the INI file that the data was loaded
+                            from. Its size, modification time and the hash of
+                            its contents are stored so that LoadSnapshot() can
+                            detect when it has changed. May be NULL.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error SaveSnapshot(
+        const char *    a_pszFile,
+        const char *    a_pszSource = NULL
+        ) const;
+
     /*-----------------------------------------------------------------------*/
     /** @}
         @{ @name Accessing INI Data */
@@ -866,6 +2243,43 @@ public:
         TNamesDepend &  a_values
         ) const;
 
+    /** Iterate over all section names without copying them. This is the
+        same as GetAllSections(), but either sorted by name or in load order.
+        The view is invalidated by any change to the data.
+
+        @param a_bLoadOrder     Return the sections in load order rather
+                                 than sorted by name.
+     */
+    TNameView Sections(
+        bool            a_bLoadOrder = false
+        ) const;
+
+    /** Iterate over the unique key names of a section without copying them.
+        This is the same as GetAllKeys(), but either sorted by name or in load
+        order. The view is empty if the section doesn't exist, and is
+        invalidated by any change to the data.
+
+        @param a_pSection       Section to request data for
+        @param a_bLoadOrder     Return the keys in load order rather than
+                                 sorted by name.
+     */
+    TNameView Keys(
+        const SI_CHAR * a_pSection,
+        bool            a_bLoadOrder = false
+        ) const;
+
+    /** Iterate over all values of a key without copying them, in the order
+        they were added. This is the same as GetAllValues(). The view is empty
+        if the key doesn't exist, and is invalidated by any change to the data.
+
+        @param a_pSection       Section to search
+        @param a_pKey           Key to search for
+     */
+    TValueView Values(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        ) const;
+
     /** Query the number of keys in a specific section. Note that if multiple
         keys are enabled, then this value may be different to the number of
         keys returned by GetAllKeys.
@@ -889,6 +2303,9 @@ public:
         CSimpleIni object is not destroyed or Reset() while these strings
         are in use!
 
+        The data table is released while the data is frozen, so this
+        always returns NULL then, see Freeze().
+
         @param a_pSection       Name of the section to return
         @return                 Section data
      */
@@ -900,7 +2317,8 @@ public:
     inline bool SectionExists(
         const SI_CHAR * a_pSection
     ) const {
-        return GetSection(a_pSection) != NULL;
+        return m_bFrozen ? FindFrozen(a_pSection, NULL) != NULL
+            : GetSection(a_pSection) != NULL;
     }
 
     /** Test if the key exists in a section. Convenience function. */
@@ -1000,6 +2418,193 @@ public:
         bool *          a_pHasMultiple = NULL
         ) const;
 
+    /** Retrieve a list of numbers separated by commas, such as "800, 600",
+        into an array. Each number is parsed as by GetLongValue() or
+        GetDoubleValue() and must fit in T. Parsing stops at the first item
+        that isn't valid, and entries of the array that aren't stored keep
+        their values, so they can be set to defaults first. The value is
+        parsed where it is stored when it needs no conversion.
+
+        @param a_pSection       Section to search
+        @param a_pKey           Key to search for
+        @param a_pValues        Receives the numbers
+        @param a_uCount         Size of a_pValues
+        @param a_pHasMultiple   Optionally receive notification of if there are
+                                multiple entries for this key.
+
+        @return Number of values stored
+     */
+    template<class T>
+    size_t GetListValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        T *             a_pValues,
+        size_t          a_uCount,
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        return ParseValueText(GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple),
+            [&](const char * a_pBegin, const char * a_pEnd) {
+                return SI_ParseList(a_pBegin, a_pEnd, a_pValues, a_uCount);
+            });
+    }
+
+    /** Retrieve a color given as "#RRGGBB", "#RRGGBBAA" or as 3 or 4
+        numbers from 0 to 255 separated by commas. The alpha is 255 when it
+        isn't given.
+
+        @param a_pSection       Section to search
+        @param a_pKey           Key to search for
+        @param a_rgba           Receives the red, green, blue and alpha, it is
+                                unchanged if the key is missing or its value
+                                isn't a color
+        @param a_pHasMultiple   Optionally receive notification of if there are
+                                multiple entries for this key.
+
+        @return true            The value is a color
+     */
+    bool GetColorValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        unsigned char   a_rgba[4],
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        return ParseValueText(GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple),
+            [&](const char * a_pBegin, const char * a_pEnd) {
+                return SI_ParseColor(a_pBegin, a_pEnd, a_rgba) ? 1 : 0;
+            }) != 0;
+    }
+
+    /** Resolve a key to a handle so that it can be read repeatedly without
+        looking up the section and key names. If multiple keys are enabled
+        the handle refers to the first value of the key, as returned by
+        GetValue(). Resolving the same key again returns the same handle.
+
+        The handle stays valid when the value is changed with SetValue() or
+        any of the typed setters, including a replacement of all values of a
+        multi-key. It becomes invalid when the value is deleted, and when the
+        whole table is replaced: Reset(), LoadSnapshot(), CopyFrom(),
+        CompactStrings(), Freeze() and Thaw(). Handles resolved while the data
+        is frozen remain valid until it is thawed. A handle must only be used
+        with the object that returned it.
+
+        @param a_pSection       Section to search
+        @param a_pKey           Key to search for
+
+        @return Handle of the value, not valid if the key was not found
+     */
+    Handle GetHandle(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        );
+
+    /** Does the handle still refer to a value? */
+    bool IsValid(const Handle & a_hValue) const {
+        return a_hValue.uSlot < m_handles.size()
+            && m_handles[a_hValue.uSlot].uGeneration == a_hValue.uGeneration;
+    }
+
+    /** Retrieve the value that a handle refers to, see GetValue().
+
+        @param a_hValue         Handle returned by GetHandle()
+        @param a_pDefault       Value to return if the handle is not valid
+
+        @return a_pDefault      Handle is no longer valid
+        @return other           Current value of the key
+     */
+    const SI_CHAR * GetValue(
+        const Handle &  a_hValue,
+        const SI_CHAR * a_pDefault = NULL
+        ) const
+    {
+        if (!IsValid(a_hValue)) {
+            return a_pDefault;
+        }
+        const HandleSlot & oSlot = m_handles[a_hValue.uSlot];
+        return m_bFrozen ? m_frozenKeys[oSlot.uFrozen].pValue : oSlot.iKey->second;
+    }
+
+    /** Retrieve the numeric value that a handle refers to, see
+        GetLongValue().
+     */
+    long GetLongValue(
+        const Handle &  a_hValue,
+        long            a_nDefault = 0
+        ) const
+    {
+        return ParseLongValue(GetValue(a_hValue), a_nDefault);
+    }
+
+    /** Retrieve the numeric value that a handle refers to, see
+        GetDoubleValue().
+     */
+    double GetDoubleValue(
+        const Handle &  a_hValue,
+        double          a_nDefault = 0
+        ) const
+    {
+        return ParseDoubleValue(GetValue(a_hValue), a_nDefault);
+    }
+
+    /** Retrieve the boolean value that a handle refers to, see
+        GetBoolValue().
+     */
+    bool GetBoolValue(
+        const Handle &  a_hValue,
+        bool            a_bDefault = false
+        ) const
+    {
+        return ParseBoolValue(GetValue(a_hValue), a_bDefault);
+    }
+
+    /** Retrieve the values of several keys of one section. The section is
+        only looked up once. If multiple keys are enabled then only the
+        first value of each key is returned, as for GetValue().
+
+        @param a_pSection       Section to search
+        @param a_pKeys          Keys to search for, NULL entries are skipped
+        @param a_uCount         Number of keys
+        @param a_pValues        Receives the value of each key, or a_pDefault
+                                if it was not found
+        @param a_pDefault       Value to return for keys that are not found
+
+        @return Number of keys that were found
+     */
+    size_t GetValues(
+        const SI_CHAR *         a_pSection,
+        const SI_CHAR * const * a_pKeys,
+        size_t                  a_uCount,
+        const SI_CHAR **        a_pValues,
+        const SI_CHAR *         a_pDefault = NULL
+        ) const;
+
+    /** Read a settings struct described by a schema, see SI_MakeSetting().
+        Each key is found with the hash of its name from the schema, and
+        settings without a key or with a value that isn't valid for their
+        type are given their default. A setting may be bool, an integer or
+        floating point type, a const SI_CHAR * which points into the data
+        or a std::basic_string<SI_CHAR>. If multiple keys are enabled then
+        only the first value of each key is read, as for GetValue().
+
+        @param a_schema         Settings to read
+        @param a_settings       Struct to receive the values
+
+        @return Number of settings that have a key in the data
+     */
+    template<class TSettings, class... TFields>
+    size_t ReadSettings(
+        const std::tuple<TFields...> &  a_schema,
+        TSettings &                     a_settings
+        ) const
+    {
+        size_t uFound = 0;
+        std::apply([&](const TFields &... a_field) {
+            ((uFound += ReadSetting(a_field, a_settings) ? 1 : 0), ...);
+        }, a_schema);
+        return uFound;
+    }
+
     /** Add or update a section or value. This will always insert
         when multiple keys are enabled.
 
@@ -1128,6 +2733,50 @@ public:
         bool            a_bForceReplace = false
         );
 
+    /** Add or update a list of numbers, see GetListValue(). The numbers are
+        separated by ", " and written in the shortest form that reads back
+        as the same value. This will always insert when multiple keys are
+        enabled.
+
+        @param a_pSection   Section to add or update
+        @param a_pKey       Key to add or update.
+        @param a_pValues    Numbers to set.
+        @param a_uCount     Number of values.
+        @param a_pComment   Comment to be associated with the key. See the
+                            notes on SetValue() for comments.
+        @param a_bForceReplace  Should all existing values in a multi-key INI
+                            file be replaced with this entry. See
+                            SetLongValue().
+
+        @return SI_Error    See error definitions
+        @return SI_UPDATED  Value was updated
+        @return SI_INSERTED Value was inserted
+     */
+    template<class T>
+    SI_Error SetListValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        const T *       a_pValues,
+        size_t          a_uCount,
+        const SI_CHAR * a_pComment      = NULL,
+        bool            a_bForceReplace = false
+        );
+
+    /** Add or update a color, see GetColorValue(). It is written as 3
+        numbers, or 4 if the alpha isn't 255.
+     */
+    SI_Error SetColorValue(
+        const SI_CHAR *         a_pSection,
+        const SI_CHAR *         a_pKey,
+        const unsigned char     a_rgba[4],
+        const SI_CHAR *         a_pComment      = NULL,
+        bool                    a_bForceReplace = false
+        )
+    {
+        return SetListValue(a_pSection, a_pKey, a_rgba, a_rgba[3] == 255 ? 3 : 4,
+            a_pComment, a_bForceReplace);
+    }
+
     /** Delete an entire section, or a key from a section. Note that the
         data returned by GetSection is invalid and must not be used after
         anything has been deleted from that section using this method.
@@ -1179,6 +2828,150 @@ public:
         bool            a_bRemoveEmpty = false
         );
 
+    /** Apply several changes as one operation. Each change is a SetValue()
+        or a Delete() (which keeps an empty section) and they are applied in
+        the order given. The changes are checked and the storage for the
+        copied strings and the hash index is reserved before anything is
+        changed, and load orders are only renumbered once, at the end. This
+        is not a transaction: the entries of the data table are still
+        allocated one at a time, and if that fails the changes before it
+        stay made.
+
+        @param a_pOps           Changes to make
+        @param a_uCount         Number of changes
+        @param a_bForceReplace  Replace all values of a multi-key, see
+                                SetValue()
+
+        @return SI_FAIL         The data is frozen, or a change has no
+                                section. Nothing was changed.
+        @return SI_NOMEM        Out of memory. The changes before the one
+                                that failed may have been made.
+        @return SI_OK           All of the changes were made.
+     */
+    SI_Error ApplyBatch(
+        const BatchOp * a_pOps,
+        size_t          a_uCount,
+        bool            a_bForceReplace = false
+        );
+
+    /** Find what changes this data into a_other. Both tables are walked
+        once, side by side in key order, so the cost is that of reading
+        them and is not multiplied by lookups. Comments and load order are
+        not compared.
+
+        The differences are appended in key order. A section that was added
+        comes before its keys and one that was removed comes after them. A
+        key with a single value on each side that differs is changed,
+        otherwise when the values of a key differ all of its old values are
+        removed and all of its new values are added.
+
+        @param a_other          Newer version of the data
+        @param a_diff           Differences are appended here. The strings
+                                are only valid until either object is
+                                changed.
+
+        @return SI_NOMEM        Out of memory. a_diff may be incomplete.
+        @return SI_OK           a_diff holds every difference.
+     */
+    SI_Error Diff(
+        const CSimpleIniTempl & a_other,
+        TDiff &                 a_diff
+        ) const;
+
+    /** Make the changes found by Diff() to data which matches the old
+        version, as one operation in the same way as ApplyBatch(). The
+        strings are copied. Like ApplyBatch() this is not a transaction.
+
+        @param a_diff           Differences to apply
+        @param a_uCount         Number of differences
+
+        @return SI_FAIL         The data is frozen, or a difference has no
+                                section. Nothing was changed.
+        @return SI_NOMEM        Out of memory. The differences before the one
+                                that failed may have been applied.
+        @return SI_OK           All of the changes were made.
+     */
+    SI_Error ApplyDiff(
+        const DiffEntry *   a_pDiff,
+        size_t              a_uCount
+        );
+
+    /** Store a settings struct described by a schema, see ReadSettings().
+        Values are written as by the typed setters and replace all existing
+        values of their key.
+
+        @param a_schema         Settings to store
+        @param a_settings       Struct holding the values
+
+        @return SI_Error        See error definitions. Settings after the one
+                                that failed are not stored.
+     */
+    template<class TSettings, class... TFields>
+    SI_Error WriteSettings(
+        const std::tuple<TFields...> &  a_schema,
+        const TSettings &               a_settings
+        )
+    {
+        SI_Error rc = SI_OK;
+        std::apply([&](const TFields &... a_field) {
+            ((rc = rc < 0 ? rc : WriteSetting(a_field, a_settings.*a_field.pMember)), ...);
+        }, a_schema);
+        return rc < 0 ? rc : SI_OK;
+    }
+
+    /** Store the defaults of a schema, see WriteSettings(). */
+    template<class... TFields>
+    SI_Error WriteDefaults(
+        const std::tuple<TFields...> & a_schema
+        )
+    {
+        SI_Error rc = SI_OK;
+        std::apply([&](const TFields &... a_field) {
+            ((rc = rc < 0 ? rc : WriteSetting(a_field, a_field.tDefault)), ...);
+        }, a_schema);
+        return rc < 0 ? rc : SI_OK;
+    }
+
+    /** Function called by a subscription with a changed section and key.
+        The key is NULL when the section itself was added or removed. Use
+        GetValue() to read the new value, which is NULL if the key was
+        deleted.
+     */
+    typedef std::function<void(const SI_CHAR * a_pSection, const SI_CHAR * a_pKey)> ChangeCallback;
+
+    /** Call a function when values change. Changes made by SetValue() and
+        the typed setters, Delete(), DeleteValue(), ApplyBatch() and loading
+        data are reported once the call returns, and a key that changed
+        several times in one call is only reported once. Setting a key to
+        the value that it already has is not a change. Nothing is reported
+        by Reset(), CopyFrom(), LoadSnapshot() or Thaw(), which replace the
+        whole table, or when the object is destroyed.
+
+        A lazy load is not used while there are subscriptions, so that every
+        loaded key can be reported. The callback may change the data, which
+        is reported after the callback returns, and may subscribe or
+        unsubscribe. It must not throw.
+
+        @param a_pSection       Section to watch, or NULL for all sections
+        @param a_pKey           Key to watch, or NULL for all keys of the
+                                section and the section itself
+        @param a_fnCallback     Function to call
+        @param a_bPrefix        Watch all keys that start with a_pKey, or if
+                                a_pKey is NULL all sections that start with
+                                a_pSection
+
+        @return Id of the subscription, for Unsubscribe()
+     */
+    unsigned Subscribe(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        ChangeCallback  a_fnCallback,
+        bool            a_bPrefix = false
+        );
+
+    /** Remove a subscription returned by Subscribe(). */
+    void Unsubscribe(unsigned a_uId);
+
     /*-----------------------------------------------------------------------*/
     /** @}
         @{ @name Converter */
@@ -1200,1650 +2993,6308 @@ private:
     CSimpleIniTempl(const CSimpleIniTempl &); // disabled
     CSimpleIniTempl & operator=(const CSimpleIniTempl &); // disabled
 
-    /** Parse the data looking for a file comment and store it if found.
+    /** OutputWriter used by SaveFile(). The data is collected in a buffer
+        of SI_WRITE_BUFFER_SIZE bytes and written out when it is full, by
+        Flush() or when the writer is destroyed.
+     */
+    class BufferedFileWriter : public OutputWriter {
+        FILE *      m_file;
+        std::string m_buffer;
+        bool        m_bError;
+    public:
+        BufferedFileWriter(FILE * a_file) : m_file(a_file), m_bError(false) {
+            m_buffer.reserve(SI_WRITE_BUFFER_SIZE);
+        }
+        ~BufferedFileWriter() { Flush(); }
+        void Write(const char * a_pBuf) {
+            Write(a_pBuf, strlen(a_pBuf));
+        }
+        void Write(const char * a_pBuf, size_t a_uLen) {
+            if (m_buffer.size() + a_uLen > m_buffer.capacity()) {
+                Flush();
+                if (a_uLen >= m_buffer.capacity()) {
+                    if (fwrite(a_pBuf, 1, a_uLen, m_file) != a_uLen) {
+                        m_bError = true;
+                    }
+                    return;
+                }
+            }
+            m_buffer.append(a_pBuf, a_uLen);
+        }
+        /** Write out the buffered data. Returns false if any write failed. */
+        bool Flush() {
+            if (!m_buffer.empty()) {
+                if (fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size()) {
+                    m_bError = true;
+                }
+                m_buffer.clear();
+            }
+            return !m_bError;
+        }
+    private:
+        BufferedFileWriter(const BufferedFileWriter &);             // disable
+        BufferedFileWriter & operator=(const BufferedFileWriter &); // disable
+    };
+
+    /** Parse a block of converted data into our data table. If data has
+        already been loaded then the strings are copied and the block is
+        released, otherwise ownership of the block is taken.
+
+        @param a_pData      NULL terminated data, a_uDataLen + 1 SI_CHAR long.
+        @param a_uDataLen   Length of the data excluding the NULL terminator.
+        @param a_pMapBase   Base address of the mapping if a_pData points into
+                            a memory mapped file, otherwise NULL.
+        @param a_uMapLen    Length of the mapping.
     */
-    SI_Error FindFileComment(
+    SI_Error ParseData(
+        SI_CHAR *       a_pData,
+        size_t          a_uDataLen,
+        void *          a_pMapBase,
+        size_t          a_uMapLen
+        );
+
+    /** Split the data at section headers and parse the chunks on several
+        threads. Does nothing if the data is too small or can't be split,
+        otherwise a_pData is moved to the end of the data.
+    */
+    SI_Error ParseParallel(
         SI_CHAR *&      a_pData,
-        bool            a_bCopyStrings
+        size_t          a_uDataLen
         );
 
-    /** Parse the data looking for the next valid entry. The memory pointed to
-        by a_pData is modified by inserting NULL characters. The pointer is
-        updated to the current location in the block of text.
+    /** Find where to split the data before the first section header line
+        at or after a_pData, which is just after the last line before the
+        header that FindEntry() returns an entry for. The comment and
+        invalid lines in between then stay with the header, as they do when
+        the data is parsed in one go. Returns NULL if there is no header, or
+        if the start would be at or before a_pMin.
     */
-    bool FindEntry(
-        SI_CHAR *&  a_pData,
-        const SI_CHAR *&  a_pSection,
-        const SI_CHAR *&  a_pKey,
-        const SI_CHAR *&  a_pVal,
-        const SI_CHAR *&  a_pComment
+    SI_CHAR * FindSectionStart(
+        SI_CHAR *       a_pData,
+        const SI_CHAR * a_pMin
         ) const;
 
-    /** Add the section/key/value to our data.
+    /** Start of the line before a_pLine, not before a_pMin. Each newline
+        character ends a line, so CRLF gives an extra empty line.
+    */
+    SI_CHAR * PrevLine(
+        SI_CHAR *       a_pLine,
+        const SI_CHAR * a_pMin
+        ) const;
 
-        @param a_pSection   Section name. Sections will be created if they
-                            don't already exist.
-        @param a_pKey       Key name. May be NULL to create an empty section.
-                            Existing entries will be updated. New entries will
-                            be created.
-        @param a_pValue     Value for the key.
-        @param a_pComment   Comment to be associated with the section or the
-                            key. If a_pKey is NULL then it will be associated
-                            with the section, otherwise the key. This must be
-                            a string in full comment form already (have a
-                            comment character starting every line).
-        @param a_bForceReplace  Should all existing values in a multi-key INI
-                            file be replaced with this entry. This option has
-                            no effect if not using multi-key files. The 
-                            difference between Delete/AddEntry and AddEntry
-                            with a_bForceReplace = true, is that the load 
-                            order and comment will be preserved this way.
-        @param a_bCopyStrings   Should copies of the strings be made or not.
-                            If false then the pointers will be used as is.
+    /** What FindEntry() makes of the line from a_pLine to a_pEnd on its
+        own: 1 an entry, 0 nothing (a blank, comment or invalid line), -1 an
+        incomplete section header, which may continue onto the next line.
     */
-    SI_Error AddEntry(
-        const SI_CHAR * a_pSection,
-        const SI_CHAR * a_pKey,
-        const SI_CHAR * a_pValue,
-        const SI_CHAR * a_pComment,
-        bool            a_bForceReplace,
-        bool            a_bCopyStrings
-        );
+    int GetLineKind(
+        SI_CHAR *       a_pLine,
+        const SI_CHAR * a_pEnd
+        ) const;
 
-    /** Is the supplied character a whitespace character? */
-    inline bool IsSpace(SI_CHAR ch) const {
-        return (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n');
-    }
+    /** Split the data at section headers, add the sections and keep the
+        rest of each one to be parsed by ParseLazySection(). Does nothing if
+        the data can't be split, otherwise a_pData is moved to the end of the
+        data.
+    */
+    SI_Error ParseLazy(
+        SI_CHAR *&      a_pData,
+        size_t          a_uDataLen
+        );
 
-    /** Does the supplied character start a comment line? */
-    inline bool IsComment(SI_CHAR ch) const {
-        return (ch == ';' || ch == '#');
-    }
+    /** Parse the keys of a section that have not been parsed yet by a lazy
+        load. This modifies the data even though it is const, as the getters
+        that call it are.
+    */
+    SI_Error ParseLazySection(
+        const SI_CHAR * a_pSection
+        ) const;
 
+    /** Parse every entry of a chunk of data into this object, which holds
+        no data of its own. Strings are not copied and a_pEmpty (the empty
+        string of the object that the chunk is merged into) is used for the
+        initial section and for keys without a value.
+    */
+    SI_Error ParseChunk(
+        SI_CHAR *       a_pData,
+        const SI_CHAR * a_pEmpty
+        );
 
-    /** Skip over a newline character (or characters) for either DOS or UNIX */
-    inline void SkipNewLine(SI_CHAR *& a_pData) const {
-        a_pData += (*a_pData == '\r' && *(a_pData+1) == '\n') ? 2 : 1;
-    }
+    /** Move the data of a chunk parsed by ParseChunk into this object. */
+    SI_Error MergeChunk(
+        CSimpleIniTempl & a_oChunk
+        );
 
-    /** Make a copy of the supplied string, replacing the original pointer */
-    SI_Error CopyString(const SI_CHAR *& a_pString);
+    /** Parse the data returned by a_fnRead, a callable that fills a buffer
+        as `size_t (char * a_pBuf, size_t a_uLen)` and returns the number of
+        bytes read, 0 at the end of the data or (size_t)-1 on error.
+     */
+    template<class SI_READ>
+    SI_Error ParseStreamData(
+        SI_READ &       a_fnRead,
+        ParseHandler &  a_oHandler
+        ) const;
 
-    /** Delete a string from the copied strings buffer if necessary */
-    void DeleteString(const SI_CHAR * a_pString);
+    /** Find the end of the data that can be parsed without seeing what
+        follows it. This is the start of the lines before the last entry that
+        FindEntry would skip or use as its comment, and is never inside a
+        multi-line value.
+     */
+    size_t FindStreamSplit(
+        const SI_CHAR * a_pData,
+        size_t          a_uDataLen
+        ) const;
 
-    /** Internal use of our string comparison function */
-    bool IsLess(const SI_CHAR * a_pLeft, const SI_CHAR * a_pRight) const {
-        const static SI_STRLESS isLess = SI_STRLESS();
-        return isLess(a_pLeft, a_pRight);
+    /** Find a section, using the hash index if it is enabled. */
+    typename TSection::iterator FindSection(const SI_CHAR * a_pSection);
+    typename TSection::const_iterator FindSection(const SI_CHAR * a_pSection) const {
+        return const_cast<CSimpleIniTempl *>(this)->FindSection(a_pSection);
     }
 
-    bool IsMultiLineTag(const SI_CHAR * a_pData) const;
-    bool IsMultiLineData(const SI_CHAR * a_pData) const;
-    bool IsSingleLineQuotedValue(const SI_CHAR* a_pData) const;
-    bool LoadMultiLineText(
-        SI_CHAR *&          a_pData,
-        const SI_CHAR *&    a_pVal,
-        const SI_CHAR *     a_pTagName,
-        bool                a_bAllowBlankLinesInComment = false
+    /** Find the first entry for a key, using the hash index if it is
+        enabled. Returns false if the section or key doesn't exist.
+     */
+    bool FindKey(
+        const SI_CHAR *                     a_pSection,
+        const SI_CHAR *                     a_pKey,
+        typename TSection::const_iterator & a_iSection,
+        typename TKeyVal::const_iterator &  a_iKey
         ) const;
-    bool IsNewLineChar(SI_CHAR a_c) const;
 
-    bool OutputMultiLineText(
-        OutputWriter &  a_oOutput,
-        Converter &     a_oConverter,
-        const SI_CHAR * a_pText
+    /** Find a section (a_pKey == NULL) or the first value of a key in the
+        frozen data. Returns NULL if it doesn't exist.
+     */
+    const FrozenSlot * FindFrozen(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        ) const
+    {
+        return a_pSection ? FindFrozen(a_pSection, a_pKey, HashName(a_pSection, a_pKey)) : NULL;
+    }
+
+    /** Find a name in the frozen data with a hash from HashName(). */
+    const FrozenSlot * FindFrozen(
+        const SI_CHAR *     a_pSection,
+        const SI_CHAR *     a_pKey,
+        unsigned long long  a_uHash
         ) const;
 
-private:
-    /** Copy of the INI file data in our character format. This will be
-        modified when parsed to have NULL characters added after all
-        interesting string entries. All of the string pointers to sections,
-        keys and values point into this block of memory.
+    /** Slot of a hashed name in a table of a_uSlots entries, for a given
+        seed. Seed 0 is used to find the bucket of the name.
      */
-    SI_CHAR * m_pData;
+    static size_t GetFrozenSlot(
+        unsigned long long  a_uHash,
+        unsigned            a_uSeed,
+        size_t              a_uSlots
+        )
+    {
+        unsigned long long x = a_uHash ^ (a_uSeed * 0x9E3779B97F4A7C15ULL);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
 
-    /** Length of the data that we have stored. Used when deleting strings
-        to determine if the string is stored here or in the allocated string
-        buffer.
+        // scale the high bits instead of dividing, a_uSlots is below 2^32
+        return (size_t) ((((x ^ (x >> 31)) >> 32) * a_uSlots) >> 32);
+    }
+
+    /** Build the perfect hash of the frozen data. Returns false if two
+        names have the same hash.
      */
-    size_t m_uDataLen;
+    bool BuildFrozenHash();
 
-    /** File comment for this data, if one exists. */
-    const SI_CHAR * m_pFileComment;
+    /** Call a_fnTask(n) for each n below a_uCount on up to a_uThreads
+        threads (0 for one for each hardware thread) including the calling
+        thread. Each task is run by whichever thread takes it next, so that
+        a few long tasks don't hold up the rest. Tasks must not throw.
+     */
+    template<class TTask>
+    static void LoadInParallel(
+        size_t      a_uCount,
+        unsigned    a_uThreads,
+        TTask       a_fnTask
+        );
 
-    /** constant empty string */
-    const SI_CHAR m_cEmptyString;
+    /** Copy the settings of another object, see CopyFrom(). */
+    void CopySettings(const CSimpleIniTempl & a_oSource);
 
-    /** Parsed INI data. Section -> (Key -> Value). */
-    TSection m_data;
+    /** Add all entries of another object in its load order, copying the
+        strings. Every value of a multi-key is added as a new entry.
+     */
+    SI_Error AddEntries(const CSimpleIniTempl & a_oSource);
+
+    /** Add the frozen data of an object to the data table in load order. */
+    SI_Error AddFrozen(
+        const CSimpleIniTempl & a_oSource,
+        bool                    a_bCopyStrings
+        );
+
+    /** Write a section header and its comment. */
+    bool OutputSection(
+        OutputWriter &  a_oOutput,
+        Converter &     a_oConverter,
+        const Entry &   a_section,
+        bool &          a_bNeedNewLine
+        ) const;
 
-    /** This vector stores allocated memory for copies of strings that have
-        been supplied after the file load. It will be empty unless SetValue()
-        has been called.
+    /** Write a single value of a key and its comment. The key is written
+        as a_pKey, the name of its first entry, as all values of a multi-key
+        are written with the same name.
      */
-    TNamesDepend m_strings;
+    bool OutputKey(
+        OutputWriter &  a_oOutput,
+        Converter &     a_oConverter,
+        const SI_CHAR * a_pKey,
+        const Entry &   a_key,
+        const SI_CHAR * a_pValue
+        ) const;
 
-    /** Is the format of our datafile UTF-8 or MBCS? */
-    bool m_bStoreIsUtf8;
+    /** Hash of a section name, or of a key within a section. */
+    unsigned long long HashName(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        ) const
+    {
+        return SI_HashName(a_pSection, a_pKey, SI_HashFold<SI_STRLESS>::value > 0);
+    }
 
-    /** Are multiple values permitted for the same key? */
-    bool m_bAllowMultiKey;
+    /** Find the hash index slot of a section (a_pKey == NULL) or key. */
+    size_t FindIndexSlot(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        ) const
+    {
+        return a_pSection ? FindIndexSlot(a_pSection, a_pKey, HashName(a_pSection, a_pKey))
+            : (size_t) -1;
+    }
 
-    /** Are data values permitted to span multiple lines? */
-    bool m_bAllowMultiLine;
+    /** Find the hash index slot of a name with a hash from HashName(). */
+    size_t FindIndexSlot(
+        const SI_CHAR *     a_pSection,
+        const SI_CHAR *     a_pKey,
+        unsigned long long  a_uHash
+        ) const;
 
-    /** Should spaces be written out surrounding the equals sign? */
-    bool m_bSpaces;
-    
-    /** Should quoted data in values be recognized and parsed? */
-    bool m_bParseQuotes;
+    /** Add the section or the first entry of a key to the hash index. */
+    void IndexInsert(
+        typename TSection::iterator a_iSection,
+        typename TKeyVal::iterator  a_iKey,
+        bool                        a_bKey
+        );
 
-    /** Do keys always need to have an equals sign when reading/writing? */
-    bool m_bAllowKeyOnly;
+    /** Remove a section or key from the hash index. */
+    void IndexErase(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        );
 
-    /** Next order value, used to ensure sections and keys are output in the
-        same order that they are loaded/added.
+    /** Rebuild the hash index from the data, or clear it if not in use. */
+    void RebuildIndex();
+
+    /** Link a section (a_bKey == false) or key into the load order, after
+        its entry has been inserted into the data.
      */
-    int m_nOrder;
-};
+    void OrderLink(
+        typename TSection::iterator a_iSection,
+        typename TKeyVal::iterator  a_iKey,
+        bool                        a_bKey
+        );
 
-// ---------------------------------------------------------------------------
-//                                  IMPLEMENTATION
-// ---------------------------------------------------------------------------
+    /** Unlink the section or key with this load order, before its entry is
+        removed from the data. The keys of a section are unlinked first.
+     */
+    void OrderUnlink(int a_nOrder);
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CSimpleIniTempl(
-    bool a_bIsUtf8,
-    bool a_bAllowMultiKey,
-    bool a_bAllowMultiLine
-    )
-  : m_pData(0)
-  , m_uDataLen(0)
-  , m_pFileComment(NULL)
-  , m_cEmptyString(0)
-  , m_bStoreIsUtf8(a_bIsUtf8)
-  , m_bAllowMultiKey(a_bAllowMultiKey)
-  , m_bAllowMultiLine(a_bAllowMultiLine)
-  , m_bSpaces(true)
-  , m_bParseQuotes(false)
-  , m_bAllowKeyOnly(false)
-  , m_nOrder(0)
-{ }
+    /** Renumber the load orders to remove the gaps left by deleted entries. */
+    void CompactOrder();
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::~CSimpleIniTempl()
+    /** Rebuild the load order from the orders stored in the data. This
+        invalidates every handle.
+     */
+    void RebuildOrder();
+
+    /** Make sure that a_uLen SI_CHAR of copied strings (including their
+        headers) can be allocated without allocating memory.
+     */
+    SI_Error ReserveStrings(size_t a_uLen);
+
+    /** Make sure that the hash index can hold a_uCount entries without
+        growing.
+     */
+    void IndexReserve(size_t a_uCount);
+
+    /** Copied strings that AddEntry() may need for a change, and the
+        entries it may add are counted in a_uEntries. See ApplyBatch().
+     */
+    size_t BatchStrings(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        const SI_CHAR * a_pValue,
+        bool            a_bForceReplace,
+        size_t &        a_uEntries
+        ) const;
+
+    /** Values of the key that a key order iterator from Keys() is on. */
+    TValueView KeyValues(const NameIterator & a_iKey) const;
+
+    /** Append the differences between the values of a key, see Diff().
+        The values are NULL on the side that doesn't have the key.
+     */
+    static void DiffKey(
+        const SI_CHAR *     a_pSection,
+        const SI_CHAR *     a_pKey,
+        const TValueView *  a_pOldValues,
+        const TValueView *  a_pNewValues,
+        TDiff &             a_diff
+        );
+
+    /** Take a free handle slot, or add one. Returns its index. */
+    unsigned NewHandle();
+
+    /** Release a handle slot so that handles to it are no longer valid. */
+    void FreeHandle(unsigned a_uSlot);
+
+    /** Release every handle slot, when the data table is replaced. */
+    void FreeHandles();
+
+    /** Does the name start with the prefix? Compared with SI_STRLESS. */
+    bool IsPrefix(const SI_CHAR * a_pName, const SI_CHAR * a_pPrefix) const;
+
+    /** Does the subscription watch the key, or the section if a_pKey is
+        NULL?
+     */
+    bool IsSubscribed(
+        const Subscription &    a_oSub,
+        const SI_CHAR *         a_pSection,
+        const SI_CHAR *         a_pKey
+        ) const;
+
+    /** Remember a change for the subscriptions that watch it. a_pKey is NULL
+        for a section that was added or removed.
+     */
+    void RecordChange(const SI_CHAR * a_pSection, const SI_CHAR * a_pKey);
+
+    /** Call the subscriptions for the recorded changes. */
+    void NotifyChanges();
+
+    /** Changes are reported when the outermost scope ends, so that the
+        changes made by one call are reported together.
+     */
+    class ChangeScope {
+    public:
+        explicit ChangeScope(CSimpleIniTempl & a_oIni) : m_oIni(a_oIni) {
+            ++m_oIni.m_nChangeDepth;
+        }
+        ~ChangeScope() {
+            if (--m_oIni.m_nChangeDepth == 0) {
+                m_oIni.NotifyChanges();
+            }
+        }
+    private:
+        ChangeScope(const ChangeScope &); // disabled
+        ChangeScope & operator=(const ChangeScope &); // disabled
+        CSimpleIniTempl & m_oIni;
+    };
+
+    /** Allocator of the data table for a memory resource, see the
+        constructor.
+     */
+    static typename TSection::allocator_type GetAllocator(
+        SI_MemoryResource * a_pResource
+        )
+    {
+#ifdef SI_HAS_PMR
+        return typename TSection::allocator_type(
+            a_pResource ? a_pResource : std::pmr::get_default_resource());
+#else
+        (void) a_pResource;
+        return typename TSection::allocator_type();
+#endif
+    }
+
+    /** Allocate a block for copied strings from the memory resource.
+        Returns NULL if out of memory.
+     */
+    SI_CHAR * AllocBlock(size_t a_uSize);
+
+    /** Release a block returned by AllocBlock(). */
+    void FreeBlock(SI_CHAR * a_pBlock, size_t a_uSize);
+
+    /** Release a data block allocated by LoadData or mapped by LoadFile. */
+    void FreeData(
+        SI_CHAR *       a_pData,
+        void *          a_pMapBase,
+        size_t          a_uMapLen
+        );
+
+    /** Try to load the file by mapping it into memory. Returns false if the
+        file could not be mapped and should be read normally instead.
+    */
+    bool LoadFileMapped(
+        FILE *          a_fpFile,
+        size_t          a_uFileSize,
+        SI_Error &      a_rc
+        );
+
+    /** Trailer at the end of a snapshot file, after the string table (padded
+        to 8 bytes) and the records. Each section record is followed by the
+        records of its keys.
+     */
+    struct SnapshotTrailer {
+        char                szMagic[8];     //!< SI_SNAPSHOT_MAGIC
+        unsigned int        uByteOrder;     //!< 0x01020304 as written
+        unsigned int        uVersion;       //!< SI_SNAPSHOT_VERSION
+        unsigned int        uFlags;         //!< sizeof(SI_CHAR) + SI_SNAP_* bits
+        unsigned int        uFileComment;   //!< string offset
+        unsigned long long  uStrings;       //!< string table length in SI_CHAR
+        unsigned long long  uRecords;       //!< number of records
+        unsigned long long  uSourceSize;
+        long long           nSourceTime;
+        unsigned long long  uSourceHash;
+    };
+
+    /** Snapshot record of a section or key. Strings are offsets into the
+        string table, or SI_SNAPSHOT_NONE for NULL. For a section uValue is
+        the number of keys that follow it.
+     */
+    struct SnapshotRecord {
+        unsigned int        uName;
+        unsigned int        uComment;
+        unsigned int        uValue;
+        int                 nOrder;
+    };
+
+    enum {
+        SI_SNAPSHOT_VERSION = 1,
+        SI_SNAPSHOT_NONE    = 0xFFFFFFFFu,
+        SI_SNAP_MULTIKEY    = 0x100,
+        SI_SNAP_FOLD        = 0x200,
+        SI_SNAP_UTF8        = 0x400
+    };
+
+    /** Get the size, modification time and a hash of the contents of the
+        source file of a snapshot. */
+    static bool GetSnapshotSource(
+        const char *            a_pszFile,
+        unsigned long long &    a_uSize,
+        long long &             a_nTime,
+        unsigned long long &    a_uHash
+        );
+
+    /** Flags that a snapshot must match to be loaded. */
+    unsigned int GetSnapshotFlags() const {
+        return (unsigned int) sizeof(SI_CHAR)
+            | (m_bAllowMultiKey ? (unsigned int) SI_SNAP_MULTIKEY : 0u)
+            | (SI_HashFold<SI_STRLESS>::value ? (unsigned int) SI_SNAP_FOLD : 0u);
+    }
+
+    /** Parse the data looking for a file comment and store it if found.
+    */
+    SI_Error FindFileComment(
+        SI_CHAR *&      a_pData,
+        bool            a_bCopyStrings
+        );
+
+    /** Parse the data looking for the next valid entry. The memory pointed to
+        by a_pData is modified by inserting NULL characters. The pointer is
+        updated to the current location in the block of text.
+    */
+    bool FindEntry(
+        SI_CHAR *&  a_pData,
+        const SI_CHAR *&  a_pSection,
+        const SI_CHAR *&  a_pKey,
+        const SI_CHAR *&  a_pVal,
+        const SI_CHAR *&  a_pComment
+        ) const;
+
+    /** Add the section/key/value to our data.
+
+        @param a_pSection   Section name. Sections will be created if they
+                            don't already exist.
+        @param a_pKey       Key name. May be NULL to create an empty section.
+                            Existing entries will be updated. New entries will
+                            be created.
+        @param a_pValue     Value for the key.
+        @param a_pComment   Comment to be associated with the section or the
+                            key. If a_pKey is NULL then it will be associated
+                            with the section, otherwise the key. This must be
+                            a string in full comment form already (have a
+                            comment character starting every line).
+        @param a_bForceReplace  Should all existing values in a multi-key INI
+                            file be replaced with this entry. This option has
+                            no effect if not using multi-key files. The 
+                            difference between Delete/AddEntry and AddEntry
+                            with a_bForceReplace = true, is that the load 
+                            order and comment will be preserved this way.
+        @param a_bCopyStrings   Should copies of the strings be made or not.
+                            If false then the pointers will be used as is.
+    */
+    SI_Error AddEntry(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        const SI_CHAR * a_pValue,
+        const SI_CHAR * a_pComment,
+        bool            a_bForceReplace,
+        bool            a_bCopyStrings
+        );
+
+    /** Is the supplied character a whitespace character? */
+    inline bool IsSpace(SI_CHAR ch) const {
+        return (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n');
+    }
+
+    /** Does the supplied character start a comment line? */
+    inline bool IsComment(SI_CHAR ch) const {
+        return (ch == ';' || ch == '#');
+    }
+
+
+    /** Skip over a newline character (or characters) for either DOS or UNIX */
+    inline void SkipNewLine(SI_CHAR *& a_pData) const {
+        a_pData += (*a_pData == '\r' && *(a_pData+1) == '\n') ? 2 : 1;
+    }
+
+    /** Parse a value for GetLongValue(), a_pValue may be NULL. */
+    long ParseLongValue(const SI_CHAR * a_pValue, long a_nDefault) const;
+
+    /** Parse a value for GetDoubleValue(), a_pValue may be NULL. */
+    double ParseDoubleValue(const SI_CHAR * a_pValue, double a_nDefault) const;
+
+    /** Parse a value for GetBoolValue(), a_pValue may be NULL. */
+    bool ParseBoolValue(const SI_CHAR * a_pValue, bool a_bDefault) const;
+
+    /** Find the first value of a key with a hash from HashName(). Returns
+        NULL if the key doesn't exist.
+     */
+    const SI_CHAR * FindValue(
+        const SI_CHAR *     a_pSection,
+        const SI_CHAR *     a_pKey,
+        unsigned long long  a_uHash
+        ) const;
+
+    /** Read one setting of a schema, see ReadSettings(). Returns true if the
+        data has its key.
+     */
+    template<class TSettings, class T>
+    bool ReadSetting(
+        const SI_Setting<SI_CHAR,TSettings,T> & a_field,
+        TSettings &                             a_settings
+        ) const
+    {
+        const SI_CHAR * pValue = FindValue(a_field.pSection, a_field.pKey,
+            SI_HashFold<SI_STRLESS>::value > 0 ? a_field.uHashFold : a_field.uHash);
+        T & tValue = a_settings.*a_field.pMember;
+        if constexpr (std::is_same<T, bool>::value) {
+            tValue = ParseBoolValue(pValue, a_field.tDefault);
+        }
+        else if constexpr (std::is_integral<T>::value) {
+            // values that don't fit the member are not valid
+            long nValue = ParseLongValue(pValue, (long) a_field.tDefault);
+            tValue = SI_IsInRange<T>(nValue) ? (T) nValue : a_field.tDefault;
+        }
+        else if constexpr (std::is_floating_point<T>::value) {
+            tValue = (T) ParseDoubleValue(pValue, (double) a_field.tDefault);
+        }
+        else if constexpr (std::is_pointer<T>::value) {
+            tValue = pValue ? pValue : a_field.tDefault;
+        }
+        else {
+            const SI_CHAR * pString = pValue ? pValue : a_field.tDefault;
+            if (pString) {
+                tValue = pString;
+            }
+            else {
+                tValue.clear();
+            }
+        }
+        return pValue != NULL;
+    }
+
+    /** Store one setting of a schema, see WriteSettings(). */
+    template<class TSettings, class T, class TValue>
+    SI_Error WriteSetting(
+        const SI_Setting<SI_CHAR,TSettings,T> & a_field,
+        const TValue &                          a_value
+        )
+    {
+        if constexpr (std::is_same<T, bool>::value) {
+            return SetBoolValue(a_field.pSection, a_field.pKey, a_value, NULL, true);
+        }
+        else if constexpr (std::is_integral<T>::value) {
+            return SetLongValue(a_field.pSection, a_field.pKey, (long) a_value, NULL, false, true);
+        }
+        else if constexpr (std::is_floating_point<T>::value) {
+            return SetDoubleValue(a_field.pSection, a_field.pKey, (double) a_value, NULL, true);
+        }
+        else if constexpr (std::is_pointer<TValue>::value) {
+            return SetValue(a_field.pSection, a_field.pKey, a_value, NULL, true);
+        }
+        else {
+            return SetValue(a_field.pSection, a_field.pKey, a_value.c_str(), NULL, true);
+        }
+    }
+
+    /** Get the text of a value to be parsed as a number. The value is
+        converted to UTF-8/MBCS (which for a number is the same as ASCII)
+        into a_pszBuf, unless it needs no conversion. Returns false if the
+        value couldn't be converted.
+     */
+    bool GetNumberText(
+        const SI_CHAR * a_pValue,
+        char *          a_pszBuf,
+        size_t          a_uBufLen,
+        const char *&   a_pszBegin,
+        const char *&   a_pszEnd
+        ) const
+    {
+        if (SI_IsPassThrough<SI_CONVERTER>::value) {
+            a_pszBegin = reinterpret_cast<const char *>(a_pValue);
+        }
+        else {
+            SI_CONVERTER c(m_bStoreIsUtf8);
+            if (!c.ConvertToStore(a_pValue, a_pszBuf, a_uBufLen)) {
+                return false;
+            }
+            a_pszBegin = a_pszBuf;
+        }
+        a_pszEnd = a_pszBegin + strlen(a_pszBegin);
+        return true;
+    }
+
+    /** Parse the text of a value with a_fnParse(begin, end), as for
+        GetNumberText() but without a limit on the length. Returns 0 if
+        there is no value or it couldn't be converted.
+     */
+    template<class TParse>
+    size_t ParseValueText(
+        const SI_CHAR * a_pValue,
+        TParse          a_fnParse
+        ) const
+    {
+        if (!a_pValue) {
+            return 0;
+        }
+        if (SI_IsPassThrough<SI_CONVERTER>::value) {
+            const char * pszValue = reinterpret_cast<const char *>(a_pValue);
+            return a_fnParse(pszValue, pszValue + strlen(pszValue));
+        }
+        Converter c(m_bStoreIsUtf8);
+        const char * pszValue = c.Convert(a_pValue);
+        return pszValue ? a_fnParse(pszValue, pszValue + strlen(pszValue)) : 0;
+    }
+
+    /** Make a copy of the supplied string, replacing the original pointer */
+    SI_Error CopyString(const SI_CHAR *& a_pString);
+
+    /** Delete a string from the copied strings buffer if necessary */
+    void DeleteString(const SI_CHAR * a_pString);
+
+    /** Is the string stored in the copied strings buffer? Strings stored
+        by this object are either in the loaded data block, the constant
+        empty string, or were allocated by AllocString().
+     */
+    bool IsCopiedString(const SI_CHAR * a_pString) const {
+        return a_pString && a_pString != &m_cEmptyString
+            && (!m_pData || a_pString < m_pData || a_pString >= m_pData + m_uDataLen);
+    }
+
+    /** Allocate space for a string of a_uLen SI_CHAR (including the NULL)
+        from the copied strings buffer.
+     */
+    SI_CHAR * AllocString(size_t a_uLen);
+
+    /** Release all blocks of the copied strings buffer */
+    void FreeStrings();
+
+    /** Internal use of our string comparison function */
+    bool IsLess(const SI_CHAR * a_pLeft, const SI_CHAR * a_pRight) const {
+        const static SI_STRLESS isLess = SI_STRLESS();
+        return isLess(a_pLeft, a_pRight);
+    }
+
+    bool IsMultiLineTag(const SI_CHAR * a_pData) const;
+    bool IsMultiLineData(const SI_CHAR * a_pData) const;
+    bool IsSingleLineQuotedValue(const SI_CHAR* a_pData) const;
+    bool LoadMultiLineText(
+        SI_CHAR *&          a_pData,
+        const SI_CHAR *&    a_pVal,
+        const SI_CHAR *     a_pTagName,
+        bool                a_bAllowBlankLinesInComment = false
+        ) const;
+    bool IsNewLineChar(SI_CHAR a_c) const;
+
+    bool OutputMultiLineText(
+        OutputWriter &  a_oOutput,
+        Converter &     a_oConverter,
+        const SI_CHAR * a_pText
+        ) const;
+
+private:
+    /** Copy of the INI file data in our character format. This will be
+        modified when parsed to have NULL characters added after all
+        interesting string entries. All of the string pointers to sections,
+        keys and values point into this block of memory.
+     */
+    SI_CHAR * m_pData;
+
+    /** Length of the data that we have stored. Used when deleting strings
+        to determine if the string is stored here or in the allocated string
+        buffer.
+     */
+    size_t m_uDataLen;
+
+    /** Base address and length of the file mapping that m_pData points into,
+        or NULL if m_pData was allocated.
+     */
+    void * m_pMapBase;
+    size_t m_uMapLen;
+
+    /** File comment for this data, if one exists. */
+    const SI_CHAR * m_pFileComment;
+
+    /** constant empty string */
+    const SI_CHAR m_cEmptyString;
+
+    /** Parsed INI data. Section -> (Key -> Value). */
+    TSection m_data;
+
+    /** Block of memory that copied strings are allocated from. */
+    struct StringBlock {
+        SI_CHAR *   pData;
+        size_t      uSize;
+        size_t      uUsed;
+    };
+
+    /** Number of free string size classes (powers of two). */
+    enum { SI_STRING_CLASSES = 32 };
+
+    /** Storage for copies of strings that have been supplied after the file
+        load. Strings are allocated sequentially from these blocks, each
+        prefixed by its capacity. It will be empty unless SetValue() has been
+        called or data has been merged.
+     */
+    std::vector<StringBlock> m_strings;
+
+    /** Strings that have been deleted, bucketed by the largest power of two
+        that fits their capacity so that they can be reused.
+     */
+    std::vector<SI_CHAR *> m_freeStrings[SI_STRING_CLASSES];
+
+    /** Is the format of our datafile UTF-8 or MBCS? */
+    bool m_bStoreIsUtf8;
+
+    /** Are multiple values permitted for the same key? */
+    bool m_bAllowMultiKey;
+
+    /** Are data values permitted to span multiple lines? */
+    bool m_bAllowMultiLine;
+
+    /** Should spaces be written out surrounding the equals sign? */
+    bool m_bSpaces;
+    
+    /** Should quoted data in values be recognized and parsed? */
+    bool m_bParseQuotes;
+
+    /** Do keys always need to have an equals sign when reading/writing? */
+    bool m_bAllowKeyOnly;
+
+    /** Should files be memory mapped when loading? */
+    bool m_bMemoryMap;
+
+    /** Are comments discarded when loading? */
+    bool m_bStripComments;
+
+    /** Number of threads used to parse large files. */
+    unsigned m_uLoadThreads;
+
+    /** Parsed numeric forms of a value, see SetTypedCache(). */
+    struct TypedValue {
+        long            nLong;
+        double          nDouble;
+        unsigned char   uFlags;     //!< SI_TYPED_* bits
+    };
+    enum {
+        SI_TYPED_LONG       = 1,    //!< nLong has been parsed
+        SI_TYPED_LONG_OK    = 2,    //!< nLong is valid
+        SI_TYPED_DOUBLE     = 4,    //!< nDouble has been parsed
+        SI_TYPED_DOUBLE_OK  = 8     //!< nDouble is valid
+    };
+    typedef std::unordered_map<const SI_CHAR *, TypedValue> TTypedCache;
+
+    /** Parsed numeric values keyed by the value string. Entries are removed
+        when the string is replaced or deleted so a pointer is never reused
+        with a stale result.
+     */
+    mutable TTypedCache m_typedCache;
+
+    /** Are parsed numeric values cached? */
+    bool m_bTypedCache;
+
+    /** Slot of the open addressing hash index. A slot refers to either a
+        section, or the first entry of a key within a section.
+     */
+    struct IndexSlot {
+        unsigned long long          uHash;  //!< 0 if the slot is empty
+        typename TSection::iterator iSection;
+        typename TKeyVal::iterator  iKey;
+        bool                        bKey;
+    };
+
+    /** Hash index of sections and keys, linear probing with a power of two
+        size. Empty unless m_bHashIndex is set.
+     */
+    std::vector<IndexSlot> m_index;
+
+    /** Number of used slots in m_index */
+    size_t m_uIndexCount;
+
+    /** Is the hash index maintained? */
+    bool m_bHashIndex;
+
+    /** Is ApplyBatch() deferring the load order compaction? */
+    bool m_bInBatch;
+
+    /** Are sections parsed on demand? */
+    bool m_bLazyLoad;
+
+    typedef std::unordered_map<const SI_CHAR *, std::vector<SI_CHAR *> > TLazySections;
+
+    /** Data of each section that a lazy load has not parsed yet, keyed by
+        the name of the section in the data table, in file order.
+     */
+    TLazySections m_lazy;
+
+    /** Next order value, used to ensure sections and keys are output in the
+        same order that they are loaded/added.
+     */
+    int m_nOrder;
+
+    /** Load order links of a section or key. Slot 0 of m_order is the head
+        of the list of sections, each section slot is the head of the list of
+        its keys.
+     */
+    struct OrderSlot {
+        typename TSection::iterator iSection;
+        typename TKeyVal::iterator  iKey;
+        int     nParent;    //!< order of the section of a key, 0 for a section
+        int     nPrev;      //!< previous entry in the parent list, or 0
+        int     nNext;      //!< next entry in the parent list, or 0
+        int     nFirst;     //!< first entry of this list, or 0
+        int     nLast;      //!< last entry of this list, or 0
+        unsigned uHandle;   //!< handle slot plus one, or 0
+        bool    bKey;
+        bool    bUsed;
+
+        OrderSlot()
+            : nParent(0), nPrev(0), nNext(0), nFirst(0), nLast(0)
+            , uHandle(0), bKey(false), bUsed(false)
+        { }
+    };
+
+    /** Every section and key indexed by its load order, so that Save() can
+        walk the data in load order without sorting it.
+     */
+    std::vector<OrderSlot> m_order;
+
+    /** Number of used slots in m_order */
+    size_t m_uOrderUsed;
+
+    /** Section of the frozen data, see Freeze(). */
+    struct FrozenSection {
+        Entry       section;
+        unsigned    uFirstKey;  //!< first value of the section in m_frozenKeys
+        unsigned    uEndKey;    //!< end of the values of the section
+    };
+
+    /** Value of a key in the frozen data. The values of a key are next to
+        each other in the order they were added, as in the data table.
+     */
+    struct FrozenKey {
+        Entry           key;
+        const SI_CHAR * pValue;
+    };
+
+    /** Slot of the frozen perfect hash, a section or the first value of a
+        key.
+     */
+    struct FrozenSlot {
+        const SI_CHAR * pSection;   //!< name of the section, saves a read
+        unsigned        uSection;
+        unsigned        uKey;       //!< SI_FROZEN_NONE for a section
+    };
+    enum {
+        SI_FROZEN_NONE      = 0xFFFFFFFFu,  //!< FrozenSlot::uKey of a section
+        SI_FROZEN_DIRECT    = 0x80000000u   //!< seed that holds the slot itself
+    };
+
+    /** Is the data frozen? */
+    bool m_bFrozen;
+
+    /** Frozen sections sorted by name. */
+    std::vector<FrozenSection> m_frozenSections;
+
+    /** Frozen values sorted by section and then by key. */
+    std::vector<FrozenKey> m_frozenKeys;
+
+    /** Frozen sections in load order, followed by the values of each section
+        in load order. The values of a section start at the number of
+        sections plus the index of its first value.
+     */
+    std::vector<unsigned> m_frozenOrder;
+
+    /** Seed of each bucket of the perfect hash, or SI_FROZEN_DIRECT plus
+        the slot for a bucket that holds a single name.
+     */
+    std::vector<unsigned> m_frozenSeeds;
+
+    /** Perfect hash table with one slot for each section and unique key. */
+    std::vector<FrozenSlot> m_frozenSlots;
+
+    /** Value that a handle refers to, see GetHandle(). The generation is
+        incremented each time the slot is released, so old handles to it
+        are no longer valid when it is reused.
+     */
+    struct HandleSlot {
+        typename TKeyVal::const_iterator iKey;
+        unsigned    uFrozen;        //!< index in m_frozenKeys when frozen
+        unsigned    uGeneration;
+        bool        bUsed;
+
+        HandleSlot() : uFrozen(0), uGeneration(1), bUsed(false) { }
+    };
+
+    /** Handle slots, referred to from the load order slot of their value
+        or from m_frozenHandles.
+     */
+    std::vector<HandleSlot> m_handles;
+
+    /** Released slots in m_handles. */
+    std::vector<unsigned> m_freeHandles;
+
+    /** Handle slot plus one of each frozen value, or 0. Empty until a
+        handle is resolved in the frozen data.
+     */
+    std::vector<unsigned> m_frozenHandles;
+
+    typedef std::basic_string<SI_CHAR> TString;
+
+    /** See Subscribe(). */
+    struct Subscription {
+        unsigned        uId;
+        TString         section;
+        TString         key;
+        bool            bAnySection;
+        bool            bAnyKey;
+        bool            bPrefix;
+        ChangeCallback  fnCallback;
+    };
+
+    /** Change waiting to be reported. */
+    struct Change {
+        TString         section;
+        TString         key;
+        bool            bKey;       //!< false for the section itself
+    };
+
+    /** Subscriptions in the order they were made. */
+    std::vector<Subscription> m_subscriptions;
+
+    /** Id of the last subscription. */
+    unsigned m_uLastSubscription;
+
+    /** Changes made by the current call that a subscription watches. */
+    std::vector<Change> m_changes;
+
+    /** Number of nested calls that make changes, see ChangeScope. */
+    int m_nChangeDepth;
+
+    /** Is a lazily loaded section being parsed, which is not a change? */
+    bool m_bParsingLazy;
+};
+
+// ---------------------------------------------------------------------------
+//                                  IMPLEMENTATION
+// ---------------------------------------------------------------------------
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CSimpleIniTempl(
+    bool                a_bIsUtf8,
+    bool                a_bAllowMultiKey,
+    bool                a_bAllowMultiLine,
+    SI_MemoryResource * a_pResource
+    )
+  : m_pData(0)
+  , m_uDataLen(0)
+  , m_pMapBase(NULL)
+  , m_uMapLen(0)
+  , m_pFileComment(NULL)
+  , m_cEmptyString(0)
+  , m_data(GetAllocator(a_pResource))
+  , m_bStoreIsUtf8(a_bIsUtf8)
+  , m_bAllowMultiKey(a_bAllowMultiKey)
+  , m_bAllowMultiLine(a_bAllowMultiLine)
+  , m_bSpaces(true)
+  , m_bParseQuotes(false)
+  , m_bAllowKeyOnly(false)
+  , m_bMemoryMap(false)
+#ifdef SI_NO_COMMENTS
+  , m_bStripComments(true)
+#else
+  , m_bStripComments(false)
+#endif
+  , m_uLoadThreads(1)
+  , m_bTypedCache(false)
+  , m_uIndexCount(0)
+  , m_bHashIndex(false)
+  , m_bInBatch(false)
+  , m_bLazyLoad(false)
+  , m_nOrder(0)
+  , m_uOrderUsed(0)
+  , m_bFrozen(false)
+  , m_uLastSubscription(0)
+  , m_nChangeDepth(0)
+  , m_bParsingLazy(false)
+{ }
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::~CSimpleIniTempl()
+{
+    Reset();
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Reset()
+{
+    // remove all data
+    FreeData(m_pData, m_pMapBase, m_uMapLen);
+    m_pData = NULL;
+    m_uDataLen = 0;
+    m_pMapBase = NULL;
+    m_uMapLen = 0;
+    m_pFileComment = NULL;
+    if (!m_data.empty()) {
+        m_data.erase(m_data.begin(), m_data.end());
+    }
+    RebuildIndex();
+    m_typedCache.clear();
+    m_lazy.clear();
+    FreeHandles();
+    m_order.clear();
+    m_uOrderUsed = 0;
+    m_nOrder = 0;
+    m_bFrozen = false;
+    std::vector<FrozenSection>().swap(m_frozenSections);
+    std::vector<FrozenKey>().swap(m_frozenKeys);
+    std::vector<unsigned>().swap(m_frozenOrder);
+    std::vector<unsigned>().swap(m_frozenSeeds);
+    std::vector<FrozenSlot>().swap(m_frozenSlots);
+
+    // remove all strings
+    FreeStrings();
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FreeStrings()
+{
+    for (size_t n = 0; n < m_strings.size(); ++n) {
+        FreeBlock(m_strings[n].pData, m_strings[n].uSize);
+    }
+    m_strings.clear();
+    for (int n = 0; n < SI_STRING_CLASSES; ++n) {
+        m_freeStrings[n].clear();
+    }
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CompactStrings()
+{
+    if (m_bFrozen) {
+        return SI_FAIL;
+    }
+
+    // the sections left by a lazy load are found by their old names
+    SI_Error rc = ParseLazySections();
+    if (rc < 0) {
+        return rc;
+    }
+
+    // move the existing strings aside, new copies are allocated from
+    // fresh blocks
+    std::vector<StringBlock> oldStrings;
+    oldStrings.swap(m_strings);
+    std::vector<SI_CHAR *> oldFree[SI_STRING_CLASSES];
+    for (int n = 0; n < SI_STRING_CLASSES; ++n) {
+        oldFree[n].swap(m_freeStrings[n]);
+    }
+
+    // rebuild the data table using the new copies, the entries are already
+    // sorted so they are appended in order
+    TSection data(m_data.get_allocator());
+    const SI_CHAR * pFileComment = m_pFileComment;
+    if (IsCopiedString(pFileComment)) {
+        rc = CopyString(pFileComment);
+    }
+    typename TSection::const_iterator iSection = m_data.begin();
+    for ( ; rc >= 0 && iSection != m_data.end(); ++iSection) {
+        Entry oSection(iSection->first);
+        if (IsCopiedString(oSection.pItem)) rc = CopyString(oSection.pItem);
+#ifndef SI_NO_COMMENTS
+        if (rc >= 0 && IsCopiedString(oSection.pComment)) rc = CopyString(oSection.pComment);
+#endif
+        if (rc < 0) break;
+
+        typename TSection::iterator iNewSection = data.insert(data.end(),
+            typename TSection::value_type(oSection, TKeyVal()));
+        typename TKeyVal::const_iterator iKeyVal = iSection->second.begin();
+        for ( ; rc >= 0 && iKeyVal != iSection->second.end(); ++iKeyVal) {
+            Entry oKey(iKeyVal->first);
+            const SI_CHAR * pValue = iKeyVal->second;
+            if (IsCopiedString(oKey.pItem)) rc = CopyString(oKey.pItem);
+#ifndef SI_NO_COMMENTS
+            if (rc >= 0 && IsCopiedString(oKey.pComment)) rc = CopyString(oKey.pComment);
+#endif
+            if (rc >= 0 && IsCopiedString(pValue)) rc = CopyString(pValue);
+            if (rc < 0) break;
+            iNewSection->second.insert(iNewSection->second.end(),
+                typename TKeyVal::value_type(oKey, pValue));
+        }
+    }
+
+    // on failure put everything back the way it was
+    if (rc < 0) {
+        FreeStrings();
+        m_strings.swap(oldStrings);
+        for (int n = 0; n < SI_STRING_CLASSES; ++n) {
+            m_freeStrings[n].swap(oldFree[n]);
+        }
+        return rc;
+    }
+
+    m_data.swap(data);
+    m_pFileComment = pFileComment;
+    RebuildIndex();
+    RebuildOrder();
+    m_typedCache.clear();
+    for (size_t n = 0; n < oldStrings.size(); ++n) {
+        FreeBlock(oldStrings[n].pData, oldStrings[n].uSize);
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
+    const char * a_pszFile
+    )
+{
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, a_pszFile, "rb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(a_pszFile, "rb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) {
+        return SI_FILE;
+    }
+    SI_Error rc = LoadFile(fp);
+    fclose(fp);
+    return rc;
+}
+
+#ifdef SI_HAS_WIDE_FILE
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
+    const SI_WCHAR_T * a_pwszFile
+    )
+{
+#ifdef _WIN32
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    _wfopen_s(&fp, a_pwszFile, L"rb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = _wfopen(a_pwszFile, L"rb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) return SI_FILE;
+    SI_Error rc = LoadFile(fp);
+    fclose(fp);
+    return rc;
+#else // !_WIN32 (therefore SI_CONVERT_ICU)
+    char szFile[256];
+    u_austrncpy(szFile, a_pwszFile, sizeof(szFile));
+    return LoadFile(szFile);
+#endif // _WIN32
+}
+#endif // SI_HAS_WIDE_FILE
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+template<class TTask>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadInParallel(
+    size_t      a_uCount,
+    unsigned    a_uThreads,
+    TTask       a_fnTask
+    )
+{
+#ifdef SI_HAS_THREADS
+    std::atomic<size_t> uNext(0);
+#else
+    size_t uNext = 0;
+#endif
+    auto worker = [&]() {
+        size_t n;
+        while ((n = uNext++) < a_uCount) {
+            a_fnTask(n);
+        }
+    };
+
+    // the calling thread works too, and does everything if no other threads
+    // could be started
+#ifdef SI_HAS_THREADS
+    if (a_uThreads == 0) {
+        a_uThreads = std::thread::hardware_concurrency();
+    }
+    std::vector<std::thread> threads;
+    for (size_t n = 1; n < a_uThreads && n < a_uCount; ++n) {
+        try {
+            threads.push_back(std::thread(worker));
+        }
+        catch (...) {
+            break;
+        }
+    }
+    worker();
+    for (size_t n = 0; n < threads.size(); ++n) {
+        threads[n].join();
+    }
+#else // !SI_HAS_THREADS
+    (void) a_uThreads;
+    worker();
+#endif // SI_HAS_THREADS
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFiles(
+    const char * const *    a_pszFiles,
+    size_t                  a_uCount,
+    CSimpleIniTempl *       a_pIni,
+    SI_Error *              a_pResults,
+    unsigned                a_uThreads
+    )
+{
+    std::vector<SI_Error> results;
+    if (!a_pResults) {
+        results.resize(a_uCount);
+        a_pResults = results.data();
+    }
+
+    LoadInParallel(a_uCount, a_uThreads, [&](size_t n) {
+        try {
+            a_pResults[n] = a_pIni[n].LoadFile(a_pszFiles[n]);
+        }
+        catch (...) {
+            a_pResults[n] = SI_NOMEM;
+        }
+    });
+
+    for (size_t n = 0; n < a_uCount; ++n) {
+        if (a_pResults[n] < 0) {
+            return a_pResults[n];
+        }
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFilesMerged(
+    const char * const *    a_pszFiles,
+    size_t                  a_uCount,
+    unsigned                a_uThreads
+    )
+{
+    // frozen data is read-only
+    if (m_bFrozen) {
+        return SI_FAIL;
+    }
+    if (a_uCount == 0) {
+        return SI_OK;
+    }
+
+    std::vector<SI_Error> results;
+    try {
+        results.resize(a_uCount);
+    }
+    catch (...) {
+        return SI_NOMEM;
+    }
+    CSimpleIniTempl * pFiles = new(std::nothrow) CSimpleIniTempl[a_uCount];
+    if (!pFiles) {
+        return SI_NOMEM;
+    }
+
+    // the files are parsed as this object would parse them, everything
+    // that only matters once they are added here is left off. Only the first
+    // file comment is kept, a later file's leading comment belongs to its
+    // first entry, and an empty file comment stops one being found.
+    for (size_t n = 0; n < a_uCount; ++n) {
+        CSimpleIniTempl & oFile = pFiles[n];
+        oFile.CopySettings(*this);
+        oFile.m_uLoadThreads = 1;
+        oFile.m_bTypedCache  = false;
+        oFile.m_bHashIndex   = false;
+        oFile.m_bLazyLoad    = false;
+        if (m_pFileComment) {
+            oFile.m_pFileComment = &oFile.m_cEmptyString;
+        }
+    }
+    (void) LoadFiles(a_pszFiles, a_uCount, pFiles, results.data(), a_uThreads);
+
+    // which file adds data first is only known now, a UTF-8 BOM changes the
+    // mode until then as it would for LoadFile()
+    bool bUtf8 = m_bStoreIsUtf8;
+    for (size_t n = 0; !m_pData && n < a_uCount && results[n] >= 0; ++n) {
+        bUtf8 = bUtf8 || pFiles[n].m_bStoreIsUtf8;
+        if (pFiles[n].m_pData) {
+            break;
+        }
+    }
+
+    // and so is which file has the first file comment. The files with data
+    // that were parsed in the other mode, and the ones after the first
+    // comment that found a file comment, are loaded again.
+    std::vector<size_t> reload;
+    size_t uFirst = a_uCount;
+    for (size_t n = 0; n < a_uCount && results[n] >= 0; ++n) {
+        const SI_CHAR * pComment = pFiles[n].m_pFileComment;
+        bool bComment = pComment && pComment != &pFiles[n].m_cEmptyString;
+        if (bComment && uFirst == a_uCount) {
+            uFirst = n;
+        }
+        if ((bComment && uFirst < n)
+            || (pFiles[n].m_pData && bUtf8 && !pFiles[n].m_bStoreIsUtf8))
+        {
+            reload.push_back(n);
+        }
+    }
+    LoadInParallel(reload.size(), a_uThreads, [&](size_t n) {
+        CSimpleIniTempl & oFile = pFiles[reload[n]];
+        oFile.Reset();
+        oFile.SetUnicode(bUtf8);
+        if (m_pFileComment || uFirst < reload[n]) {
+            oFile.m_pFileComment = &oFile.m_cEmptyString;
+        }
+        try {
+            results[reload[n]] = oFile.LoadFile(a_pszFiles[reload[n]]);
+        }
+        catch (...) {
+            results[reload[n]] = SI_NOMEM;
+        }
+    });
+
+    // data added to a lazy load must follow all of its entries, and changes
+    // are reported once everything has been added
+    ChangeScope oScope(*this);
+    SetUnicode(bUtf8);
+    SI_Error rc = ParseLazySections();
+    for (size_t n = 0; rc >= 0 && n < a_uCount; ++n) {
+        rc = results[n];
+        if (rc < 0) {
+            break;
+        }
+
+        // only the first file comment is kept
+        const CSimpleIniTempl & oFile = pFiles[n];
+        if (!m_pFileComment && oFile.m_pFileComment
+            && oFile.m_pFileComment != &oFile.m_cEmptyString)
+        {
+            m_pFileComment = oFile.m_pFileComment;
+            rc = CopyString(m_pFileComment);
+            if (rc < 0) {
+                m_pFileComment = NULL;
+                break;
+            }
+        }
+        rc = AddEntries(oFile);
+    }
+    delete[] pFiles;
+    return rc < 0 ? rc : SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
+    FILE * a_fpFile
+    )
+{
+    // load the raw file data
+    int retval = fseek(a_fpFile, 0, SEEK_END);
+    if (retval != 0) {
+        return SI_FILE;
+    }
+    long lSize = ftell(a_fpFile);
+    if (lSize < 0) {
+        return SI_FILE;
+    }
+    if (lSize == 0) {
+        return SI_OK;
+    }
+
+    // check file size is within supported limits (SI_MAX_FILE_SIZE)
+    if (static_cast<size_t>(lSize) > SI_MAX_FILE_SIZE) {
+        return SI_FILE;
+    }
+
+    // parse the file in place if we can map it
+    if (m_bMemoryMap) {
+        SI_Error rc;
+        if (LoadFileMapped(a_fpFile, static_cast<size_t>(lSize), rc)) {
+            return rc;
+        }
+    }
+
+    // allocate and ensure NULL terminated
+    char * pData = new(std::nothrow) char[static_cast<size_t>(lSize) + 1];
+    if (!pData) {
+        return SI_NOMEM;
+    }
+    pData[lSize] = 0;
+    
+    // load data into buffer
+    fseek(a_fpFile, 0, SEEK_SET);
+    size_t uRead = fread(pData, sizeof(char), lSize, a_fpFile);
+    if (uRead != (size_t) lSize) {
+        delete[] pData;
+        return SI_FILE;
+    }
+
+    // data that needs no conversion is parsed in the buffer it was read
+    // into, saving a copy of the whole file
+    if (SI_IsPassThrough<SI_CONVERTER>::value) {
+        if (uRead >= 3 && memcmp(pData, SI_UTF8_SIGNATURE, 3) == 0) {
+            uRead -= 3;
+            memmove(pData, pData + 3, uRead + 1);
+            SI_ASSERT(m_bStoreIsUtf8 || !m_pData); // we don't expect mixed mode data
+            SetUnicode();
+        }
+        return ParseData(reinterpret_cast<SI_CHAR *>(pData), uRead, NULL, 0);
+    }
+
+    // convert the raw data to unicode
+    SI_Error rc = LoadData(pData, uRead);
+    delete[] pData;
+    return rc;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadData(
+    const char *    a_pData,
+    size_t          a_uDataLen
+    )
+{
+    if (!a_pData) {
+        return SI_OK;
+    }
+    
+    // if the UTF-8 BOM exists, consume it and set mode to unicode, if we have
+    // already loaded data and try to change mode half-way through then this will
+    // be ignored and we will assert in debug versions
+    if (a_uDataLen >= 3 && memcmp(a_pData, SI_UTF8_SIGNATURE, 3) == 0) {
+        a_pData    += 3;
+        a_uDataLen -= 3;
+        SI_ASSERT(m_bStoreIsUtf8 || !m_pData); // we don't expect mixed mode data
+        SetUnicode();
+    }
+
+    if (a_uDataLen == 0) {
+        return SI_OK;
+    }
+
+    // determine the length of the converted data
+    SI_CONVERTER converter(m_bStoreIsUtf8);
+    size_t uLen = converter.SizeFromStore(a_pData, a_uDataLen);
+    if (uLen == (size_t)(-1)) {
+        return SI_FAIL;
+    }
+
+    // check converted data size is within supported limits (SI_MAX_FILE_SIZE)
+    if (uLen >= (SI_MAX_FILE_SIZE / sizeof(SI_CHAR))) {
+        return SI_FILE;
+    }
+
+    // allocate memory for the data, ensure that there is a NULL
+    // terminator wherever the converted data ends
+    SI_CHAR * pData = new(std::nothrow) SI_CHAR[uLen + 1];
+    if (!pData) {
+        return SI_NOMEM;
+    }
+    memset(pData, 0, sizeof(SI_CHAR) * (uLen + 1));
+
+    // convert the data
+    if (!converter.ConvertFromStore(a_pData, a_uDataLen, pData, uLen)) {
+        delete[] pData;
+        return SI_FAIL;
+    }
+
+    return ParseData(pData, uLen, NULL, 0);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFileMapped(
+    FILE *          a_fpFile,
+    size_t          a_uFileSize,
+    SI_Error &      a_rc
+    )
+{
+#ifdef SI_HAS_MMAP
+    // the mapping is parsed as SI_CHAR data directly
+    if (!SI_IsPassThrough<SI_CONVERTER>::value) {
+        return false;
+    }
+
+    // we rely on the zero filled tail of the last page to NULL terminate
+    // the data, which doesn't exist if the file fills the last page
+    long nPageSize = sysconf(_SC_PAGESIZE);
+    if (nPageSize <= 0 || a_uFileSize % static_cast<size_t>(nPageSize) == 0) {
+        return false;
+    }
+
+    // private mapping so that the parser can modify the data in place
+    // without affecting the file
+    void * pMap = mmap(NULL, a_uFileSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fileno(a_fpFile), 0);
+    if (pMap == MAP_FAILED) {
+        return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(pMap, a_uFileSize, MADV_SEQUENTIAL);
+#endif
+
+    // consume the UTF-8 BOM the same way as LoadData does
+    SI_CHAR * pData = static_cast<SI_CHAR *>(pMap);
+    size_t uLen = a_uFileSize;
+    if (uLen >= 3 && memcmp(pData, SI_UTF8_SIGNATURE, 3) == 0) {
+        pData += 3;
+        uLen  -= 3;
+        SI_ASSERT(m_bStoreIsUtf8 || !m_pData); // we don't expect mixed mode data
+        SetUnicode();
+    }
+
+    a_rc = ParseData(pData, uLen, pMap, a_uFileSize);
+    return true;
+#else // !SI_HAS_MMAP
+    (void)a_fpFile;
+    (void)a_uFileSize;
+    (void)a_rc;
+    return false;
+#endif // SI_HAS_MMAP
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetSnapshotSource(
+    const char *            a_pszFile,
+    unsigned long long &    a_uSize,
+    long long &             a_nTime,
+    unsigned long long &    a_uHash
+    )
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(a_pszFile, &st) != 0) {
+        return false;
+    }
+#else // !_WIN32
+    struct stat st;
+    if (stat(a_pszFile, &st) != 0) {
+        return false;
+    }
+#endif // _WIN32
+    a_uSize = (unsigned long long) st.st_size;
+    a_nTime = (long long) st.st_mtime;
+
+    // the modification time may be too coarse to see every change, so the
+    // contents are hashed as well (FNV-1a)
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, a_pszFile, "rb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(a_pszFile, "rb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) {
+        return false;
+    }
+    a_uHash = 14695981039346656037ULL;
+    unsigned char szBuf[4096];
+    size_t uRead;
+    while ((uRead = fread(szBuf, 1, sizeof(szBuf), fp)) > 0) {
+        for (size_t n = 0; n < uRead; ++n) {
+            a_uHash = (a_uHash ^ szBuf[n]) * 1099511628211ULL;
+        }
+    }
+    bool bOk = !ferror(fp);
+    fclose(fp);
+    return bOk;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadSnapshot(
+    const char *    a_pszFile,
+    const char *    a_pszSource
+    )
+{
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, a_pszFile, "rb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(a_pszFile, "rb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) {
+        return SI_FILE;
+    }
+
+    // check the trailer before reading anything else
+    SnapshotTrailer oTrailer;
+    long lSize = -1;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        lSize = ftell(fp);
+    }
+    if (lSize < (long) sizeof(oTrailer) || (size_t) lSize > SI_MAX_FILE_SIZE
+        || fseek(fp, lSize - (long) sizeof(oTrailer), SEEK_SET) != 0
+        || fread(&oTrailer, sizeof(oTrailer), 1, fp) != 1)
+    {
+        fclose(fp);
+        return SI_FILE;
+    }
+    size_t uSize = (size_t) lSize;
+    size_t uStringBytes = (size_t) oTrailer.uStrings * sizeof(SI_CHAR);
+    size_t uPadded = (uStringBytes + 7) & ~(size_t) 7;
+    if (memcmp(oTrailer.szMagic, SI_SNAPSHOT_MAGIC, sizeof(oTrailer.szMagic)) != 0
+        || oTrailer.uByteOrder != 0x01020304
+        || oTrailer.uVersion != SI_SNAPSHOT_VERSION
+        || (oTrailer.uFlags & ~(unsigned int) SI_SNAP_UTF8) != GetSnapshotFlags()
+        || oTrailer.uStrings >= SI_SNAPSHOT_NONE
+        || oTrailer.uRecords > uSize / sizeof(SnapshotRecord)
+        || uPadded + oTrailer.uRecords * sizeof(SnapshotRecord)
+            + sizeof(oTrailer) != uSize)
+    {
+        fclose(fp);
+        return SI_FAIL;
+    }
+
+    // the source must be unchanged since the snapshot was made
+    if (a_pszSource) {
+        unsigned long long uSourceSize = 0, uSourceHash = 0;
+        long long nSourceTime = 0;
+        if (!GetSnapshotSource(a_pszSource, uSourceSize, nSourceTime, uSourceHash)
+            || uSourceSize != oTrailer.uSourceSize
+            || nSourceTime != oTrailer.nSourceTime
+            || uSourceHash != oTrailer.uSourceHash)
+        {
+            fclose(fp);
+            return SI_FAIL;
+        }
+    }
+
+    // the string table must start the data so that it can become m_pData
+    void * pMap = NULL;
+    SI_CHAR * pData = NULL;
+#ifdef SI_HAS_MMAP
+    if (m_bMemoryMap) {
+        pMap = mmap(NULL, uSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+        if (pMap == MAP_FAILED) {
+            pMap = NULL;
+        }
+        else {
+            pData = static_cast<SI_CHAR *>(pMap);
+        }
+    }
+#endif // SI_HAS_MMAP
+    if (!pData) {
+        pData = new(std::nothrow) SI_CHAR[uSize / sizeof(SI_CHAR)];
+        if (!pData) {
+            fclose(fp);
+            return SI_NOMEM;
+        }
+        if (fseek(fp, 0, SEEK_SET) != 0 || fread(pData, 1, uSize, fp) != uSize) {
+            delete[] pData;
+            fclose(fp);
+            return SI_FILE;
+        }
+    }
+    fclose(fp);
+
+    // every offset is checked, and the table must end with a NULL so that
+    // all strings are terminated
+    size_t uStrings = (size_t) oTrailer.uStrings;
+    if (uStrings == 0 || pData[uStrings - 1] != 0) {
+        FreeData(pData, pMap, uSize);
+        return SI_FAIL;
+    }
+    bool bValid = true;
+    auto getString = [&](unsigned int a_uOffset) -> const SI_CHAR * {
+        if (a_uOffset == SI_SNAPSHOT_NONE) return NULL;
+        if (a_uOffset >= uStrings) { bValid = false; return NULL; }
+        return pData + a_uOffset;
+    };
+
+    // the records are already sorted, so each insert is at the end
+    Reset();
+    m_bStoreIsUtf8 = (oTrailer.uFlags & SI_SNAP_UTF8) != 0;
+    const unsigned char * pRecords =
+        reinterpret_cast<const unsigned char *>(pData) + uPadded;
+    size_t uRecords = (size_t) oTrailer.uRecords;
+    for (size_t n = 0; bValid && n < uRecords; ) {
+        SnapshotRecord oRecord;
+        memcpy(&oRecord, pRecords + n++ * sizeof(oRecord), sizeof(oRecord));
+        const SI_CHAR * pComment = getString(oRecord.uComment);
+        Entry oSection(getString(oRecord.uName), IsStripComments() ? NULL : pComment, oRecord.nOrder);
+        if (!oSection.pItem || oRecord.uValue > uRecords - n) {
+            bValid = false;
+            break;
+        }
+        if (m_nOrder < oRecord.nOrder) m_nOrder = oRecord.nOrder;
+        typename TSection::iterator iSection = m_data.insert(m_data.end(),
+            typename TSection::value_type(oSection, TKeyVal()));
+
+        TKeyVal & keyval = iSection->second;
+        for (size_t nKeys = oRecord.uValue; nKeys > 0; --nKeys) {
+            memcpy(&oRecord, pRecords + n++ * sizeof(oRecord), sizeof(oRecord));
+            pComment = getString(oRecord.uComment);
+            Entry oKey(getString(oRecord.uName), IsStripComments() ? NULL : pComment, oRecord.nOrder);
+            const SI_CHAR * pValue = getString(oRecord.uValue);
+            if (!oKey.pItem) {
+                bValid = false;
+                break;
+            }
+            if (m_nOrder < oRecord.nOrder) m_nOrder = oRecord.nOrder;
+            keyval.insert(keyval.end(), typename TKeyVal::value_type(oKey,
+                pValue ? pValue : &m_cEmptyString));
+        }
+    }
+    const SI_CHAR * pFileComment = getString(oTrailer.uFileComment);
+    m_pFileComment = IsStripComments() ? NULL : pFileComment;
+
+    // take ownership of the data, Reset() releases it again if the
+    // snapshot turned out to be invalid
+    m_pData = pData;
+    m_uDataLen = uStrings;
+    m_pMapBase = pMap;
+    m_uMapLen = pMap ? uSize : 0;
+    if (!bValid) {
+        Reset();
+        return SI_FAIL;
+    }
+    RebuildIndex();
+    RebuildOrder();
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveSnapshot(
+    const char *    a_pszFile,
+    const char *    a_pszSource
+    ) const
+{
+    SnapshotTrailer oTrailer;
+    memset(&oTrailer, 0, sizeof(oTrailer));
+    memcpy(oTrailer.szMagic, SI_SNAPSHOT_MAGIC, sizeof(oTrailer.szMagic));
+    oTrailer.uByteOrder = 0x01020304;
+    oTrailer.uVersion = SI_SNAPSHOT_VERSION;
+    oTrailer.uFlags = GetSnapshotFlags()
+        | (m_bStoreIsUtf8 ? (unsigned int) SI_SNAP_UTF8 : 0u);
+    if (a_pszSource && !GetSnapshotSource(a_pszSource,
+        oTrailer.uSourceSize, oTrailer.nSourceTime, oTrailer.uSourceHash))
+    {
+        return SI_FILE;
+    }
+
+    SI_Error rc = ParseLazySections();
+    if (rc < 0) {
+        return rc;
+    }
+
+    // build the string table and the records in sorted order
+    std::vector<SI_CHAR> strings;
+    std::vector<SnapshotRecord> records;
+    auto addString = [&strings](const SI_CHAR * a_pString) -> unsigned int {
+        if (!a_pString) return SI_SNAPSHOT_NONE;
+        unsigned int uOffset = (unsigned int) strings.size();
+        do {
+            strings.push_back(*a_pString);
+        } while (*a_pString++);
+        return uOffset;
+    };
+    oTrailer.uFileComment = addString(m_pFileComment);
+    for (size_t n = 0; n < m_frozenSections.size(); ++n) {
+        const FrozenSection & section = m_frozenSections[n];
+        SnapshotRecord oRecord;
+        oRecord.uName = addString(section.section.pItem);
+        oRecord.uComment = addString(section.section.pComment);
+        oRecord.uValue = section.uEndKey - section.uFirstKey;
+        oRecord.nOrder = section.section.nOrder;
+        records.push_back(oRecord);
+
+        for (size_t uKey = section.uFirstKey; uKey < section.uEndKey; ++uKey) {
+            const FrozenKey & key = m_frozenKeys[uKey];
+            oRecord.uName = addString(key.key.pItem);
+            oRecord.uComment = addString(key.key.pComment);
+            oRecord.uValue = addString(key.pValue);
+            oRecord.nOrder = key.key.nOrder;
+            records.push_back(oRecord);
+        }
+    }
+    typename TSection::const_iterator iSection = m_data.begin();
+    for ( ; iSection != m_data.end(); ++iSection) {
+        SnapshotRecord oRecord;
+        oRecord.uName = addString(iSection->first.pItem);
+        oRecord.uComment = addString(iSection->first.pComment);
+        oRecord.uValue = (unsigned int) iSection->second.size();
+        oRecord.nOrder = iSection->first.nOrder;
+        records.push_back(oRecord);
+
+        typename TKeyVal::const_iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            oRecord.uName = addString(iKeyVal->first.pItem);
+            oRecord.uComment = addString(iKeyVal->first.pComment);
+            oRecord.uValue = addString(iKeyVal->second);
+            oRecord.nOrder = iKeyVal->first.nOrder;
+            records.push_back(oRecord);
+        }
+    }
+    strings.push_back(0);
+    if (strings.size() >= SI_SNAPSHOT_NONE) {
+        return SI_FAIL;
+    }
+    oTrailer.uStrings = strings.size();
+    oTrailer.uRecords = records.size();
+
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, a_pszFile, "wb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(a_pszFile, "wb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) {
+        return SI_FILE;
+    }
+
+    // the trailer is written last so an incomplete file is never accepted
+    static const char szPadding[8] = { 0 };
+    size_t uStringBytes = strings.size() * sizeof(SI_CHAR);
+    bool bOk = fwrite(&strings[0], 1, uStringBytes, fp) == uStringBytes
+        && fwrite(szPadding, 1, (8 - uStringBytes % 8) % 8, fp) == (8 - uStringBytes % 8) % 8
+        && (records.empty() || fwrite(&records[0], sizeof(SnapshotRecord), records.size(), fp) == records.size())
+        && fwrite(&oTrailer, sizeof(oTrailer), 1, fp) == 1;
+    if (fclose(fp) != 0) {
+        bOk = false;
+    }
+    return bOk ? SI_OK : SI_FILE;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AllocBlock(
+    size_t a_uSize
+    )
+{
+#ifdef SI_HAS_PMR
+    try {
+        return static_cast<SI_CHAR *>(GetMemoryResource()->allocate(
+            a_uSize * sizeof(SI_CHAR), alignof(std::max_align_t)));
+    }
+    catch (...) {
+        return NULL;
+    }
+#else
+    return new(std::nothrow) SI_CHAR[a_uSize];
+#endif
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FreeBlock(
+    SI_CHAR *   a_pBlock,
+    size_t      a_uSize
+    )
+{
+#ifdef SI_HAS_PMR
+    GetMemoryResource()->deallocate(a_pBlock, a_uSize * sizeof(SI_CHAR),
+        alignof(std::max_align_t));
+#else
+    (void) a_uSize;
+    delete[] a_pBlock;
+#endif
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FreeData(
+    SI_CHAR *       a_pData,
+    void *          a_pMapBase,
+    size_t          a_uMapLen
+    )
+{
+#ifdef SI_HAS_MMAP
+    if (a_pMapBase) {
+        munmap(a_pMapBase, a_uMapLen);
+        return;
+    }
+#else // !SI_HAS_MMAP
+    (void)a_pMapBase;
+    (void)a_uMapLen;
+#endif // SI_HAS_MMAP
+    delete[] a_pData;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseData(
+    SI_CHAR *       a_pData,
+    size_t          a_uDataLen,
+    void *          a_pMapBase,
+    size_t          a_uMapLen
+    )
+{
+    SI_CHAR * pData = a_pData;
+
+    // frozen data is read-only
+    if (m_bFrozen) {
+        FreeData(pData, a_pMapBase, a_uMapLen);
+        return SI_FAIL;
+    }
+    ChangeScope oScope(*this);
+
+    // parse it
+    SI_CHAR * pWork = pData;
+    const SI_CHAR * pSection = &m_cEmptyString;
+    const SI_CHAR * pItem = NULL;
+    const SI_CHAR * pVal = NULL;
+    const SI_CHAR * pComment = NULL;
+
+    // We copy the strings if we are loading data into this class when we
+    // already have stored some.
+    bool bCopyStrings = (m_pData != NULL);
+
+    // data merged into a lazy load must follow all of its entries
+    SI_Error rc = ParseLazySections();
+
+    // find a file comment if it exists, this is a comment that starts at the
+    // beginning of the file and continues until the first blank line.
+    if (rc >= 0) {
+        rc = FindFileComment(pWork, bCopyStrings);
+    }
+
+    // large files may be indexed to be parsed on demand, or split and
+    // parsed by several threads
+    if (rc >= 0 && m_bLazyLoad && m_subscriptions.empty() && !bCopyStrings && !m_bAllowMultiLine) {
+        rc = ParseLazy(pWork, a_uDataLen - (size_t) (pWork - pData));
+    }
+    else if (rc >= 0 && m_uLoadThreads > 1 && !bCopyStrings && !m_bAllowMultiLine) {
+        // the chunks are merged without AddEntry(), everything is new
+        SI_CHAR * pStart = pWork;
+        rc = ParseParallel(pWork, a_uDataLen - (size_t) (pWork - pData));
+        for (typename TSection::const_iterator iSection = m_data.begin();
+            pWork != pStart && !m_subscriptions.empty() && iSection != m_data.end(); ++iSection)
+        {
+            RecordChange(iSection->first.pItem, NULL);
+            typename TKeyVal::const_iterator iKeyVal = iSection->second.begin();
+            for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+                RecordChange(iSection->first.pItem, iKeyVal->first.pItem);
+            }
+        }
+    }
+
+    // add every (remaining) entry in the file to the data table
+    while (rc >= 0 && FindEntry(pWork, pSection, pItem, pVal, pComment)) {
+        rc = AddEntry(pSection, pItem, pVal, pComment, false, bCopyStrings);
+    }
+
+    // store these strings if we didn't copy them, entries added before any
+    // failure still point into the data so it is kept in that case too
+    if (bCopyStrings) {
+        FreeData(pData, a_pMapBase, a_uMapLen);
+    }
+    else {
+        m_pData = pData;
+        m_uDataLen = a_uDataLen+1;
+        m_pMapBase = a_pMapBase;
+        m_uMapLen = a_uMapLen;
+    }
+
+    return rc < 0 ? rc : SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseLazy(
+    SI_CHAR *&      a_pData,
+    size_t          a_uDataLen
+    )
+{
+    if (!*a_pData) {
+        return SI_OK;
+    }
+
+    // split the data at every section header
+    std::vector<SI_CHAR *> chunks(1, a_pData);
+    for (SI_CHAR * pSplit = a_pData; (pSplit = FindSectionStart(pSplit + 1, pSplit)) != NULL; ) {
+        chunks.push_back(pSplit);
+    }
+    if (chunks.size() < 2) {
+        return SI_OK;
+    }
+    for (size_t n = 1; n < chunks.size(); ++n) {
+        // the previous chunk ends at the newline before the header
+        chunks[n][-1] = 0;
+    }
+
+    // the data before the first split may hold keys without a section, so
+    // it is parsed now
+    SI_Error rc = SI_OK;
+    const SI_CHAR * pSection = &m_cEmptyString;
+    const SI_CHAR * pItem = NULL;
+    const SI_CHAR * pVal = NULL;
+    const SI_CHAR * pComment = NULL;
+    SI_CHAR * pData = chunks[0];
+    while (rc >= 0 && FindEntry(pData, pSection, pItem, pVal, pComment)) {
+        rc = AddEntry(pSection, pItem, pVal, pComment, false, false);
+    }
+
+    for (size_t n = 1; rc >= 0 && n < chunks.size(); ++n) {
+        // every other chunk starts with a section header and its comment
+        pData = chunks[n];
+        if (!FindEntry(pData, pSection, pItem, pVal, pComment)) {
+            continue;
+        }
+
+        // a '[' that doesn't start a valid header changes the section of
+        // the lines after it, so that chunk is parsed now
+        bool bLazy = !pItem;
+        for (SI_CHAR * p = pData; bLazy && *p; p = SI_ScanLine(p, (SI_CHAR) 0, (SI_CHAR) 0)) {
+            while (IsSpace(*p)) {
+                ++p;
+            }
+            bLazy = *p != '[';
+        }
+        if (!bLazy) {
+            do {
+                rc = AddEntry(pSection, pItem, pVal, pComment, false, false);
+            }
+            while (rc >= 0 && FindEntry(pData, pSection, pItem, pVal, pComment));
+            continue;
+        }
+
+        // a repeated header leaves the section unchanged
+        typename TSection::iterator iSection = FindSection(pSection);
+        if (iSection == m_data.end()) {
+            rc = AddEntry(pSection, NULL, NULL, pComment, false, false);
+            iSection = FindSection(pSection);
+        }
+        if (rc >= 0 && *pData) {
+            m_lazy[iSection->first.pItem].push_back(pData);
+        }
+    }
+
+    // the data has been modified so it can't be parsed again after a failure
+    a_pData += a_uDataLen;
+    return rc;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseLazySection(
+    const SI_CHAR * a_pSection
+    ) const
+{
+    if (m_lazy.empty() || !a_pSection) {
+        return SI_OK;
+    }
+    typename TSection::const_iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        return SI_OK;
+    }
+    CSimpleIniTempl * pThis = const_cast<CSimpleIniTempl *>(this);
+    typename TLazySections::iterator iLazy = pThis->m_lazy.find(iSection->first.pItem);
+    if (iLazy == pThis->m_lazy.end()) {
+        return SI_OK;
+    }
+
+    // taken out first so that adding the entries doesn't come back here
+    std::vector<SI_CHAR *> chunks;
+    chunks.swap(iLazy->second);
+    pThis->m_lazy.erase(iLazy);
+
+    // the entries were loaded earlier, they are not changes
+    const SI_CHAR * pSection = iSection->first.pItem;
+    const SI_CHAR * pItem = NULL;
+    const SI_CHAR * pVal = NULL;
+    const SI_CHAR * pComment = NULL;
+    bool bParsingLazy = m_bParsingLazy;
+    pThis->m_bParsingLazy = true;
+    SI_Error rc = SI_OK;
+    for (size_t n = 0; rc >= 0 && n < chunks.size(); ++n) {
+        SI_CHAR * pData = chunks[n];
+        while (rc >= 0 && FindEntry(pData, pSection, pItem, pVal, pComment)) {
+            rc = pThis->AddEntry(pSection, pItem, pVal, pComment, false, false);
+        }
+    }
+    pThis->m_bParsingLazy = bParsingLazy;
+    return rc;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseLazySections() const
+{
+    while (!m_lazy.empty()) {
+        const SI_CHAR * pSection = m_lazy.begin()->first;
+        SI_Error rc = ParseLazySection(pSection);
+        if (rc < 0) return rc;
+        const_cast<CSimpleIniTempl *>(this)->m_lazy.erase(pSection);
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseParallel(
+    SI_CHAR *&      a_pData,
+    size_t          a_uDataLen
+    )
+{
+#ifdef SI_HAS_THREADS
+    size_t uChunks = (size_t) m_uLoadThreads * 4;
+    if (uChunks > a_uDataLen / SI_PARALLEL_CHUNK_SIZE) {
+        uChunks = a_uDataLen / SI_PARALLEL_CHUNK_SIZE;
+    }
+    if (uChunks < 2 || a_uDataLen + uChunks > (size_t) (INT_MAX - m_nOrder)) {
+        return SI_OK;
+    }
+
+    // the chunks allocate from the heap, on other threads, and their
+    // sections are moved into our table
+#ifdef SI_HAS_PMR
+    if (!GetMemoryResource()->is_equal(*std::pmr::new_delete_resource())) {
+        return SI_OK;
+    }
+#endif
+
+    // split the data at the section headers nearest to equal sized chunks
+    std::vector<SI_CHAR *> chunks(1, a_pData);
+    for (size_t n = 1; n < uChunks; ++n) {
+        SI_CHAR * pSplit = a_pData + a_uDataLen / uChunks * n;
+        if (pSplit <= chunks.back()) {
+            continue;
+        }
+        pSplit = FindSectionStart(pSplit, chunks.back());
+        if (!pSplit) {
+            break;
+        }
+        chunks.push_back(pSplit);
+    }
+    uChunks = chunks.size();
+    if (uChunks < 2) {
+        return SI_OK;
+    }
+
+    CSimpleIniTempl * pChunks = new(std::nothrow) CSimpleIniTempl[uChunks];
+    if (!pChunks) {
+        return SI_OK;
+    }
+
+    // each chunk numbers its entries from 1, they are renumbered as they
+    // are merged
+    for (size_t n = 0; n < uChunks; ++n) {
+        CSimpleIniTempl & oChunk = pChunks[n];
+        oChunk.m_bStoreIsUtf8   = m_bStoreIsUtf8;
+        oChunk.m_bAllowMultiKey = m_bAllowMultiKey;
+        oChunk.m_bParseQuotes   = m_bParseQuotes;
+        oChunk.m_bAllowKeyOnly  = m_bAllowKeyOnly;
+        oChunk.m_bStripComments = m_bStripComments;
+        if (n > 0) {
+            // the previous chunk ends at the newline before the header
+            chunks[n][-1] = 0;
+        }
+    }
+
+    std::atomic<size_t> uNext(0);
+    std::atomic<int> nError(SI_OK);
+    const SI_CHAR * pEmpty = &m_cEmptyString;
+    auto worker = [&]() {
+        size_t n;
+        while (nError.load() >= 0 && (n = uNext++) < uChunks) {
+            SI_Error rc;
+            try {
+                rc = pChunks[n].ParseChunk(chunks[n], pEmpty);
+            }
+            catch (...) {
+                rc = SI_NOMEM;
+            }
+            if (rc < 0) {
+                nError = rc;
+            }
+        }
+    };
+
+    // the calling thread parses too, and does all of the work if no other
+    // threads could be started
+    std::vector<std::thread> threads;
+    for (size_t n = 1; n < m_uLoadThreads && n < uChunks; ++n) {
+        try {
+            threads.push_back(std::thread(worker));
+        }
+        catch (...) {
+            break;
+        }
+    }
+    worker();
+    for (size_t n = 0; n < threads.size(); ++n) {
+        threads[n].join();
+    }
+
+    // merge in file order, the hash index is rebuilt once at the end
+    SI_Error rc = nError.load();
+    bool bHashIndex = m_bHashIndex;
+    m_bHashIndex = false;
+    for (size_t n = 0; rc >= 0 && n < uChunks; ++n) {
+        rc = MergeChunk(pChunks[n]);
+    }
+    m_bHashIndex = bHashIndex;
+    RebuildIndex();
+    delete[] pChunks;
+
+    // the data has been modified so it can't be parsed again after a failure
+    a_pData += a_uDataLen;
+    return rc;
+#else // !SI_HAS_THREADS
+    (void)a_pData;
+    (void)a_uDataLen;
+    return SI_OK;
+#endif // SI_HAS_THREADS
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindSectionStart(
+    SI_CHAR *       a_pData,
+    const SI_CHAR * a_pMin
+    ) const
+{
+    // move to the start of the next line
+    while (*a_pData && !IsNewLineChar(a_pData[-1])) {
+        ++a_pData;
+    }
+
+    while (*a_pData) {
+        // find the end of this line and the start of the next
+        SI_CHAR * pLine = a_pData;
+        SI_CHAR * pEnd = SI_ScanLine(pLine, (SI_CHAR) 0, (SI_CHAR) 0);
+        a_pData = pEnd;
+        while (*a_pData && IsNewLineChar(*a_pData)) {
+            ++a_pData;
+        }
+
+        // only a valid section header, as recognised by FindEntry
+        SI_CHAR * p = pLine;
+        while (p < pEnd && IsSpace(*p)) {
+            ++p;
+        }
+        if (*p != '[' || *SI_ScanLine(p, (SI_CHAR) ']', (SI_CHAR) ']') != ']') {
+            continue;
+        }
+
+        // FindEntry keeps a comment over blank and invalid lines until the
+        // next entry, so go back to the line after the last entry
+        SI_CHAR * pStart = pLine;
+        int nKind = 0;
+        while (pStart > a_pMin) {
+            SI_CHAR * pPrev = PrevLine(pStart, a_pMin);
+            nKind = GetLineKind(pPrev, pStart);
+            if (nKind != 0) {
+                break;
+            }
+            pStart = pPrev;
+        }
+        if (nKind <= 0 || pStart <= a_pMin) {
+            continue;
+        }
+
+        // FindEntry skips newlines after a '[' so an incomplete header
+        // before the entry may continue onto it, don't split there
+        SI_CHAR * pEntry = PrevLine(pStart, a_pMin);
+        while (pEntry > a_pMin) {
+            SI_CHAR * pPrev = PrevLine(pEntry, a_pMin);
+            p = pPrev;
+            while (p < pEntry && IsSpace(*p)) {
+                ++p;
+            }
+            if (p < pEntry) {
+                nKind = GetLineKind(pPrev, pEntry);
+                break;
+            }
+            pEntry = pPrev;
+        }
+        if (nKind < 0) {
+            continue;
+        }
+        return pStart;
+    }
+    return NULL;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::PrevLine(
+    SI_CHAR *       a_pLine,
+    const SI_CHAR * a_pMin
+    ) const
+{
+    SI_CHAR * pPrev = a_pLine - 1;
+    while (pPrev > a_pMin && !IsNewLineChar(pPrev[-1])) {
+        --pPrev;
+    }
+    return pPrev;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+int
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetLineKind(
+    SI_CHAR *       a_pLine,
+    const SI_CHAR * a_pEnd
+    ) const
+{
+    while (a_pLine < a_pEnd && IsSpace(*a_pLine)) {
+        ++a_pLine;
+    }
+    if (a_pLine == a_pEnd || IsComment(*a_pLine) || *a_pLine == '=') {
+        return 0;
+    }
+    if (*a_pLine == '[') {
+        return *SI_ScanLine(a_pLine, (SI_CHAR) ']', (SI_CHAR) ']') == ']' ? 1 : -1;
+    }
+    if (m_bAllowKeyOnly) {
+        return 1;
+    }
+    return *SI_ScanLine(a_pLine, (SI_CHAR) '=', (SI_CHAR) '=') == '=' ? 1 : 0;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseChunk(
+    SI_CHAR *       a_pData,
+    const SI_CHAR * a_pEmpty
+    )
+{
+    const SI_CHAR * pSection = a_pEmpty;
+    const SI_CHAR * pItem = NULL;
+    const SI_CHAR * pVal = NULL;
+    const SI_CHAR * pComment = NULL;
+    while (FindEntry(a_pData, pSection, pItem, pVal, pComment)) {
+        if (pItem && !pVal) {
+            pVal = a_pEmpty;
+        }
+        SI_Error rc = AddEntry(pSection, pItem, pVal, pComment, false, false);
+        if (rc < 0) return rc;
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::MergeChunk(
+    CSimpleIniTempl & a_oChunk
+    )
+{
+    const std::vector<OrderSlot> & order = a_oChunk.m_order;
+    int nSection = order.empty() ? 0 : order[0].nFirst;
+    while (nSection) {
+        typename TSection::iterator iChunkSection = order[nSection].iSection;
+        int nFirstKey = order[nSection].nFirst;
+        nSection = order[nSection].nNext;
+
+        // sections first seen in this chunk are moved over whole, with load
+        // orders that follow on from ours
+        if (m_data.find(iChunkSection->first) == m_data.end()) {
+            iChunkSection->first.nOrder = ++m_nOrder;
+            for (int nKey = nFirstKey; nKey; nKey = order[nKey].nNext) {
+                order[nKey].iKey->first.nOrder = ++m_nOrder;
+            }
+            typename TSection::iterator iSection =
+                m_data.insert(a_oChunk.m_data.extract(iChunkSection)).position;
+            OrderLink(iSection, typename TKeyVal::iterator(), false);
+            for (int nKey = nFirstKey; nKey; nKey = order[nKey].nNext) {
+                OrderLink(iSection, order[nKey].iKey, true);
+            }
+            continue;
+        }
+
+        // otherwise the keys are added in their load order, exactly as they
+        // would have been by a single threaded load
+        for (int nKey = nFirstKey; nKey; nKey = order[nKey].nNext) {
+            typename TKeyVal::iterator iKey = order[nKey].iKey;
+            SI_Error rc = AddEntry(iChunkSection->first.pItem, iKey->first.pItem,
+                iKey->second, iKey->first.pComment, false, false);
+            if (rc < 0) return rc;
+        }
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseStream(
+    FILE *          a_fpFile,
+    ParseHandler &  a_oHandler
+    ) const
+{
+    auto fnRead = [a_fpFile](char * a_pBuf, size_t a_uLen) -> size_t {
+        size_t uRead = fread(a_pBuf, sizeof(char), a_uLen, a_fpFile);
+        return (uRead == 0 && ferror(a_fpFile)) ? (size_t)(-1) : uRead;
+    };
+    return ParseStreamData(fnRead, a_oHandler);
+}
+
+#ifdef SI_SUPPORT_IOSTREAMS
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseStream(
+    std::istream &  a_istream,
+    ParseHandler &  a_oHandler
+    ) const
+{
+    auto fnRead = [&a_istream](char * a_pBuf, size_t a_uLen) -> size_t {
+        a_istream.read(a_pBuf, (std::streamsize) a_uLen);
+        size_t uRead = (size_t) a_istream.gcount();
+        return (uRead == 0 && a_istream.bad()) ? (size_t)(-1) : uRead;
+    };
+    return ParseStreamData(fnRead, a_oHandler);
+}
+#endif // SI_SUPPORT_IOSTREAMS
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+template<class SI_READ>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseStreamData(
+    SI_READ &       a_fnRead,
+    ParseHandler &  a_oHandler
+    ) const
+{
+    std::vector<char> raw;              // data read but not yet converted
+    std::vector<SI_CHAR> text(1, 0);    // converted but not yet parsed
+    std::basic_string<SI_CHAR> strSection; // outlives the text it came from
+    const SI_CHAR * pSection = strSection.c_str();
+    bool bStoreIsUtf8 = m_bStoreIsUtf8;
+    bool bSignature = true;
+    bool bFileComment = true;
+    bool bEnd = false;
+
+    while (!bEnd) {
+        size_t uRawLen = raw.size();
+        raw.resize(uRawLen + SI_STREAM_CHUNK_SIZE);
+        size_t uRead = a_fnRead(raw.data() + uRawLen, SI_STREAM_CHUNK_SIZE);
+        if (uRead == (size_t)(-1)) {
+            return SI_FILE;
+        }
+        raw.resize(uRawLen + uRead);
+        bEnd = (uRead == 0);
+
+        // the UTF-8 BOM selects unicode for this parse, as it would for a
+        // load, but the setting of this object isn't changed
+        if (bSignature) {
+            if (raw.size() < 3 && !bEnd) {
+                continue;
+            }
+            bSignature = false;
+            if (raw.size() >= 3 && memcmp(raw.data(), SI_UTF8_SIGNATURE, 3) == 0) {
+                raw.erase(raw.begin(), raw.begin() + 3);
+                bStoreIsUtf8 = true;
+            }
+        }
+
+        // only whole lines are converted so that no character is split, any
+        // earlier data still waiting has no newline in it
+        size_t uConvert = raw.size();
+        if (!bEnd) {
+            while (uConvert > uRawLen && raw[uConvert - 1] != '\n') {
+                --uConvert;
+            }
+            if (uConvert <= uRawLen) {
+                uConvert = 0;
+            }
+        }
+        if (uConvert > 0) {
+            SI_CONVERTER converter(bStoreIsUtf8);
+            size_t uLen = converter.SizeFromStore(raw.data(), uConvert);
+            if (uLen == (size_t)(-1)) {
+                return SI_FAIL;
+            }
+            size_t uTextLen = text.size() - 1;
+            text.resize(uTextLen + uLen + 1);
+            if (!converter.ConvertFromStore(raw.data(), uConvert,
+                text.data() + uTextLen, uLen))
+            {
+                return SI_FAIL;
+            }
+            text[uTextLen + uLen] = 0;
+            raw.erase(raw.begin(), raw.begin() + uConvert);
+        }
+
+        // parse everything up to the last entry that may still be changed by
+        // the data that follows it
+        size_t uTextLen = text.size() - 1;
+        size_t uSplit = bEnd ? uTextLen : FindStreamSplit(text.data(), uTextLen);
+        if (uSplit == 0) {
+            continue;
+        }
+        SI_CHAR cSplit = text[uSplit];
+        text[uSplit] = 0;
+
+        SI_CHAR * pWork = text.data();
+        const SI_CHAR * pItem = NULL;
+        const SI_CHAR * pVal = NULL;
+        const SI_CHAR * pComment = NULL;
+        if (bFileComment) {
+            bFileComment = false;
+            if (!IsStripComments() && LoadMultiLineText(pWork, pComment, NULL, false)
+                && !a_oHandler.OnFileComment(pComment))
+            {
+                return SI_OK;
+            }
+        }
+        while (FindEntry(pWork, pSection, pItem, pVal, pComment)) {
+            // FindEntry also moves the section on an invalid header, the
+            // keys that follow go into that section exactly as on a load
+            if (pSection != strSection.c_str()) {
+                strSection = pSection;
+                pSection = strSection.c_str();
+            }
+            if (!pItem) {
+                if (!a_oHandler.OnSection(pSection, pComment)) {
+                    return SI_OK;
+                }
+                continue;
+            }
+            if (!a_oHandler.OnKey(pSection, pItem,
+                pVal ? pVal : &m_cEmptyString, pComment))
+            {
+                return SI_OK;
+            }
+        }
+
+        text[uSplit] = cSplit;
+        text.erase(text.begin(), text.begin() + uSplit);
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+size_t
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindStreamSplit(
+    const SI_CHAR * a_pData,
+    size_t          a_uDataLen
+    ) const
+{
+    size_t uSplit = 0;      // start of the lines before the last entry
+    size_t uRun = 0;        // start of the lines since the last entry
+    std::basic_string<SI_CHAR> strTag, strLine;
+    bool bInValue = false;  // inside a multi-line value ending at strTag
+
+    size_t uLine = 0;
+    while (uLine < a_uDataLen) {
+        size_t uEnd = uLine;
+        while (uEnd < a_uDataLen && !IsNewLineChar(a_pData[uEnd])) {
+            ++uEnd;
+        }
+        size_t uNext = uEnd;
+        if (uNext < a_uDataLen && a_pData[uNext++] == '\r'
+            && uNext < a_uDataLen && a_pData[uNext] == '\n')
+        {
+            ++uNext;
+        }
+
+        // the end tag is matched as LoadMultiLineText does, trailing
+        // whitespace is ignored but not leading whitespace
+        if (bInValue) {
+            size_t uTrim = uEnd;
+            while (uTrim > uLine + 1 && IsSpace(a_pData[uTrim - 1])) {
+                --uTrim;
+            }
+            strLine.assign(a_pData + uLine, uTrim - uLine);
+            if (!IsLess(strLine.c_str(), strTag.c_str())
+                && !IsLess(strTag.c_str(), strLine.c_str()))
+            {
+                bInValue = false;
+                uRun = uNext;
+            }
+            uLine = uNext;
+            continue;
+        }
+
+        // blank, comment and invalid lines are skipped or kept as comments
+        // by FindEntry, an entry is anything else
+        size_t uStart = uLine;
+        while (uStart < uEnd && IsSpace(a_pData[uStart])) {
+            ++uStart;
+        }
+        bool bEntry = false;
+        if (uStart == uEnd || IsComment(a_pData[uStart])) {
+            bEntry = false;
+        }
+        else if (a_pData[uStart] == '[') {
+            size_t uClose = uStart + 1;
+            while (uClose < uEnd && a_pData[uClose] != ']') {
+                ++uClose;
+            }
+            bEntry = (uClose < uEnd);
+        }
+        else {
+            size_t uEquals = uStart;
+            while (uEquals < uEnd && a_pData[uEquals] != '=') {
+                ++uEquals;
+            }
+            if (uEquals == uEnd) {
+                bEntry = m_bAllowKeyOnly;
+            }
+            else if (uEquals > uStart) {
+                bEntry = true;
+
+                // a multi-line value starts with <<< and its tag is the
+                // rest of the value
+                size_t uVal = uEquals + 1;
+                while (uVal < uEnd && IsSpace(a_pData[uVal])) {
+                    ++uVal;
+                }
+                size_t uTrim = uEnd;
+                while (uTrim > uVal && IsSpace(a_pData[uTrim - 1])) {
+                    --uTrim;
+                }
+                if (m_bAllowMultiLine && uTrim - uVal >= 3
+                    && a_pData[uVal] == '<' && a_pData[uVal + 1] == '<'
+                    && a_pData[uVal + 2] == '<')
+                {
+                    strTag.assign(a_pData + uVal + 3, uTrim - uVal - 3);
+                    bInValue = true;
+                }
+            }
+        }
+
+        if (bEntry) {
+            uSplit = uRun;
+            uRun = uNext;
+        }
+        uLine = uNext;
+    }
+    return uSplit;
+}
+
+#ifdef SI_SUPPORT_IOSTREAMS
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadData(
+    std::istream & a_istream
+    )
+{
+    std::string strData;
+    char szBuf[512];
+    do {
+        a_istream.get(szBuf, sizeof(szBuf), '\0');
+        strData.append(szBuf);
+    }
+    while (a_istream.good());
+    return LoadData(strData);
+}
+#endif // SI_SUPPORT_IOSTREAMS
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindFileComment(
+    SI_CHAR *&      a_pData,
+    bool            a_bCopyStrings
+    )
+{
+    // there can only be a single file comment
+    if (m_pFileComment || IsStripComments()) {
+        return SI_OK;
+    }
+
+    // Load the file comment as multi-line text, this will modify all of
+    // the newline characters to be single \n chars
+    if (!LoadMultiLineText(a_pData, m_pFileComment, NULL, false)) {
+        return SI_OK;
+    }
+
+    // copy the string if necessary
+    if (a_bCopyStrings) {
+        SI_Error rc = CopyString(m_pFileComment);
+        if (rc < 0) return rc;
+    }
+
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindEntry(
+    SI_CHAR *&        a_pData,
+    const SI_CHAR *&  a_pSection,
+    const SI_CHAR *&  a_pKey,
+    const SI_CHAR *&  a_pVal,
+    const SI_CHAR *&  a_pComment
+    ) const
+{
+    a_pComment = NULL;
+
+    bool bHaveValue = false;
+    SI_CHAR * pTrail = NULL;
+    while (*a_pData) {
+        // skip spaces and empty lines
+        while (*a_pData && IsSpace(*a_pData)) {
+            ++a_pData;
+        }
+        if (!*a_pData) {
+            break;
+        }
+
+        // skip processing of comment lines but keep a pointer to
+        // the start of the comment, unless comments are discarded
+        if (IsComment(*a_pData)) {
+            if (IsStripComments()) {
+                a_pData = SI_ScanLine(a_pData, (SI_CHAR) 0, (SI_CHAR) 0);
+            }
+            else {
+                LoadMultiLineText(a_pData, a_pComment, NULL, true);
+            }
+            continue;
+        }
+
+        // process section names
+        if (*a_pData == '[') {
+            // skip leading spaces
+            ++a_pData;
+            while (*a_pData && IsSpace(*a_pData)) {
+                ++a_pData;
+            }
+
+            // find the end of the section name (it may contain spaces)
+            // and convert it to lowercase as necessary
+            a_pSection = a_pData;
+            a_pData = SI_ScanLine(a_pData, (SI_CHAR) ']', (SI_CHAR) ']');
+
+            // if it's an invalid line, just skip it
+            if (*a_pData != ']') {
+                continue;
+            }
+
+            // remove trailing spaces from the section
+            pTrail = a_pData - 1;
+            while (pTrail >= a_pSection && IsSpace(*pTrail)) {
+                --pTrail;
+            }
+            ++pTrail;
+            *pTrail = 0;
+
+            // skip to the end of the line
+            ++a_pData;  // safe as checked that it == ']' above
+            a_pData = SI_ScanLine(a_pData, (SI_CHAR) 0, (SI_CHAR) 0);
+
+            a_pKey = NULL;
+            a_pVal = NULL;
+            return true;
+        }
+
+        // find the end of the key name (it may contain spaces)
+        a_pKey = a_pData;
+        a_pData = SI_ScanLine(a_pData, (SI_CHAR) '=', (SI_CHAR) '=');
+        // *a_pData is null, equals, or newline
+
+        // if no value and we don't allow no value, then invalid
+        bHaveValue = (*a_pData == '=');
+        if (!bHaveValue && !m_bAllowKeyOnly) {
+            continue;
+        }
+
+        // empty keys are invalid
+        if (bHaveValue && a_pKey == a_pData) {
+            a_pData = SI_ScanLine(a_pData, (SI_CHAR) 0, (SI_CHAR) 0);
+            continue;
+        }
+
+        // remove trailing spaces from the key
+        pTrail = a_pData - 1;
+        while (pTrail >= a_pKey && IsSpace(*pTrail)) {
+            --pTrail;
+        }
+        ++pTrail;
+
+        if (bHaveValue) {
+            // process the value 
+            *pTrail = 0;
+
+            // skip leading whitespace on the value
+            ++a_pData;  // safe as checked that it == '=' above
+            while (*a_pData && !IsNewLineChar(*a_pData) && IsSpace(*a_pData)) {
+                ++a_pData;
+            }
+
+            // find the end of the value which is the end of this line
+            a_pVal = a_pData;
+            a_pData = SI_ScanLine(a_pData, (SI_CHAR) 0, (SI_CHAR) 0);
+
+            // remove trailing spaces from the value
+            pTrail = a_pData - 1;
+            if (*a_pData) { // prepare for the next round
+                SkipNewLine(a_pData);
+            }
+            while (pTrail >= a_pVal && IsSpace(*pTrail)) {
+                --pTrail;
+            }
+            ++pTrail;
+            *pTrail = 0;
+
+            // check for multi-line entries
+            if (m_bAllowMultiLine && IsMultiLineTag(a_pVal)) {
+                // skip the "<<<" to get the tag that will end the multiline
+                const SI_CHAR* pTagName = a_pVal + 3;
+                return LoadMultiLineText(a_pData, a_pVal, pTagName);
+            }
+
+            // check for quoted values, we are not supporting escapes in quoted values (yet)
+            if (m_bParseQuotes) {
+                --pTrail;
+                if (pTrail > a_pVal && *a_pVal == '"' && *pTrail == '"') {
+                    ++a_pVal;
+                    *pTrail = 0;
+                }
+            }
+        }
+        else {
+            // no value to process, just prepare for the next
+            if (*a_pData) { 
+                SkipNewLine(a_pData);
+            }
+            *pTrail = 0;
+            a_pVal = NULL;
+        }
+
+        // return the standard entry
+        return true;
+    }
+
+    return false;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsMultiLineTag(
+    const SI_CHAR * a_pVal
+    ) const
+{
+    // check for the "<<<" prefix for a multi-line entry
+    if (*a_pVal++ != '<') return false;
+    if (*a_pVal++ != '<') return false;
+    if (*a_pVal++ != '<') return false;
+    return true;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsMultiLineData(
+    const SI_CHAR * a_pData
+    ) const
+{
+    // data is multi-line if it has any of the following features:
+    //  * whitespace prefix
+    //  * embedded newlines
+    //  * whitespace suffix
+
+    // empty string
+    if (!*a_pData) {
+        return false;
+    }
+
+    // check for prefix
+    if (IsSpace(*a_pData)) {
+        return true;
+    }
+
+    // embedded newlines
+    const SI_CHAR * pStart = a_pData;
+    while (*a_pData) {
+        if (IsNewLineChar(*a_pData)) {
+            return true;
+        }
+        ++a_pData;
+    }
+
+    // check for suffix (ensure we don't go before start of string)
+    if (a_pData > pStart && IsSpace(*(a_pData - 1))) {
+        return true;
+    }
+
+    return false;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR, SI_STRLESS, SI_CONVERTER>::IsSingleLineQuotedValue(
+    const SI_CHAR* a_pData
+) const
+{
+    // data needs quoting if it starts or ends with whitespace
+    // and doesn't have embedded newlines
+
+    // empty string
+    if (!*a_pData) {
+        return false;
+    }
+
+    // check for prefix
+    if (IsSpace(*a_pData)) {
+        return true;
+    }
+
+    // embedded newlines
+    const SI_CHAR * pStart = a_pData;
+    while (*a_pData) {
+        if (IsNewLineChar(*a_pData)) {
+            return false;
+        }
+        ++a_pData;
+    }
+
+    // check for suffix (ensure we don't go before start of string)
+    if (a_pData > pStart && IsSpace(*(a_pData - 1))) {
+        return true;
+    }
+
+    return false;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsNewLineChar(
+    SI_CHAR a_c
+    ) const
+{
+    return (a_c == '\n' || a_c == '\r');
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadMultiLineText(
+    SI_CHAR *&          a_pData,
+    const SI_CHAR *&    a_pVal,
+    const SI_CHAR *     a_pTagName,
+    bool                a_bAllowBlankLinesInComment
+    ) const
+{
+    // we modify this data to strip all newlines down to a single '\n'
+    // character. This means that on Windows we need to strip out some
+    // characters which will make the data shorter.
+    // i.e.  LINE1-LINE1\r\nLINE2-LINE2\0 will become
+    //       LINE1-LINE1\nLINE2-LINE2\0
+    // The pDataLine entry is the pointer to the location in memory that
+    // the current line needs to start to run following the existing one.
+    // This may be the same as pCurrLine in which case no move is needed.
+    SI_CHAR * pDataLine = a_pData;
+    SI_CHAR * pCurrLine;
+
+    // value starts at the current line
+    a_pVal = a_pData;
+
+    // find the end tag. This tag must start in column 1 and be
+    // followed by a newline. We ignore any whitespace after the end
+    // tag but not whitespace before it.
+    SI_CHAR cEndOfLineChar = *a_pData;
+    for(;;) {
+        // if we are loading comments then we need a comment character as
+        // the first character on every line
+        if (!a_pTagName && !IsComment(*a_pData)) {
+            // if we aren't allowing blank lines then we're done
+            if (!a_bAllowBlankLinesInComment) {
+                break;
+            }
+
+            // if we are allowing blank lines then we only include them
+            // in this comment if another comment follows, so read ahead
+            // to find out.
+            SI_CHAR * pCurr = a_pData;
+            int nNewLines = 0;
+            while (IsSpace(*pCurr)) {
+                if (IsNewLineChar(*pCurr)) {
+                    ++nNewLines;
+                    SkipNewLine(pCurr);
+                }
+                else {
+                    ++pCurr;
+                }
+            }
+
+            // we have a comment, add the blank lines to the output
+            // and continue processing from here
+            if (IsComment(*pCurr)) {
+                for (; nNewLines > 0; --nNewLines) *pDataLine++ = '\n';
+                a_pData = pCurr;
+                continue;
+            }
+
+            // the comment ends here
+            break;
+        }
+
+        // find the end of this line
+        pCurrLine = a_pData;
+        a_pData = SI_ScanLine(a_pData, (SI_CHAR) 0, (SI_CHAR) 0);
+
+        // move this line down to the location that it should be if necessary
+        if (pDataLine < pCurrLine) {
+            size_t nLen = (size_t) (a_pData - pCurrLine);
+            memmove(pDataLine, pCurrLine, nLen * sizeof(SI_CHAR));
+            pDataLine[nLen] = '\0';
+        }
+
+        // end the line with a NULL
+        cEndOfLineChar = *a_pData;
+        *a_pData = 0;
+
+        // if are looking for a tag then do the check now. This is done before
+        // checking for end of the data, so that if we have the tag at the end
+        // of the data then the tag is removed correctly.
+        if (a_pTagName) {
+            // strip whitespace from the end of this tag, the line may have
+            // been moved down to pDataLine
+            SI_CHAR* pc = pDataLine + (a_pData - pCurrLine) - 1;
+            while (pc > pDataLine && IsSpace(*pc)) --pc;
+            SI_CHAR ch = *++pc;
+            *pc = 0;
+
+            if (!IsLess(pDataLine, a_pTagName) && !IsLess(a_pTagName, pDataLine)) {
+                break;
+            }
+
+            *pc = ch;
+        }
+
+        // if we are at the end of the data then we just automatically end
+        // this entry and return the current data.
+        if (!cEndOfLineChar) {
+            return true;
+        }
+
+        // otherwise we need to process this newline to ensure that it consists
+        // of just a single \n character.
+        pDataLine += (a_pData - pCurrLine);
+        *a_pData = cEndOfLineChar;
+        SkipNewLine(a_pData);
+        *pDataLine++ = '\n';
+    }
+
+    // if we didn't find a comment at all then return false
+    if (a_pVal == a_pData) {
+        a_pVal = NULL;
+        return false;
+    }
+
+    // the data (which ends at the end of the last line) needs to be
+    // null-terminated BEFORE before the newline character(s). If the
+    // user wants a new line in the multi-line data then they need to
+    // add an empty line before the tag.
+    *--pDataLine = '\0';
+
+    // if looking for a tag and if we aren't at the end of the data,
+    // then move a_pData to the start of the next line.
+    if (a_pTagName && cEndOfLineChar) {
+        SI_ASSERT(IsNewLineChar(cEndOfLineChar));
+        *a_pData = cEndOfLineChar;
+        SkipNewLine(a_pData);
+    }
+
+    return true;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CopyString(
+    const SI_CHAR *& a_pString
+    )
+{
+    size_t uLen = 0;
+    if (sizeof(SI_CHAR) == sizeof(char)) {
+        uLen = strlen((const char *)a_pString);
+    }
+    else if (sizeof(SI_CHAR) == sizeof(wchar_t)) {
+        uLen = wcslen((const wchar_t *)a_pString);
+    }
+    else {
+        for ( ; a_pString[uLen]; ++uLen) /*loop*/ ;
+    }
+    ++uLen; // NULL character
+    SI_CHAR * pCopy = AllocString(uLen);
+    if (!pCopy) {
+        return SI_NOMEM;
+    }
+    memcpy(pCopy, a_pString, sizeof(SI_CHAR)*uLen);
+    a_pString = pCopy;
+    return SI_OK;
+}
+
+// Each string in the copied strings buffer is prefixed by its capacity in
+// SI_CHAR (including the NULL) so that it can be freed and reused.
+#define SI_STRING_HEADER \
+    ((sizeof(unsigned int) + sizeof(SI_CHAR) - 1) / sizeof(SI_CHAR))
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AllocString(
+    size_t a_uLen
+    )
+{
+    // reuse a deleted string if there is one of a large enough capacity,
+    // everything in bucket n has capacity >= 2^n
+    int nClass = 0;
+    while (nClass < SI_STRING_CLASSES && ((size_t) 1 << nClass) < a_uLen) {
+        ++nClass;
+    }
+    for (int n = nClass; n < nClass + 2 && n < SI_STRING_CLASSES; ++n) {
+        if (!m_freeStrings[n].empty()) {
+            SI_CHAR * pString = m_freeStrings[n].back();
+            m_freeStrings[n].pop_back();
+            return pString;
+        }
+    }
+
+    // otherwise allocate from the end of the last block
+    size_t uNeeded = SI_STRING_HEADER + a_uLen;
+    if (m_strings.empty() || m_strings.back().uSize - m_strings.back().uUsed < uNeeded) {
+        // blocks double in size up to a limit, large strings get their own
+        size_t uSize = m_strings.empty() ? 4096 : m_strings.back().uSize * 2;
+        if (uSize > 1024 * 1024) uSize = 1024 * 1024;
+        if (uSize < uNeeded) uSize = uNeeded;
+
+        StringBlock oBlock;
+        oBlock.pData = AllocBlock(uSize);
+        if (!oBlock.pData) {
+            return NULL;
+        }
+        oBlock.uSize = uSize;
+        oBlock.uUsed = 0;
+        m_strings.push_back(oBlock);
+    }
+
+    StringBlock & oBlock = m_strings.back();
+    SI_CHAR * pString = oBlock.pData + oBlock.uUsed + SI_STRING_HEADER;
+    unsigned int uCapacity = (unsigned int) a_uLen;
+    memcpy(pString - SI_STRING_HEADER, &uCapacity, sizeof(uCapacity));
+    oBlock.uUsed += uNeeded;
+    return pString;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ReserveStrings(
+    size_t a_uLen
+    )
+{
+    if (!m_strings.empty() && m_strings.back().uSize - m_strings.back().uUsed >= a_uLen) {
+        return SI_OK;
+    }
+
+    // a new last block, sized as AllocString() would but large enough for
+    // all of the strings
+    size_t uSize = m_strings.empty() ? 4096 : m_strings.back().uSize * 2;
+    if (uSize > 1024 * 1024) uSize = 1024 * 1024;
+    if (uSize < a_uLen) uSize = a_uLen;
+
+    StringBlock oBlock;
+    oBlock.pData = AllocBlock(uSize);
+    if (!oBlock.pData) {
+        return SI_NOMEM;
+    }
+    oBlock.uSize = uSize;
+    oBlock.uUsed = 0;
+    m_strings.push_back(oBlock);
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AddEntry(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    const SI_CHAR * a_pValue,
+    const SI_CHAR * a_pComment,
+    bool            a_bForceReplace,
+    bool            a_bCopyStrings
+    )
+{
+    ChangeScope oScope(*this);
+    SI_Error rc;
+    bool bInserted = false;
+
+    SI_ASSERT(!a_pComment || IsComment(*a_pComment));
+#ifdef SI_NO_COMMENTS
+    a_pComment = NULL;
+#endif
+
+    // frozen data is read-only
+    if (m_bFrozen) {
+        return SI_FAIL;
+    }
+
+    // the rest of a lazily loaded section comes before any new entry
+    rc = ParseLazySection(a_pSection);
+    if (rc < 0) return rc;
+
+    // renumber once half of the load orders belong to deleted entries
+    if (!m_bInBatch && m_order.size() > 64 && m_uOrderUsed < m_order.size() / 2) {
+        CompactOrder();
+    }
+
+    // if we are copying strings then make a copy of the comment now
+    // because we will need it when we add the entry.
+    if (a_bCopyStrings && a_pComment) {
+        rc = CopyString(a_pComment);
+        if (rc < 0) return rc;
+    }
+
+    // create the section entry if necessary
+    typename TSection::iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        // if the section doesn't exist then we need a copy as the
+        // string needs to last beyond the end of this function
+        if (a_bCopyStrings) {
+            rc = CopyString(a_pSection);
+            if (rc < 0) return rc;
+        }
+
+        // only set the comment if this is a section only entry
+        Entry oSection(a_pSection, a_pKey ? NULL : a_pComment, ++m_nOrder);
+
+        typename TSection::value_type oEntry(oSection, TKeyVal());
+        typedef typename TSection::iterator SectionIterator;
+        std::pair<SectionIterator,bool> i = m_data.insert(oEntry);
+        iSection = i.first;
+        bInserted = true;
+        OrderLink(iSection, typename TKeyVal::iterator(), false);
+        RecordChange(iSection->first.pItem, NULL);
+        if (m_bHashIndex) {
+            IndexInsert(iSection, typename TKeyVal::iterator(), false);
+        }
+    }
+    if (!a_pKey) {
+        // section only entries are specified with pItem as NULL
+        return bInserted ? SI_INSERTED : SI_UPDATED;
+    }
+
+    // check for existence of the key
+    TKeyVal & keyval = iSection->second;
+    typename TKeyVal::iterator iKey = keyval.find(a_pKey);
+    bInserted = iKey == keyval.end();
+
+    // a single value keeping its comment is just updated, so that setting
+    // the value it already has isn't a change
+    bool bReplace = iKey != keyval.end() && m_bAllowMultiKey && a_bForceReplace;
+    if (bReplace && (iKey->first.pComment || !a_pComment)
+        && (std::next(iKey) == keyval.end()
+            || IsLess(a_pKey, std::next(iKey)->first.pItem)))
+    {
+        if (a_bCopyStrings) {
+            DeleteString(a_pComment);
+        }
+        bReplace = false;
+    }
+
+    // remove all existing entries but save the load order and
+    // comment of the first entry
+    int nLoadOrder = 0;
+    unsigned uHandle = 0;
+    if (bReplace) {
+        const SI_CHAR * pComment = NULL;
+        int nFirst = iKey->first.nOrder;
+        while (iKey != keyval.end() && !IsLess(a_pKey, iKey->first.pItem)) {
+            if (!nLoadOrder || iKey->first.nOrder < nLoadOrder) {
+                nLoadOrder = iKey->first.nOrder;
+                pComment   = iKey->first.pComment;
+            }
+            ++iKey;
+        }
+        if (pComment) {
+            DeleteString(a_pComment);
+            a_pComment = pComment;
+            rc = CopyString(a_pComment);
+            if (rc < 0) return rc;
+        }
+
+        // a handle to the first value moves to the value that replaces it
+        std::swap(uHandle, m_order[nFirst].uHandle);
+        Delete(a_pSection, a_pKey);
+        iKey = keyval.end();
+    }
+
+    // values need to be a valid string, even if they are an empty string
+    if (!a_pValue) {
+        a_pValue = &m_cEmptyString;
+    }
+
+    // make string copies if necessary
+    bool bForceCreateNewKey = m_bAllowMultiKey && !a_bForceReplace;
+    if (a_bCopyStrings) {
+        if (bForceCreateNewKey || iKey == keyval.end()) {
+            // if the key doesn't exist then we need a copy as the
+            // string needs to last beyond the end of this function
+            // because we will be inserting the key next
+            rc = CopyString(a_pKey);
+        }
+
+        // we always need a copy of the value
+        if (rc >= 0) {
+            rc = CopyString(a_pValue);
+        }
+        if (rc < 0) {
+            if (uHandle) FreeHandle(uHandle - 1);
+            return rc;
+        }
+    }
+
+    // create the key entry
+    if (iKey == keyval.end() || bForceCreateNewKey) {
+        Entry oKey(a_pKey, a_pComment, nLoadOrder ? nLoadOrder : ++m_nOrder);
+        typename TKeyVal::value_type oEntry(oKey, static_cast<const SI_CHAR *>(NULL));
+        bool bNewKey = (iKey == keyval.end());
+        iKey = keyval.insert(oEntry);
+        OrderLink(iSection, iKey, true);
+        if (uHandle) {
+            m_order[nLoadOrder].uHandle = uHandle;
+            m_handles[uHandle - 1].iKey = iKey;
+        }
+        if (bNewKey && m_bHashIndex) {
+            IndexInsert(iSection, iKey, true);
+        }
+    }
+
+    // the previous value is no longer reachable so neither is its cached form
+    if (m_bTypedCache && iKey->second) {
+        m_typedCache.erase(iKey->second);
+    }
+    if (!m_subscriptions.empty()) {
+        const SI_CHAR * pOld = iKey->second;
+        const SI_CHAR * pNew = a_pValue;
+        while (pOld && *pOld && *pOld == *pNew) {
+            ++pOld;
+            ++pNew;
+        }
+        if (!pOld || *pOld != *pNew) {
+            RecordChange(iSection->first.pItem, iKey->first.pItem);
+        }
+    }
+    iKey->second = a_pValue;
+    return bInserted ? SI_INSERTED : SI_UPDATED;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+const SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    const SI_CHAR * a_pDefault,
+    bool *          a_pHasMultiple
+    ) const
+{
+    if (a_pHasMultiple) {
+        *a_pHasMultiple = false;
+    }
+    (void) ParseLazySection(a_pSection);
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = a_pKey ? FindFrozen(a_pSection, a_pKey) : NULL;
+        if (!pSlot) {
+            return a_pDefault;
+        }
+        size_t uKey = pSlot->uKey;
+        if (m_bAllowMultiKey && a_pHasMultiple
+            && uKey + 1 < m_frozenSections[pSlot->uSection].uEndKey)
+        {
+            *a_pHasMultiple = !IsLess(a_pKey, m_frozenKeys[uKey + 1].key.pItem);
+        }
+        return m_frozenKeys[uKey].pValue;
+    }
+
+    typename TSection::const_iterator iSection;
+    typename TKeyVal::const_iterator iKeyVal;
+    if (!FindKey(a_pSection, a_pKey, iSection, iKeyVal)) {
+        return a_pDefault;
+    }
+
+    // check for multiple entries with the same key
+    if (m_bAllowMultiKey && a_pHasMultiple) {
+        typename TKeyVal::const_iterator iTemp = iKeyVal;
+        if (++iTemp != iSection->second.end()) {
+            if (!IsLess(a_pKey, iTemp->first.pItem)) {
+                *a_pHasMultiple = true;
+            }
+        }
+    }
+
+    return iKeyVal->second;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+const SI_CHAR *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindValue(
+    const SI_CHAR *     a_pSection,
+    const SI_CHAR *     a_pKey,
+    unsigned long long  a_uHash
+    ) const
+{
+    if (!a_pSection || !a_pKey) {
+        return NULL;
+    }
+    (void) ParseLazySection(a_pSection);
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = FindFrozen(a_pSection, a_pKey, a_uHash);
+        return pSlot ? m_frozenKeys[pSlot->uKey].pValue : NULL;
+    }
+    if (m_bHashIndex) {
+        size_t uSlot = FindIndexSlot(a_pSection, a_pKey, a_uHash);
+        return uSlot == (size_t) -1 ? NULL : m_index[uSlot].iKey->second;
+    }
+
+    typename TSection::const_iterator iSection;
+    typename TKeyVal::const_iterator iKeyVal;
+    return FindKey(a_pSection, a_pKey, iSection, iKeyVal) ? iKeyVal->second : NULL;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+size_t
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetValues(
+    const SI_CHAR *         a_pSection,
+    const SI_CHAR * const * a_pKeys,
+    size_t                  a_uCount,
+    const SI_CHAR **        a_pValues,
+    const SI_CHAR *         a_pDefault
+    ) const
+{
+    for (size_t n = 0; n < a_uCount; ++n) {
+        a_pValues[n] = a_pDefault;
+    }
+    if (!a_pSection) {
+        return 0;
+    }
+    (void) ParseLazySection(a_pSection);
+
+    size_t uFound = 0;
+    if (m_bFrozen) {
+        // the values of the section are sorted by key
+        const FrozenSlot * pSlot = FindFrozen(a_pSection, NULL);
+        if (!pSlot) {
+            return 0;
+        }
+        const FrozenSection & section = m_frozenSections[pSlot->uSection];
+        typename std::vector<FrozenKey>::const_iterator iBegin =
+            m_frozenKeys.begin() + section.uFirstKey;
+        typename std::vector<FrozenKey>::const_iterator iEnd =
+            m_frozenKeys.begin() + section.uEndKey;
+        for (size_t n = 0; n < a_uCount; ++n) {
+            if (!a_pKeys[n]) {
+                continue;
+            }
+            typename std::vector<FrozenKey>::const_iterator iKey = std::lower_bound(
+                iBegin, iEnd, a_pKeys[n],
+                [this](const FrozenKey & a_oKey, const SI_CHAR * a_pKey) {
+                    return IsLess(a_oKey.key.pItem, a_pKey);
+                });
+            if (iKey != iEnd && !IsLess(a_pKeys[n], iKey->key.pItem)) {
+                a_pValues[n] = iKey->pValue;
+                ++uFound;
+            }
+        }
+        return uFound;
+    }
+
+    typename TSection::const_iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        return 0;
+    }
+    for (size_t n = 0; n < a_uCount; ++n) {
+        if (!a_pKeys[n]) {
+            continue;
+        }
+        typename TKeyVal::const_iterator iKeyVal = iSection->second.find(a_pKeys[n]);
+        if (iKeyVal != iSection->second.end()) {
+            a_pValues[n] = iKeyVal->second;
+            ++uFound;
+        }
+    }
+    return uFound;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+long
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetLongValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    long            a_nDefault,
+    bool *          a_pHasMultiple
+    ) const
+{
+    return ParseLongValue(GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple), a_nDefault);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+long
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseLongValue(
+    const SI_CHAR * a_pValue,
+    long            a_nDefault
+    ) const
+{
+    // return the default if we don't have a value
+    if (!a_pValue || !*a_pValue) return a_nDefault;
+
+    // use the previously parsed result if there is one
+    TypedValue * pTyped = NULL;
+    if (m_bTypedCache) {
+        pTyped = &m_typedCache.try_emplace(a_pValue, TypedValue()).first->second;
+        if (pTyped->uFlags & SI_TYPED_LONG) {
+            return (pTyped->uFlags & SI_TYPED_LONG_OK) ? pTyped->nLong : a_nDefault;
+        }
+    }
+
+    // convert to UTF-8/MBCS which for a numeric value will be the same as
+    // ASCII, any invalid strings will return the default value
+    char szValue[64] = { 0 };
+    const char * pszBegin = NULL;
+    const char * pszEnd = NULL;
+    long nValue = 0;
+    bool bValid = GetNumberText(a_pValue, szValue, sizeof(szValue), pszBegin, pszEnd)
+        && SI_ParseLong(pszBegin, pszEnd, nValue);
+    if (pTyped) {
+        pTyped->nLong = nValue;
+        pTyped->uFlags |= bValid ? SI_TYPED_LONG | SI_TYPED_LONG_OK : SI_TYPED_LONG;
+    }
+    return bValid ? nValue : a_nDefault;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error 
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetLongValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    long            a_nValue,
+    const SI_CHAR * a_pComment,
+    bool            a_bUseHex,
+    bool            a_bForceReplace
+    )
+{
+    // use SetValue to create sections
+    if (!a_pSection || !a_pKey) return SI_FAIL;
+
+    // convert to an ASCII string
+    char szInput[64];
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    sprintf_s(szInput, a_bUseHex ? "0x%lx" : "%ld", a_nValue);
+#else // !__STDC_WANT_SECURE_LIB__
+    snprintf(szInput, sizeof(szInput), a_bUseHex ? "0x%lx" : "%ld", a_nValue);
+#endif // __STDC_WANT_SECURE_LIB__
+
+    // convert to output text
+    SI_CHAR szOutput[64];
+    SI_CONVERTER c(m_bStoreIsUtf8);
+    c.ConvertFromStore(szInput, strlen(szInput) + 1, 
+        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
+
+    // actually add it
+    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+double
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetDoubleValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    double          a_nDefault,
+    bool *          a_pHasMultiple
+    ) const
+{
+    return ParseDoubleValue(GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple), a_nDefault);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+double
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseDoubleValue(
+    const SI_CHAR * a_pValue,
+    double          a_nDefault
+    ) const
+{
+    // return the default if we don't have a value
+    if (!a_pValue || !*a_pValue) return a_nDefault;
+
+    // use the previously parsed result if there is one
+    TypedValue * pTyped = NULL;
+    if (m_bTypedCache) {
+        pTyped = &m_typedCache.try_emplace(a_pValue, TypedValue()).first->second;
+        if (pTyped->uFlags & SI_TYPED_DOUBLE) {
+            return (pTyped->uFlags & SI_TYPED_DOUBLE_OK) ? pTyped->nDouble : a_nDefault;
+        }
+    }
+
+    // convert to UTF-8/MBCS which for a numeric value will be the same as
+    // ASCII, any invalid strings will return the default value
+    char szValue[64] = { 0 };
+    const char * pszBegin = NULL;
+    const char * pszEnd = NULL;
+    double nValue = 0;
+    bool bValid = GetNumberText(a_pValue, szValue, sizeof(szValue), pszBegin, pszEnd)
+        && SI_ParseDouble(pszBegin, pszEnd, nValue);
+    if (pTyped) {
+        pTyped->nDouble = nValue;
+        pTyped->uFlags |= bValid ? SI_TYPED_DOUBLE | SI_TYPED_DOUBLE_OK : SI_TYPED_DOUBLE;
+    }
+    return bValid ? nValue : a_nDefault;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error 
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetDoubleValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    double          a_nValue,
+    const SI_CHAR * a_pComment,
+    bool            a_bForceReplace
+    )
+{
+    // use SetValue to create sections
+    if (!a_pSection || !a_pKey) return SI_FAIL;
+
+    // convert to an ASCII string
+    char szInput[64];
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    sprintf_s(szInput, "%f", a_nValue);
+#else // !__STDC_WANT_SECURE_LIB__
+    snprintf(szInput, sizeof(szInput), "%f", a_nValue);
+#endif // __STDC_WANT_SECURE_LIB__
+
+    // convert to output text
+    SI_CHAR szOutput[64];
+    SI_CONVERTER c(m_bStoreIsUtf8);
+    c.ConvertFromStore(szInput, strlen(szInput) + 1, 
+        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
+
+    // actually add it
+    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetBoolValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    bool            a_bDefault,
+    bool *          a_pHasMultiple
+    ) const
+{
+    return ParseBoolValue(GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple), a_bDefault);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ParseBoolValue(
+    const SI_CHAR * a_pValue,
+    bool            a_bDefault
+    ) const
+{
+    // return the default if we don't have a value
+    if (!a_pValue || !*a_pValue) return a_bDefault;
+
+    // we only look at the minimum number of characters
+    switch (a_pValue[0]) {
+    case 't': case 'T': // true
+    case 'y': case 'Y': // yes
+    case '1':           // 1 (one)
+        return true;
+
+    case 'f': case 'F': // false
+    case 'n': case 'N': // no
+    case '0':           // 0 (zero)
+        return false;
+
+    case 'o': case 'O':
+        if (a_pValue[1] == 'n' || a_pValue[1] == 'N') return true;  // on
+        if (a_pValue[1] == 'f' || a_pValue[1] == 'F') return false; // off
+        break;
+    }
+
+    // no recognized value, return the default
+    return a_bDefault;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error 
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetBoolValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    bool            a_bValue,
+    const SI_CHAR * a_pComment,
+    bool            a_bForceReplace
+    )
 {
-    Reset();
-}
+    // use SetValue to create sections
+    if (!a_pSection || !a_pKey) return SI_FAIL;
+
+    // convert to an ASCII string
+    const char * pszInput = a_bValue ? "true" : "false";
+
+    // convert to output text
+    SI_CHAR szOutput[64];
+    SI_CONVERTER c(m_bStoreIsUtf8);
+    c.ConvertFromStore(pszInput, strlen(pszInput) + 1, 
+        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
 
+    // actually add it
+    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+}
+    
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-void
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Reset()
+template<class T>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetListValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    const T *       a_pValues,
+    size_t          a_uCount,
+    const SI_CHAR * a_pComment,
+    bool            a_bForceReplace
+    )
 {
-    // remove all data
-    delete[] m_pData;
-    m_pData = NULL;
-    m_uDataLen = 0;
-    m_pFileComment = NULL;
-    if (!m_data.empty()) {
-        m_data.erase(m_data.begin(), m_data.end());
-    }
+    // use SetValue to create sections
+    if (!a_pSection || !a_pKey) return SI_FAIL;
 
-    // remove all strings
-    if (!m_strings.empty()) {
-        typename TNamesDepend::iterator i = m_strings.begin();
-        for (; i != m_strings.end(); ++i) {
-            delete[] const_cast<SI_CHAR*>(i->pItem);
+    // format the list, short lists don't need to allocate
+    char szStack[256];
+    std::vector<char> heap;
+    char * pszInput = szStack;
+    size_t uMaxLen = a_uCount * (SI_NUMBER_CHARS + 2) + 1;
+    if (uMaxLen > sizeof(szStack)) {
+        heap.resize(uMaxLen);
+        pszInput = heap.data();
+    }
+    char * pszEnd = pszInput;
+    for (size_t n = 0; n < a_uCount; ++n) {
+        if (n) {
+            *pszEnd++ = ',';
+            *pszEnd++ = ' ';
         }
-        m_strings.erase(m_strings.begin(), m_strings.end());
+        pszEnd = SI_FormatNumber(pszEnd, a_pValues[n]);
+    }
+    *pszEnd = 0;
+
+    if (SI_IsPassThrough<SI_CONVERTER>::value) {
+        return AddEntry(a_pSection, a_pKey, reinterpret_cast<const SI_CHAR *>(pszInput),
+            a_pComment, a_bForceReplace, true);
+    }
+
+    // convert to output text, which is ASCII so needs one SI_CHAR per char
+    size_t uLen = (size_t) (pszEnd - pszInput) + 1;
+    std::vector<SI_CHAR> output(uLen);
+    SI_CONVERTER c(m_bStoreIsUtf8);
+    if (!c.ConvertFromStore(pszInput, uLen, output.data(), output.size())) {
+        return SI_FAIL;
     }
+    return AddEntry(a_pSection, a_pKey, output.data(), a_pComment, a_bForceReplace, true);
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
-    const char * a_pszFile
-    )
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllValues(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    TNamesDepend &  a_values
+    ) const
 {
-    FILE * fp = NULL;
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    fopen_s(&fp, a_pszFile, "rb");
-#else // !__STDC_WANT_SECURE_LIB__
-    fp = fopen(a_pszFile, "rb");
-#endif // __STDC_WANT_SECURE_LIB__
-    if (!fp) {
-        return SI_FILE;
+    a_values.clear();
+    (void) ParseLazySection(a_pSection);
+
+    if (m_bFrozen) {
+        TValueView values = Values(a_pSection, a_pKey);
+        a_values.assign(values.begin(), values.end());
+        return !values.empty();
     }
-    SI_Error rc = LoadFile(fp);
-    fclose(fp);
-    return rc;
+
+    typename TSection::const_iterator iSection;
+    typename TKeyVal::const_iterator iKeyVal;
+    if (!FindKey(a_pSection, a_pKey, iSection, iKeyVal)) {
+        return false;
+    }
+
+    // insert all values for this key
+    a_values.push_back(Entry(iKeyVal->second, iKeyVal->first.pComment, iKeyVal->first.nOrder));
+    if (m_bAllowMultiKey) {
+        ++iKeyVal;
+        while (iKeyVal != iSection->second.end() && !IsLess(a_pKey, iKeyVal->first.pItem)) {
+            a_values.push_back(Entry(iKeyVal->second, iKeyVal->first.pComment, iKeyVal->first.nOrder));
+            ++iKeyVal;
+        }
+    }
+
+    return true;
 }
 
-#ifdef SI_HAS_WIDE_FILE
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
-    const SI_WCHAR_T * a_pwszFile
-    )
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TNameView
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Sections(
+    bool            a_bLoadOrder
+    ) const
 {
-#ifdef _WIN32
-    FILE * fp = NULL;
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    _wfopen_s(&fp, a_pwszFile, L"rb");
-#else // !__STDC_WANT_SECURE_LIB__
-    fp = _wfopen(a_pwszFile, L"rb");
-#endif // __STDC_WANT_SECURE_LIB__
-    if (!fp) return SI_FILE;
-    SI_Error rc = LoadFile(fp);
-    fclose(fp);
-    return rc;
-#else // !_WIN32 (therefore SI_CONVERT_ICU)
-    char szFile[256];
-    u_austrncpy(szFile, a_pwszFile, sizeof(szFile));
-    return LoadFile(szFile);
-#endif // _WIN32
+    NameIterator begin, end;
+    begin.m_pIni = end.m_pIni = this;
+    if (m_bFrozen) {
+        begin.m_bFrozen = end.m_bFrozen = true;
+        begin.m_nSlot = end.m_nSlot = a_bLoadOrder ? 0 : -1;
+        end.m_uFrozen = m_frozenSections.size();
+    }
+    else if (a_bLoadOrder) {
+        begin.m_nSlot = m_order.empty() ? 0 : m_order[0].nFirst;
+        end.m_nSlot = 0;
+    }
+    else {
+        begin.m_iSection = m_data.begin();
+        end.m_iSection = m_data.end();
+    }
+    return TNameView(begin, end);
 }
-#endif // SI_HAS_WIDE_FILE
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadFile(
-    FILE * a_fpFile
-    )
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TNameView
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Keys(
+    const SI_CHAR * a_pSection,
+    bool            a_bLoadOrder
+    ) const
 {
-    // load the raw file data
-    int retval = fseek(a_fpFile, 0, SEEK_END);
-    if (retval != 0) {
-        return SI_FILE;
+    if (!a_pSection) {
+        return TNameView();
     }
-    long lSize = ftell(a_fpFile);
-    if (lSize < 0) {
-        return SI_FILE;
+    (void) ParseLazySection(a_pSection);
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = FindFrozen(a_pSection, NULL);
+        if (!pSlot) {
+            return TNameView();
+        }
+        const FrozenSection & section = m_frozenSections[pSlot->uSection];
+        const size_t uOffset = a_bLoadOrder ? m_frozenSections.size() : 0;
+        NameIterator begin, end;
+        begin.m_pIni = end.m_pIni = this;
+        begin.m_bFrozen = end.m_bFrozen = true;
+        begin.m_pFrozen = end.m_pFrozen = &section;
+        begin.m_nSlot = end.m_nSlot = a_bLoadOrder ? 0 : -1;
+        begin.m_uFrozen = uOffset + section.uFirstKey;
+        end.m_uFrozen = uOffset + section.uEndKey;
+        begin.SkipRepeatedKeys();
+        return TNameView(begin, end);
     }
-    if (lSize == 0) {
-        return SI_OK;
+
+    typename TSection::const_iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        return TNameView();
     }
 
-    // check file size is within supported limits (SI_MAX_FILE_SIZE)
-    if (static_cast<size_t>(lSize) > SI_MAX_FILE_SIZE) {
-        return SI_FILE;
+    NameIterator begin, end;
+    begin.m_pIni = end.m_pIni = this;
+    begin.m_pKeys = end.m_pKeys = &iSection->second;
+    if (a_bLoadOrder) {
+        begin.m_nSlot = m_order[(size_t) iSection->first.nOrder].nFirst;
+        begin.SkipRepeatedKeys();
+        end.m_nSlot = 0;
+    }
+    else {
+        begin.m_iKey = iSection->second.begin();
+        end.m_iKey = iSection->second.end();
     }
+    return TNameView(begin, end);
+}
 
-    // allocate and ensure NULL terminated
-    char * pData = new(std::nothrow) char[static_cast<size_t>(lSize) + 1];
-    if (!pData) {
-        return SI_NOMEM;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TValueView
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Values(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey
+    ) const
+{
+    (void) ParseLazySection(a_pSection);
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = a_pKey ? FindFrozen(a_pSection, a_pKey) : NULL;
+        if (!pSlot) {
+            return TValueView();
+        }
+        const FrozenKey * pBegin = &m_frozenKeys[pSlot->uKey];
+        const FrozenKey * pEnd = pBegin + 1;
+        if (m_bAllowMultiKey) {
+            const FrozenKey * pLast = &m_frozenKeys[0] + m_frozenSections[pSlot->uSection].uEndKey;
+            while (pEnd != pLast && !IsLess(a_pKey, pEnd->key.pItem)) {
+                ++pEnd;
+            }
+        }
+        return TValueView(ValueIterator(pBegin), ValueIterator(pEnd));
     }
-    pData[lSize] = 0;
-    
-    // load data into buffer
-    fseek(a_fpFile, 0, SEEK_SET);
-    size_t uRead = fread(pData, sizeof(char), lSize, a_fpFile);
-    if (uRead != (size_t) lSize) {
-        delete[] pData;
-        return SI_FILE;
+
+    typename TSection::const_iterator iSection;
+    typename TKeyVal::const_iterator iKeyVal;
+    if (!FindKey(a_pSection, a_pKey, iSection, iKeyVal)) {
+        return TValueView();
     }
 
-    // convert the raw data to unicode
-    SI_Error rc = LoadData(pData, uRead);
-    delete[] pData;
-    return rc;
+    // FindKey returns the first value, the rest follow it
+    typename TKeyVal::const_iterator iEnd = m_bAllowMultiKey
+        ? iSection->second.upper_bound(iKeyVal->first) : std::next(iKeyVal);
+    return TValueView(ValueIterator(iKeyVal), ValueIterator(iEnd));
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadData(
-    const char *    a_pData,
-    size_t          a_uDataLen
-    )
+int
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetSectionSize(
+    const SI_CHAR * a_pSection
+    ) const
 {
-    if (!a_pData) {
-        return SI_OK;
-    }
-    
-    // if the UTF-8 BOM exists, consume it and set mode to unicode, if we have
-    // already loaded data and try to change mode half-way through then this will
-    // be ignored and we will assert in debug versions
-    if (a_uDataLen >= 3 && memcmp(a_pData, SI_UTF8_SIGNATURE, 3) == 0) {
-        a_pData    += 3;
-        a_uDataLen -= 3;
-        SI_ASSERT(m_bStoreIsUtf8 || !m_pData); // we don't expect mixed mode data
-        SetUnicode();
+    if (!a_pSection) {
+        return -1;
     }
+    (void) ParseLazySection(a_pSection);
 
-    if (a_uDataLen == 0) {
-        return SI_OK;
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = FindFrozen(a_pSection, NULL);
+        if (!pSlot) {
+            return -1;
+        }
+        const FrozenSection & section = m_frozenSections[pSlot->uSection];
+        if (!m_bAllowMultiKey) {
+            return (int) (section.uEndKey - section.uFirstKey);
+        }
+        TNameView keys = Keys(a_pSection);
+        return (int) std::distance(keys.begin(), keys.end());
     }
 
-    // determine the length of the converted data
-    SI_CONVERTER converter(m_bStoreIsUtf8);
-    size_t uLen = converter.SizeFromStore(a_pData, a_uDataLen);
-    if (uLen == (size_t)(-1)) {
-        return SI_FAIL;
+    typename TSection::const_iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        return -1;
     }
+    const TKeyVal & section = iSection->second;
 
-    // check converted data size is within supported limits (SI_MAX_FILE_SIZE)
-    if (uLen >= (SI_MAX_FILE_SIZE / sizeof(SI_CHAR))) {
-        return SI_FILE;
+    // if multi-key isn't permitted then the section size is
+    // the number of keys that we have.
+    if (!m_bAllowMultiKey || section.empty()) {
+        return (int) section.size();
     }
 
-    // allocate memory for the data, ensure that there is a NULL
-    // terminator wherever the converted data ends
-    SI_CHAR * pData = new(std::nothrow) SI_CHAR[uLen + 1];
-    if (!pData) {
-        return SI_NOMEM;
+    // otherwise we need to count them
+    int nCount = 0;
+    const SI_CHAR * pLastKey = NULL;
+    typename TKeyVal::const_iterator iKeyVal = section.begin();
+    for (; iKeyVal != section.end(); ++iKeyVal) {
+        if (!pLastKey || IsLess(pLastKey, iKeyVal->first.pItem)) {
+            ++nCount;
+            pLastKey = iKeyVal->first.pItem;
+        }
     }
-    memset(pData, 0, sizeof(SI_CHAR) * (uLen + 1));
+    return nCount;
+}
 
-    // convert the data
-    if (!converter.ConvertFromStore(a_pData, a_uDataLen, pData, uLen)) {
-        delete[] pData;
-        return SI_FAIL;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+const typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TKeyVal *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetSection(
+    const SI_CHAR * a_pSection
+    ) const
+{
+    (void) ParseLazySection(a_pSection);
+    if (a_pSection && !m_bFrozen) {
+        typename TSection::const_iterator i = FindSection(a_pSection);
+        if (i != m_data.end()) {
+            return &(i->second);
+        }
     }
+    return 0;
+}
 
-    // parse it
-    const static SI_CHAR empty = 0;
-    SI_CHAR * pWork = pData;
-    const SI_CHAR * pSection = &empty;
-    const SI_CHAR * pItem = NULL;
-    const SI_CHAR * pVal = NULL;
-    const SI_CHAR * pComment = NULL;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllSections(
+    TNamesDepend & a_names
+    ) const
+{
+    a_names.clear();
+    for (size_t n = 0; n < m_frozenSections.size(); ++n) {
+        a_names.push_back(m_frozenSections[n].section);
+    }
+    typename TSection::const_iterator i = m_data.begin();
+    for (; i != m_data.end(); ++i) {
+        a_names.push_back(i->first);
+    }
+}
 
-    // We copy the strings if we are loading data into this class when we
-    // already have stored some.
-    bool bCopyStrings = (m_pData != NULL);
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllKeys(
+    const SI_CHAR * a_pSection,
+    TNamesDepend &  a_names
+    ) const
+{
+    a_names.clear();
 
-    // find a file comment if it exists, this is a comment that starts at the
-    // beginning of the file and continues until the first blank line.
-    SI_Error rc = FindFileComment(pWork, bCopyStrings);
-    if (rc < 0) return rc;
+    if (!a_pSection) {
+        return false;
+    }
+    (void) ParseLazySection(a_pSection);
 
-    // add every entry in the file to the data table
-    while (FindEntry(pWork, pSection, pItem, pVal, pComment)) {
-        rc = AddEntry(pSection, pItem, pVal, pComment, false, bCopyStrings);
-        if (rc < 0) return rc;
+    if (m_bFrozen) {
+        TNameView keys = Keys(a_pSection);
+        a_names.assign(keys.begin(), keys.end());
+        return FindFrozen(a_pSection, NULL) != NULL;
     }
 
-    // store these strings if we didn't copy them
-    if (bCopyStrings) {
-        delete[] pData;
+    typename TSection::const_iterator iSection = FindSection(a_pSection);
+    if (iSection == m_data.end()) {
+        return false;
     }
-    else {
-        m_pData = pData;
-        m_uDataLen = uLen+1;
+
+    const TKeyVal & section = iSection->second;
+    const SI_CHAR * pLastKey = NULL;
+    typename TKeyVal::const_iterator iKeyVal = section.begin();
+    for (; iKeyVal != section.end(); ++iKeyVal) {
+        if (!pLastKey || IsLess(pLastKey, iKeyVal->first.pItem)) {
+            a_names.push_back(iKeyVal->first);
+            pLastKey = iKeyVal->first.pItem;
+        }
     }
 
-    return SI_OK;
+    return true;
 }
 
-#ifdef SI_SUPPORT_IOSTREAMS
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadData(
-    std::istream & a_istream
-    )
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
+    const char *    a_pszFile,
+    bool            a_bAddSignature
+    ) const
 {
-    std::string strData;
-    char szBuf[512];
-    do {
-        a_istream.get(szBuf, sizeof(szBuf), '\0');
-        strData.append(szBuf);
-    }
-    while (a_istream.good());
-    return LoadData(strData);
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, a_pszFile, "wb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(a_pszFile, "wb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) return SI_FILE;
+    SI_Error rc = SaveFile(fp, a_bAddSignature);
+    if (fclose(fp) != 0 && rc >= 0) rc = SI_FILE;
+    return rc;
 }
-#endif // SI_SUPPORT_IOSTREAMS
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindFileComment(
-    SI_CHAR *&      a_pData,
-    bool            a_bCopyStrings
-    )
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFileAtomic(
+    const char *    a_pszFile,
+    bool            a_bAddSignature
+    ) const
 {
-    // there can only be a single file comment
-    if (m_pFileComment) {
-        return SI_OK;
-    }
+    std::string strTemp(a_pszFile);
+    strTemp += ".tmp";
 
-    // Load the file comment as multi-line text, this will modify all of
-    // the newline characters to be single \n chars
-    if (!LoadMultiLineText(a_pData, m_pFileComment, NULL, false)) {
-        return SI_OK;
-    }
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    fopen_s(&fp, strTemp.c_str(), "wb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = fopen(strTemp.c_str(), "wb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) return SI_FILE;
+    SI_Error rc = SaveFile(fp, a_bAddSignature);
 
-    // copy the string if necessary
-    if (a_bCopyStrings) {
-        SI_Error rc = CopyString(m_pFileComment);
-        if (rc < 0) return rc;
-    }
+    // the data must be on the disk before the rename makes it visible
+    if (rc >= 0 && fflush(fp) != 0) rc = SI_FILE;
+#ifdef _WIN32
+    if (rc >= 0 && _commit(_fileno(fp)) != 0) rc = SI_FILE;
+#else // !_WIN32
+    if (rc >= 0 && fsync(fileno(fp)) != 0) rc = SI_FILE;
+#endif // _WIN32
+    if (fclose(fp) != 0 && rc >= 0) rc = SI_FILE;
 
-    return SI_OK;
+    if (rc >= 0) {
+#ifdef _WIN32
+        // rename() doesn't replace an existing file on Windows
+        if (!MoveFileExA(strTemp.c_str(), a_pszFile,
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            rc = SI_FILE;
+        }
+#else // !_WIN32
+        if (rename(strTemp.c_str(), a_pszFile) != 0) rc = SI_FILE;
+#endif // _WIN32
+    }
+    if (rc < 0) {
+        remove(strTemp.c_str());
+    }
+    return rc;
 }
 
+#ifdef SI_HAS_WIDE_FILE
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindEntry(
-    SI_CHAR *&        a_pData,
-    const SI_CHAR *&  a_pSection,
-    const SI_CHAR *&  a_pKey,
-    const SI_CHAR *&  a_pVal,
-    const SI_CHAR *&  a_pComment
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
+    const SI_WCHAR_T *  a_pwszFile,
+    bool                a_bAddSignature
     ) const
 {
-    a_pComment = NULL;
-
-    bool bHaveValue = false;
-    SI_CHAR * pTrail = NULL;
-    while (*a_pData) {
-        // skip spaces and empty lines
-        while (*a_pData && IsSpace(*a_pData)) {
-            ++a_pData;
-        }
-        if (!*a_pData) {
-            break;
-        }
+#ifdef _WIN32
+    FILE * fp = NULL;
+#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
+    _wfopen_s(&fp, a_pwszFile, L"wb");
+#else // !__STDC_WANT_SECURE_LIB__
+    fp = _wfopen(a_pwszFile, L"wb");
+#endif // __STDC_WANT_SECURE_LIB__
+    if (!fp) return SI_FILE;
+    SI_Error rc = SaveFile(fp, a_bAddSignature);
+    fclose(fp);
+    return rc;
+#else // !_WIN32 (therefore SI_CONVERT_ICU)
+    char szFile[256];
+    u_austrncpy(szFile, a_pwszFile, sizeof(szFile));
+    return SaveFile(szFile, a_bAddSignature);
+#endif // _WIN32
+}
+#endif // SI_HAS_WIDE_FILE
 
-        // skip processing of comment lines but keep a pointer to
-        // the start of the comment.
-        if (IsComment(*a_pData)) {
-            LoadMultiLineText(a_pData, a_pComment, NULL, true);
-            continue;
-        }
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
+    FILE *  a_pFile,
+    bool    a_bAddSignature
+    ) const
+{
+    BufferedFileWriter writer(a_pFile);
+    SI_Error rc = Save(writer, a_bAddSignature);
+    if (!writer.Flush() && rc >= 0) rc = SI_FILE;
+    return rc;
+}
 
-        // process section names
-        if (*a_pData == '[') {
-            // skip leading spaces
-            ++a_pData;
-            while (*a_pData && IsSpace(*a_pData)) {
-                ++a_pData;
-            }
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Save(
+    OutputWriter &  a_oOutput,
+    bool            a_bAddSignature
+    ) const
+{
+    Converter convert(m_bStoreIsUtf8);
+    SI_Error rc = ParseLazySections();
+    if (rc < 0) {
+        return rc;
+    }
 
-            // find the end of the section name (it may contain spaces)
-            // and convert it to lowercase as necessary
-            a_pSection = a_pData;
-            while (*a_pData && *a_pData != ']' && !IsNewLineChar(*a_pData)) {
-                ++a_pData;
-            }
+    // add the UTF-8 signature if it is desired
+    if (m_bStoreIsUtf8 && a_bAddSignature) {
+        a_oOutput.Write(SI_UTF8_SIGNATURE);
+    }
 
-            // if it's an invalid line, just skip it
-            if (*a_pData != ']') {
-                continue;
-            }
+    // write the file comment if we have one
+    bool bNeedNewLine = false;
+    if (m_pFileComment) {
+        if (!OutputMultiLineText(a_oOutput, convert, m_pFileComment)) {
+            return SI_FAIL;
+        }
+        bNeedNewLine = true;
+    }
 
-            // remove trailing spaces from the section
-            pTrail = a_pData - 1;
-            while (pTrail >= a_pSection && IsSpace(*pTrail)) {
-                --pTrail;
+    // the frozen data is written in the same way using its load order array
+    if (m_bFrozen) {
+        const size_t uSections = m_frozenSections.size();
+        auto writeSection = [&](size_t a_uSection) -> bool {
+            const FrozenSection & section = m_frozenSections[a_uSection];
+            if (!OutputSection(a_oOutput, convert, section.section, bNeedNewLine)) {
+                return false;
             }
-            ++pTrail;
-            *pTrail = 0;
 
-            // skip to the end of the line
-            ++a_pData;  // safe as checked that it == ']' above
-            while (*a_pData && !IsNewLineChar(*a_pData)) {
-                ++a_pData;
+            // all values of a key are written together at its first entry
+            for (size_t uPos = section.uFirstKey; uPos < section.uEndKey; ++uPos) {
+                size_t uKey = m_frozenOrder[uSections + uPos];
+                const SI_CHAR * pKey = m_frozenKeys[uKey].key.pItem;
+                if (uKey != section.uFirstKey
+                    && !IsLess(m_frozenKeys[uKey - 1].key.pItem, pKey))
+                {
+                    continue;
+                }
+                do {
+                    const FrozenKey & key = m_frozenKeys[uKey];
+                    if (!OutputKey(a_oOutput, convert, pKey, key.key, key.pValue)) {
+                        return false;
+                    }
+                }
+                while (m_bAllowMultiKey && ++uKey < section.uEndKey
+                    && !IsLess(pKey, m_frozenKeys[uKey].key.pItem));
             }
-
-            a_pKey = NULL;
-            a_pVal = NULL;
+            bNeedNewLine = true;
             return true;
-        }
-
-        // find the end of the key name (it may contain spaces)
-        a_pKey = a_pData;
-        while (*a_pData && *a_pData != '=' && !IsNewLineChar(*a_pData)) {
-            ++a_pData;
-        }
-        // *a_pData is null, equals, or newline
-
-        // if no value and we don't allow no value, then invalid
-        bHaveValue = (*a_pData == '=');
-        if (!bHaveValue && !m_bAllowKeyOnly) {
-            continue;
-        }
-
-        // empty keys are invalid
-        if (bHaveValue && a_pKey == a_pData) {
-            while (*a_pData && !IsNewLineChar(*a_pData)) {
-                ++a_pData;
-            }
-            continue;
-        }
+        };
 
-        // remove trailing spaces from the key
-        pTrail = a_pData - 1;
-        while (pTrail >= a_pKey && IsSpace(*pTrail)) {
-            --pTrail;
+        // the empty section is written first here too
+        const FrozenSlot * pRoot = FindFrozen(&m_cEmptyString, NULL);
+        if (pRoot && !writeSection(pRoot->uSection)) {
+            return SI_FAIL;
         }
-        ++pTrail;
-
-        if (bHaveValue) {
-            // process the value 
-            *pTrail = 0;
-
-            // skip leading whitespace on the value
-            ++a_pData;  // safe as checked that it == '=' above
-            while (*a_pData && !IsNewLineChar(*a_pData) && IsSpace(*a_pData)) {
-                ++a_pData;
+        for (size_t n = 0; n < uSections; ++n) {
+            if (pRoot && m_frozenOrder[n] == pRoot->uSection) {
+                continue;
             }
-
-            // find the end of the value which is the end of this line
-            a_pVal = a_pData;
-            while (*a_pData && !IsNewLineChar(*a_pData)) {
-                ++a_pData;
+            if (!writeSection(m_frozenOrder[n])) {
+                return SI_FAIL;
             }
+        }
+        return SI_OK;
+    }
 
-            // remove trailing spaces from the value
-            pTrail = a_pData - 1;
-            if (*a_pData) { // prepare for the next round
-                SkipNewLine(a_pData);
-            }
-            while (pTrail >= a_pVal && IsSpace(*pTrail)) {
-                --pTrail;
-            }
-            ++pTrail;
-            *pTrail = 0;
+    // if there is an empty section name, then it must be written out first
+    // regardless of the load order
+    typename TSection::const_iterator iRoot = FindSection(&m_cEmptyString);
+    const int nRoot = iRoot != m_data.end() ? iRoot->first.nOrder : 0;
+    auto nextSection = [&](int a_nSection) -> int {
+        int nNext = a_nSection == nRoot ? m_order[0].nFirst : m_order[a_nSection].nNext;
+        return (nNext && nNext == nRoot) ? m_order[nNext].nNext : nNext;
+    };
 
-            // check for multi-line entries
-            if (m_bAllowMultiLine && IsMultiLineTag(a_pVal)) {
-                // skip the "<<<" to get the tag that will end the multiline
-                const SI_CHAR* pTagName = a_pVal + 3;
-                return LoadMultiLineText(a_pData, a_pVal, pTagName);
+    // iterate through our sections in load order and output the data
+    int nSection = nRoot;
+    if (!nSection && !m_order.empty()) {
+        nSection = m_order[0].nFirst;
+    }
+    for ( ; nSection; nSection = nextSection(nSection)) {
+        const OrderSlot & oSection = m_order[nSection];
+        const TKeyVal & keyval = oSection.iSection->second;
+        if (!OutputSection(a_oOutput, convert, oSection.iSection->first, bNeedNewLine)) {
+            return SI_FAIL;
+        }
+
+        // write all keys and values in load order
+        for (int nKey = oSection.nFirst; nKey; nKey = m_order[nKey].nNext) {
+            typename TKeyVal::const_iterator iKeyVal = m_order[nKey].iKey;
+
+            // all values of a key are written together at its first entry,
+            // which is also the first of them in the map
+            if (iKeyVal != keyval.begin()
+                && !IsLess(std::prev(iKeyVal)->first.pItem, iKeyVal->first.pItem))
+            {
+                continue;
             }
 
-            // check for quoted values, we are not supporting escapes in quoted values (yet)
-            if (m_bParseQuotes) {
-                --pTrail;
-                if (pTrail > a_pVal && *a_pVal == '"' && *pTrail == '"') {
-                    ++a_pVal;
-                    *pTrail = 0;
+            const SI_CHAR * pKey = iKeyVal->first.pItem;
+            do {
+                if (!OutputKey(a_oOutput, convert, pKey, iKeyVal->first, iKeyVal->second)) {
+                    return SI_FAIL;
                 }
             }
-        }
-        else {
-            // no value to process, just prepare for the next
-            if (*a_pData) { 
-                SkipNewLine(a_pData);
-            }
-            *pTrail = 0;
+            while (m_bAllowMultiKey && ++iKeyVal != keyval.end()
+                && !IsLess(pKey, iKeyVal->first.pItem));
         }
 
-        // return the standard entry
-        return true;
+        bNeedNewLine = true;
     }
 
-    return false;
+    return SI_OK;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsMultiLineTag(
-    const SI_CHAR * a_pVal
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OutputSection(
+    OutputWriter &  a_oOutput,
+    Converter &     a_oConverter,
+    const Entry &   a_section,
+    bool &          a_bNeedNewLine
     ) const
 {
-    // check for the "<<<" prefix for a multi-line entry
-    if (*a_pVal++ != '<') return false;
-    if (*a_pVal++ != '<') return false;
-    if (*a_pVal++ != '<') return false;
+    // write out the comment if there is one
+    if (a_section.pComment) {
+        if (a_bNeedNewLine) {
+            a_oOutput.Write(SI_NEWLINE_A);
+            a_oOutput.Write(SI_NEWLINE_A);
+        }
+        if (!OutputMultiLineText(a_oOutput, a_oConverter, a_section.pComment)) {
+            return false;
+        }
+        a_bNeedNewLine = false;
+    }
+
+    if (a_bNeedNewLine) {
+        a_oOutput.Write(SI_NEWLINE_A);
+        a_oOutput.Write(SI_NEWLINE_A);
+        a_bNeedNewLine = false;
+    }
+
+    // write the section (unless there is no section name)
+    if (*a_section.pItem) {
+        const char * pszSection = a_oConverter.Convert(a_section.pItem);
+        if (!pszSection) {
+            return false;
+        }
+        a_oOutput.Write("[");
+        a_oOutput.Write(pszSection);
+        a_oOutput.Write("]");
+        a_oOutput.Write(SI_NEWLINE_A);
+    }
     return true;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsMultiLineData(
-    const SI_CHAR * a_pData
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OutputKey(
+    OutputWriter &  a_oOutput,
+    Converter &     a_oConverter,
+    const SI_CHAR * a_pKey,
+    const Entry &   a_key,
+    const SI_CHAR * a_pValue
     ) const
 {
-    // data is multi-line if it has any of the following features:
-    //  * whitespace prefix
-    //  * embedded newlines
-    //  * whitespace suffix
-
-    // empty string
-    if (!*a_pData) {
-        return false;
+    // write out the comment if there is one
+    if (a_key.pComment) {
+        a_oOutput.Write(SI_NEWLINE_A);
+        if (!OutputMultiLineText(a_oOutput, a_oConverter, a_key.pComment)) {
+            return false;
+        }
     }
 
-    // check for prefix
-    if (IsSpace(*a_pData)) {
-        return true;
+    // write the key
+    const char * pszKey = a_oConverter.Convert(a_pKey);
+    if (!pszKey) {
+        return false;
     }
-
-    // embedded newlines
-    const SI_CHAR * pStart = a_pData;
-    while (*a_pData) {
-        if (IsNewLineChar(*a_pData)) {
-            return true;
+    a_oOutput.Write(pszKey);
+
+    // write the value as long 
+    if (*a_pValue || !m_bAllowKeyOnly) {
+        a_oOutput.Write(m_bSpaces ? " = " : "=");
+        if (m_bAllowMultiLine && IsMultiLineData(a_pValue)
+            && !(m_bParseQuotes && IsSingleLineQuotedValue(a_pValue)))
+        {
+            // multi-line data needs to be processed specially to ensure
+            // that we use the correct newline format for the current system
+            a_oOutput.Write("<<<END_OF_TEXT" SI_NEWLINE_A);
+            if (!OutputMultiLineText(a_oOutput, a_oConverter, a_pValue)) {
+                return false;
+            }
+            a_oOutput.Write("END_OF_TEXT");
+        }
+        else {
+            const char * pszValue = a_oConverter.Convert(a_pValue);
+            if (!pszValue) {
+                return false;
+            }
+            if (m_bParseQuotes && IsSingleLineQuotedValue(a_pValue)) {
+                // the only way to preserve external whitespace on a value (i.e. before or after)
+                // is to quote it. This is simple quoting, we don't escape quotes within the data. 
+                a_oOutput.Write("\"");
+                a_oOutput.Write(pszValue);
+                a_oOutput.Write("\"");
+            }
+            else {
+                a_oOutput.Write(pszValue);
+            }
         }
-        ++a_pData;
-    }
-
-    // check for suffix (ensure we don't go before start of string)
-    if (a_pData > pStart && IsSpace(*(a_pData - 1))) {
-        return true;
     }
-
-    return false;
+    a_oOutput.Write(SI_NEWLINE_A);
+    return true;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 bool
-CSimpleIniTempl<SI_CHAR, SI_STRLESS, SI_CONVERTER>::IsSingleLineQuotedValue(
-    const SI_CHAR* a_pData
-) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OutputMultiLineText(
+    OutputWriter &  a_oOutput,
+    Converter &     a_oConverter,
+    const SI_CHAR * a_pText
+    ) const
 {
-    // data needs quoting if it starts or ends with whitespace
-    // and doesn't have embedded newlines
-
-    // empty string
-    if (!*a_pData) {
-        return false;
-    }
-
-    // check for prefix
-    if (IsSpace(*a_pData)) {
-        return true;
-    }
+    const SI_CHAR * pEndOfLine;
+    SI_CHAR cEndOfLineChar = *a_pText;
+    while (cEndOfLineChar) {
+        // find the end of this line
+        pEndOfLine = a_pText;
+        for (; *pEndOfLine && *pEndOfLine != '\n'; ++pEndOfLine) /*loop*/ ;
+        cEndOfLineChar = *pEndOfLine;
 
-    // embedded newlines
-    const SI_CHAR * pStart = a_pData;
-    while (*a_pData) {
-        if (IsNewLineChar(*a_pData)) {
-            return false;
+        if (SI_IsPassThrough<SI_CONVERTER>::value) {
+            // output the line as it is
+            a_oOutput.Write(reinterpret_cast<const char *>(a_pText),
+                (size_t) (pEndOfLine - a_pText));
         }
-        ++a_pData;
-    }
-
-    // check for suffix (ensure we don't go before start of string)
-    if (a_pData > pStart && IsSpace(*(a_pData - 1))) {
-        return true;
+        else {
+            // temporarily null terminate, convert and output the line
+            *const_cast<SI_CHAR*>(pEndOfLine) = 0;
+            if (!a_oConverter.ConvertToStore(a_pText)) {
+                return false;
+            }
+            *const_cast<SI_CHAR*>(pEndOfLine) = cEndOfLineChar;
+            a_oOutput.Write(a_oConverter.Data());
+        }
+        a_pText += (pEndOfLine - a_pText) + 1;
+        a_oOutput.Write(SI_NEWLINE_A);
     }
-
-    return false;
+    return true;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsNewLineChar(
-    SI_CHAR a_c
-    ) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Delete(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    bool            a_bRemoveEmpty
+    )
 {
-    return (a_c == '\n' || a_c == '\r');
+    return DeleteValue(a_pSection, a_pKey, NULL, a_bRemoveEmpty);
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::LoadMultiLineText(
-    SI_CHAR *&          a_pData,
-    const SI_CHAR *&    a_pVal,
-    const SI_CHAR *     a_pTagName,
-    bool                a_bAllowBlankLinesInComment
-    ) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::DeleteValue(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    const SI_CHAR * a_pValue,
+    bool            a_bRemoveEmpty
+    )
 {
-    // we modify this data to strip all newlines down to a single '\n'
-    // character. This means that on Windows we need to strip out some
-    // characters which will make the data shorter.
-    // i.e.  LINE1-LINE1\r\nLINE2-LINE2\0 will become
-    //       LINE1-LINE1\nLINE2-LINE2\0
-    // The pDataLine entry is the pointer to the location in memory that
-    // the current line needs to start to run following the existing one.
-    // This may be the same as pCurrLine in which case no move is needed.
-    SI_CHAR * pDataLine = a_pData;
-    SI_CHAR * pCurrLine;
-
-    // value starts at the current line
-    a_pVal = a_pData;
-
-    // find the end tag. This tag must start in column 1 and be
-    // followed by a newline. We ignore any whitespace after the end
-    // tag but not whitespace before it.
-    SI_CHAR cEndOfLineChar = *a_pData;
-    for(;;) {
-        // if we are loading comments then we need a comment character as
-        // the first character on every line
-        if (!a_pTagName && !IsComment(*a_pData)) {
-            // if we aren't allowing blank lines then we're done
-            if (!a_bAllowBlankLinesInComment) {
-                break;
-            }
-
-            // if we are allowing blank lines then we only include them
-            // in this comment if another comment follows, so read ahead
-            // to find out.
-            SI_CHAR * pCurr = a_pData;
-            int nNewLines = 0;
-            while (IsSpace(*pCurr)) {
-                if (IsNewLineChar(*pCurr)) {
-                    ++nNewLines;
-                    SkipNewLine(pCurr);
-                }
-                else {
-                    ++pCurr;
-                }
-            }
+    if (!a_pSection || m_bFrozen) {
+        return false;
+    }
+    ChangeScope oScope(*this);
 
-            // we have a comment, add the blank lines to the output
-            // and continue processing from here
-            if (IsComment(*pCurr)) {
-                for (; nNewLines > 0; --nNewLines) *pDataLine++ = '\n';
-                a_pData = pCurr;
-                continue;
-            }
+    // the rest of a lazily loaded section is either needed or discarded,
+    // the keys of a deleted section are needed to report them
+    if (a_pKey || !m_subscriptions.empty()) {
+        (void) ParseLazySection(a_pSection);
+    }
+    typename TSection::iterator iSection = FindSection(a_pSection);
+    if (iSection != m_data.end() && !a_pKey) {
+        m_lazy.erase(iSection->first.pItem);
+    }
+    if (iSection == m_data.end()) {
+        return false;
+    }
 
-            // the comment ends here
-            break;
+    // remove a single key if we have a keyname
+    if (a_pKey) {
+        typename TKeyVal::iterator iKeyVal = iSection->second.find(a_pKey);
+        if (iKeyVal == iSection->second.end()) {
+            return false;
         }
 
-        // find the end of this line
-        pCurrLine = a_pData;
-        while (*a_pData && !IsNewLineChar(*a_pData)) ++a_pData;
-
-        // move this line down to the location that it should be if necessary
-        if (pDataLine < pCurrLine) {
-            size_t nLen = (size_t) (a_pData - pCurrLine);
-            memmove(pDataLine, pCurrLine, nLen * sizeof(SI_CHAR));
-            pDataLine[nLen] = '\0';
+        // the index refers to the first entry which may be removed, so drop
+        // it now while the entry is valid and add it back afterwards
+        if (m_bHashIndex) {
+            IndexErase(a_pSection, a_pKey);
         }
 
-        // end the line with a NULL
-        cEndOfLineChar = *a_pData;
-        *a_pData = 0;
+        const static SI_STRLESS isLess = SI_STRLESS();
 
-        // if are looking for a tag then do the check now. This is done before
-        // checking for end of the data, so that if we have the tag at the end
-        // of the data then the tag is removed correctly.
-        if (a_pTagName) {
-            // strip whitespace from the end of this tag
-            SI_CHAR* pc = a_pData - 1;
-            while (pc > pDataLine && IsSpace(*pc)) --pc;
-            SI_CHAR ch = *++pc;
-            *pc = 0;
+        // remove any copied strings and then the key
+        typename TKeyVal::iterator iDelete;
+        bool bDeleted = false;
+        do {
+            iDelete = iKeyVal++;
+
+            if(a_pValue == NULL ||
+            (isLess(a_pValue, iDelete->second) == false &&
+            isLess(iDelete->second, a_pValue) == false)) {
+                RecordChange(iSection->first.pItem, iDelete->first.pItem);
+                DeleteString(iDelete->first.pItem);
+                DeleteString(iDelete->second);
+                OrderUnlink(iDelete->first.nOrder);
+                iSection->second.erase(iDelete);
+                bDeleted = true;
+            }
+        }
+        while (iKeyVal != iSection->second.end()
+            && !IsLess(a_pKey, iKeyVal->first.pItem));
 
-            if (!IsLess(pDataLine, a_pTagName) && !IsLess(a_pTagName, pDataLine)) {
-                break;
+        if (m_bHashIndex) {
+            typename TKeyVal::iterator iFirst = iSection->second.find(a_pKey);
+            if (iFirst != iSection->second.end()) {
+                IndexInsert(iSection, iFirst, true);
             }
+        }
 
-            *pc = ch;
+        if(!bDeleted) {
+            return false;
         }
 
-        // if we are at the end of the data then we just automatically end
-        // this entry and return the current data.
-        if (!cEndOfLineChar) {
+        // done now if the section is not empty or we are not pruning away
+        // the empty sections. Otherwise let it fall through into the section
+        // deletion code
+        if (!a_bRemoveEmpty || !iSection->second.empty()) {
             return true;
         }
-
-        // otherwise we need to process this newline to ensure that it consists
-        // of just a single \n character.
-        pDataLine += (a_pData - pCurrLine);
-        *a_pData = cEndOfLineChar;
-        SkipNewLine(a_pData);
-        *pDataLine++ = '\n';
     }
-
-    // if we didn't find a comment at all then return false
-    if (a_pVal == a_pData) {
-        a_pVal = NULL;
-        return false;
+    else {
+        // delete all copied strings from this section. The actual
+        // entries will be removed when the section is removed.
+        typename TKeyVal::iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            RecordChange(iSection->first.pItem, iKeyVal->first.pItem);
+            DeleteString(iKeyVal->first.pItem);
+            DeleteString(iKeyVal->second);
+            OrderUnlink(iKeyVal->first.nOrder);
+        }
     }
 
-    // the data (which ends at the end of the last line) needs to be
-    // null-terminated BEFORE before the newline character(s). If the
-    // user wants a new line in the multi-line data then they need to
-    // add an empty line before the tag.
-    *--pDataLine = '\0';
-
-    // if looking for a tag and if we aren't at the end of the data,
-    // then move a_pData to the start of the next line.
-    if (a_pTagName && cEndOfLineChar) {
-        SI_ASSERT(IsNewLineChar(cEndOfLineChar));
-        *a_pData = cEndOfLineChar;
-        SkipNewLine(a_pData);
+    // remove the section and all of its keys from the index
+    if (m_bHashIndex) {
+        typename TKeyVal::iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            IndexErase(a_pSection, iKeyVal->first.pItem);
+        }
+        IndexErase(a_pSection, NULL);
     }
 
+    // delete the section itself
+    RecordChange(iSection->first.pItem, NULL);
+    DeleteString(iSection->first.pItem);
+    OrderUnlink(iSection->first.nOrder);
+    m_data.erase(iSection);
+
     return true;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CopyString(
-    const SI_CHAR *& a_pString
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ApplyBatch(
+    const BatchOp * a_pOps,
+    size_t          a_uCount,
+    bool            a_bForceReplace
     )
 {
-    size_t uLen = 0;
-    if (sizeof(SI_CHAR) == sizeof(char)) {
-        uLen = strlen((const char *)a_pString);
+    if (m_bFrozen) {
+        return SI_FAIL;
     }
-    else if (sizeof(SI_CHAR) == sizeof(wchar_t)) {
-        uLen = wcslen((const wchar_t *)a_pString);
+    ChangeScope oScope(*this);
+
+    size_t uStrings = 0;
+    size_t uEntries = 0;
+    for (size_t n = 0; n < a_uCount; ++n) {
+        const BatchOp & op = a_pOps[n];
+        if (!op.pSection) {
+            return SI_FAIL;
+        }
+        if (!op.bDelete) {
+            uStrings += BatchStrings(op.pSection, op.pKey, op.pValue, a_bForceReplace, uEntries);
+        }
     }
-    else {
-        for ( ; a_pString[uLen]; ++uLen) /*loop*/ ;
+    SI_Error rc = ReserveStrings(uStrings);
+    if (rc < 0) {
+        return rc;
     }
-    ++uLen; // NULL character
-    SI_CHAR * pCopy = new(std::nothrow) SI_CHAR[uLen];
-    if (!pCopy) {
-        return SI_NOMEM;
+    if (m_bHashIndex) {
+        IndexReserve(m_uIndexCount + uEntries);
     }
-    memcpy(pCopy, a_pString, sizeof(SI_CHAR)*uLen);
-    m_strings.push_back(pCopy);
-    a_pString = pCopy;
-    return SI_OK;
+
+    // the table's nodes are allocated as the changes are made
+    m_bInBatch = true;
+    try {
+        for (size_t n = 0; rc >= 0 && n < a_uCount; ++n) {
+            const BatchOp & op = a_pOps[n];
+            if (op.bDelete) {
+                DeleteValue(op.pSection, op.pKey, NULL, false);
+            }
+            else {
+                rc = AddEntry(op.pSection, op.pKey, op.pValue, NULL, a_bForceReplace, true);
+            }
+        }
+    }
+    catch (...) {
+        rc = SI_NOMEM;
+    }
+    m_bInBatch = false;
+
+    if (m_order.size() > 64 && m_uOrderUsed < m_order.size() / 2) {
+        CompactOrder();
+    }
+    return rc < 0 ? rc : SI_OK;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AddEntry(
+size_t
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::BatchStrings(
     const SI_CHAR * a_pSection,
     const SI_CHAR * a_pKey,
     const SI_CHAR * a_pValue,
-    const SI_CHAR * a_pComment,
     bool            a_bForceReplace,
-    bool            a_bCopyStrings
+    size_t &        a_uEntries
+    ) const
+{
+    // the section, key and value of the change and the comment that a
+    // replaced multi-key keeps
+    auto length = [](const SI_CHAR * a_pString) -> size_t {
+        size_t uLen = 0;
+        while (a_pString[uLen]) ++uLen;
+        return SI_STRING_HEADER + uLen + 1;
+    };
+    size_t uStrings = length(a_pSection);
+    ++a_uEntries;
+    if (!a_pKey) {
+        return uStrings;
+    }
+    uStrings += length(a_pKey);
+    uStrings += length(a_pValue ? a_pValue : &m_cEmptyString);
+    ++a_uEntries;
+    if (m_bAllowMultiKey && a_bForceReplace) {
+        (void) ParseLazySection(a_pSection);
+        typename TSection::const_iterator iSection;
+        typename TKeyVal::const_iterator iKeyVal;
+        if (FindKey(a_pSection, a_pKey, iSection, iKeyVal) && iKeyVal->first.pComment) {
+            uStrings += length(iKeyVal->first.pComment);
+        }
+    }
+    return uStrings;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TValueView
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::KeyValues(
+    const NameIterator & a_iKey
+    ) const
+{
+    // the values of a key are next to each other in either table, and end
+    // where the iterator moves on to the next key
+    NameIterator iNext = a_iKey;
+    ++iNext;
+    if (a_iKey.m_bFrozen) {
+        return TValueView(ValueIterator(m_frozenKeys.data() + a_iKey.m_uFrozen),
+            ValueIterator(m_frozenKeys.data() + iNext.m_uFrozen));
+    }
+    return TValueView(ValueIterator(a_iKey.m_iKey), ValueIterator(iNext.m_iKey));
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::DiffKey(
+    const SI_CHAR *     a_pSection,
+    const SI_CHAR *     a_pKey,
+    const TValueView *  a_pOldValues,
+    const TValueView *  a_pNewValues,
+    TDiff &             a_diff
     )
 {
-    SI_Error rc;
-    bool bInserted = false;
+    // values are compared exactly, a change of case is a change
+    auto isSame = [](const SI_CHAR * a_pLeft, const SI_CHAR * a_pRight) {
+        while (*a_pLeft && *a_pLeft == *a_pRight) {
+            ++a_pLeft;
+            ++a_pRight;
+        }
+        return *a_pLeft == *a_pRight;
+    };
 
-    SI_ASSERT(!a_pComment || IsComment(*a_pComment));
+    if (a_pOldValues && a_pNewValues) {
+        const TValueView & oldValues = *a_pOldValues;
+        const TValueView & newValues = *a_pNewValues;
+        ValueIterator iOld = oldValues.begin();
+        ValueIterator iNew = newValues.begin();
+        bool bFirst = true;
+        while (iOld != oldValues.end() && iNew != newValues.end()
+            && isSame((*iOld).pItem, (*iNew).pItem))
+        {
+            ++iOld;
+            ++iNew;
+            bFirst = false;
+        }
+        if (iOld == oldValues.end() && iNew == newValues.end()) {
+            return;
+        }
 
-    // if we are copying strings then make a copy of the comment now
-    // because we will need it when we add the entry.
-    if (a_bCopyStrings && a_pComment) {
-        rc = CopyString(a_pComment);
-        if (rc < 0) return rc;
+        // a single value is changed in place so that it keeps its position
+        if (bFirst && std::next(iOld) == oldValues.end() && std::next(iNew) == newValues.end()) {
+            DiffEntry oEntry = { SI_DIFF_CHANGED, a_pSection, a_pKey, (*iOld).pItem, (*iNew).pItem };
+            a_diff.push_back(oEntry);
+            return;
+        }
     }
 
-    // create the section entry if necessary
-    typename TSection::iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        // if the section doesn't exist then we need a copy as the
-        // string needs to last beyond the end of this function
-        if (a_bCopyStrings) {
-            rc = CopyString(a_pSection);
-            if (rc < 0) return rc;
+    if (a_pOldValues) {
+        for (ValueIterator iOld = a_pOldValues->begin(); iOld != a_pOldValues->end(); ++iOld) {
+            DiffEntry oEntry = { SI_DIFF_REMOVED, a_pSection, a_pKey, (*iOld).pItem, NULL };
+            a_diff.push_back(oEntry);
         }
-
-        // only set the comment if this is a section only entry
-        Entry oSection(a_pSection, ++m_nOrder);
-        if (a_pComment && !a_pKey) {
-            oSection.pComment = a_pComment;
+    }
+    if (a_pNewValues) {
+        for (ValueIterator iNew = a_pNewValues->begin(); iNew != a_pNewValues->end(); ++iNew) {
+            DiffEntry oEntry = { SI_DIFF_ADDED, a_pSection, a_pKey, NULL, (*iNew).pItem };
+            a_diff.push_back(oEntry);
         }
+    }
+}
 
-        typename TSection::value_type oEntry(oSection, TKeyVal());
-        typedef typename TSection::iterator SectionIterator;
-        std::pair<SectionIterator,bool> i = m_data.insert(oEntry);
-        iSection = i.first;
-        bInserted = true;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Diff(
+    const CSimpleIniTempl & a_other,
+    TDiff &                 a_diff
+    ) const
+{
+    SI_Error rc = ParseLazySections();
+    if (rc < 0) {
+        return rc;
     }
-    if (!a_pKey) {
-        // section only entries are specified with pItem as NULL
-        return bInserted ? SI_INSERTED : SI_UPDATED;
+    rc = a_other.ParseLazySections();
+    if (rc < 0) {
+        return rc;
     }
 
-    // check for existence of the key
-    TKeyVal & keyval = iSection->second;
-    typename TKeyVal::iterator iKey = keyval.find(a_pKey);
-    bInserted = iKey == keyval.end();
+    // -1 when only the old data has the name, 1 when only the new data does
+    auto compare = [this](const NameIterator & a_iOld, const NameIterator & a_iOldEnd,
+        const NameIterator & a_iNew, const NameIterator & a_iNewEnd) -> int
+    {
+        if (a_iOld == a_iOldEnd) return 1;
+        if (a_iNew == a_iNewEnd) return -1;
+        if (IsLess(a_iOld->pItem, a_iNew->pItem)) return -1;
+        return IsLess(a_iNew->pItem, a_iOld->pItem) ? 1 : 0;
+    };
 
-    // remove all existing entries but save the load order and
-    // comment of the first entry
-    int nLoadOrder = ++m_nOrder;
-    if (iKey != keyval.end() && m_bAllowMultiKey && a_bForceReplace) {
-        const SI_CHAR * pComment = NULL;
-        while (iKey != keyval.end() && !IsLess(a_pKey, iKey->first.pItem)) {
-            if (iKey->first.nOrder < nLoadOrder) {
-                nLoadOrder = iKey->first.nOrder;
-                pComment   = iKey->first.pComment;
+    try {
+        TNameView oldSections = Sections();
+        TNameView newSections = a_other.Sections();
+        NameIterator iOldSection = oldSections.begin();
+        NameIterator iNewSection = newSections.begin();
+        while (iOldSection != oldSections.end() || iNewSection != newSections.end()) {
+            int nSection = compare(iOldSection, oldSections.end(), iNewSection, newSections.end());
+            const SI_CHAR * pSection = nSection > 0 ? iNewSection->pItem : iOldSection->pItem;
+            if (nSection > 0) {
+                DiffEntry oEntry = { SI_DIFF_ADDED, pSection, NULL, NULL, NULL };
+                a_diff.push_back(oEntry);
             }
-            ++iKey;
+
+            // a section on one side only is walked against no keys
+            TNameView oldKeys, newKeys;
+            if (nSection <= 0) oldKeys = Keys(iOldSection->pItem);
+            if (nSection >= 0) newKeys = a_other.Keys(iNewSection->pItem);
+            NameIterator iOldKey = oldKeys.begin();
+            NameIterator iNewKey = newKeys.begin();
+            while ((nSection <= 0 && iOldKey != oldKeys.end())
+                || (nSection >= 0 && iNewKey != newKeys.end()))
+            {
+                int nKey = nSection != 0 ? nSection
+                    : compare(iOldKey, oldKeys.end(), iNewKey, newKeys.end());
+                TValueView oldValues, newValues;
+                if (nKey <= 0) oldValues = KeyValues(iOldKey);
+                if (nKey >= 0) newValues = a_other.KeyValues(iNewKey);
+                DiffKey(pSection, nKey > 0 ? iNewKey->pItem : iOldKey->pItem,
+                    nKey <= 0 ? &oldValues : NULL, nKey >= 0 ? &newValues : NULL, a_diff);
+                if (nKey <= 0) ++iOldKey;
+                if (nKey >= 0) ++iNewKey;
+            }
+
+            if (nSection < 0) {
+                DiffEntry oEntry = { SI_DIFF_REMOVED, pSection, NULL, NULL, NULL };
+                a_diff.push_back(oEntry);
+            }
+            if (nSection <= 0) ++iOldSection;
+            if (nSection >= 0) ++iNewSection;
         }
-        if (pComment) {
-            DeleteString(a_pComment);
-            a_pComment = pComment;
-            rc = CopyString(a_pComment);
-            if (rc < 0) return rc;
+    }
+    catch (...) {
+        return SI_NOMEM;
+    }
+    return SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::ApplyDiff(
+    const DiffEntry *   a_pDiff,
+    size_t              a_uCount
+    )
+{
+    if (m_bFrozen) {
+        return SI_FAIL;
+    }
+    ChangeScope oScope(*this);
+
+    size_t uStrings = 0;
+    size_t uEntries = 0;
+    for (size_t n = 0; n < a_uCount; ++n) {
+        const DiffEntry & entry = a_pDiff[n];
+        if (!entry.pSection) {
+            return SI_FAIL;
         }
-        Delete(a_pSection, a_pKey);
-        iKey = keyval.end();
+        if (entry.eType != SI_DIFF_REMOVED) {
+            uStrings += BatchStrings(entry.pSection, entry.pKey, entry.pNewValue,
+                entry.eType == SI_DIFF_CHANGED, uEntries);
+        }
+    }
+    SI_Error rc = ReserveStrings(uStrings);
+    if (rc < 0) {
+        return rc;
+    }
+    if (m_bHashIndex) {
+        IndexReserve(m_uIndexCount + uEntries);
     }
 
-    // values need to be a valid string, even if they are an empty string
-    if (!a_pValue) {
-        a_pValue = &m_cEmptyString;
+    // every old value of a multi-key is removed before the new ones are
+    // added, so removing a value removes all copies of it. The table's nodes
+    // are allocated as the changes are made.
+    m_bInBatch = true;
+    try {
+        for (size_t n = 0; rc >= 0 && n < a_uCount; ++n) {
+            const DiffEntry & entry = a_pDiff[n];
+            if (entry.eType == SI_DIFF_REMOVED) {
+                DeleteValue(entry.pSection, entry.pKey, entry.pOldValue, false);
+            }
+            else {
+                rc = AddEntry(entry.pSection, entry.pKey, entry.pNewValue, NULL,
+                    entry.eType == SI_DIFF_CHANGED, true);
+            }
+        }
+    }
+    catch (...) {
+        rc = SI_NOMEM;
     }
+    m_bInBatch = false;
 
-    // make string copies if necessary
-    bool bForceCreateNewKey = m_bAllowMultiKey && !a_bForceReplace;
-    if (a_bCopyStrings) {
-        if (bForceCreateNewKey || iKey == keyval.end()) {
-            // if the key doesn't exist then we need a copy as the
-            // string needs to last beyond the end of this function
-            // because we will be inserting the key next
-            rc = CopyString(a_pKey);
-            if (rc < 0) return rc;
+    if (m_order.size() > 64 && m_uOrderUsed < m_order.size() / 2) {
+        CompactOrder();
+    }
+    return rc < 0 ? rc : SI_OK;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+unsigned
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Subscribe(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey,
+    ChangeCallback  a_fnCallback,
+    bool            a_bPrefix
+    )
+{
+    Subscription oSub;
+    oSub.uId = ++m_uLastSubscription;
+    oSub.bAnySection = !a_pSection;
+    oSub.bAnyKey = !a_pKey;
+    oSub.bPrefix = a_bPrefix;
+    if (a_pSection) oSub.section = a_pSection;
+    if (a_pKey) oSub.key = a_pKey;
+    oSub.fnCallback = a_fnCallback;
+    m_subscriptions.push_back(oSub);
+    return oSub.uId;
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Unsubscribe(
+    unsigned a_uId
+    )
+{
+    for (size_t n = 0; n < m_subscriptions.size(); ++n) {
+        if (m_subscriptions[n].uId == a_uId) {
+            m_subscriptions.erase(m_subscriptions.begin() + n);
+            return;
         }
+    }
+}
 
-        // we always need a copy of the value
-        rc = CopyString(a_pValue);
-        if (rc < 0) return rc;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsPrefix(
+    const SI_CHAR * a_pName,
+    const SI_CHAR * a_pPrefix
+    ) const
+{
+    // SI_STRLESS may ignore case, so the start of the name is compared
+    // with it rather than character by character
+    size_t uLen = 0;
+    while (a_pPrefix[uLen]) {
+        if (!a_pName[uLen]) {
+            return false;
+        }
+        ++uLen;
     }
+    TString start(a_pName, uLen);
+    return !IsLess(start.c_str(), a_pPrefix) && !IsLess(a_pPrefix, start.c_str());
+}
 
-    // create the key entry
-    if (iKey == keyval.end() || bForceCreateNewKey) {
-        Entry oKey(a_pKey, nLoadOrder);
-        if (a_pComment) {
-            oKey.pComment = a_pComment;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IsSubscribed(
+    const Subscription &    a_oSub,
+    const SI_CHAR *         a_pSection,
+    const SI_CHAR *         a_pKey
+    ) const
+{
+    // the prefix applies to the key, or to the section if there is no key
+    if (!a_oSub.bAnySection) {
+        const SI_CHAR * pSection = a_oSub.section.c_str();
+        if (a_oSub.bPrefix && a_oSub.bAnyKey) {
+            if (!IsPrefix(a_pSection, pSection)) return false;
+        }
+        else if (IsLess(a_pSection, pSection) || IsLess(pSection, a_pSection)) {
+            return false;
+        }
+    }
+    if (a_oSub.bAnyKey) {
+        return true;
+    }
+    if (!a_pKey) {
+        return false;
+    }
+    const SI_CHAR * pKey = a_oSub.key.c_str();
+    if (a_oSub.bPrefix) {
+        return IsPrefix(a_pKey, pKey);
+    }
+    return !IsLess(a_pKey, pKey) && !IsLess(pKey, a_pKey);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::RecordChange(
+    const SI_CHAR * a_pSection,
+    const SI_CHAR * a_pKey
+    )
+{
+    if (m_subscriptions.empty() || m_bParsingLazy) {
+        return;
+    }
+    for (size_t n = 0; n < m_subscriptions.size(); ++n) {
+        if (IsSubscribed(m_subscriptions[n], a_pSection, a_pKey)) {
+            Change oChange;
+            oChange.section = a_pSection;
+            if (a_pKey) oChange.key = a_pKey;
+            oChange.bKey = a_pKey != NULL;
+            m_changes.push_back(oChange);
+            return;
         }
-        typename TKeyVal::value_type oEntry(oKey, static_cast<const SI_CHAR *>(NULL));
-        iKey = keyval.insert(oEntry);
     }
-
-    iKey->second = a_pValue;
-    return bInserted ? SI_INSERTED : SI_UPDATED;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-const SI_CHAR *
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    const SI_CHAR * a_pDefault,
-    bool *          a_pHasMultiple
-    ) const
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::NotifyChanges()
 {
-    if (a_pHasMultiple) {
-        *a_pHasMultiple = false;
-    }
-    if (!a_pSection || !a_pKey) {
-        return a_pDefault;
+    if (m_changes.empty()) {
+        return;
     }
-    typename TSection::const_iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        return a_pDefault;
+    std::vector<Change> changes;
+    changes.swap(m_changes);
+
+    // report each key once, in the order that it first changed
+    std::vector<size_t> sorted(changes.size());
+    for (size_t n = 0; n < sorted.size(); ++n) {
+        sorted[n] = n;
     }
-    typename TKeyVal::const_iterator iKeyVal = iSection->second.find(a_pKey);
-    if (iKeyVal == iSection->second.end()) {
-        return a_pDefault;
+    auto isLess = [&](size_t a_uLeft, size_t a_uRight) -> bool {
+        const Change & lhs = changes[a_uLeft];
+        const Change & rhs = changes[a_uRight];
+        if (lhs.bKey != rhs.bKey) return rhs.bKey;
+        if (IsLess(lhs.section.c_str(), rhs.section.c_str())) return true;
+        if (IsLess(rhs.section.c_str(), lhs.section.c_str())) return false;
+        return IsLess(lhs.key.c_str(), rhs.key.c_str());
+    };
+    std::stable_sort(sorted.begin(), sorted.end(), isLess);
+    std::vector<bool> repeated(changes.size(), false);
+    for (size_t n = 1; n < sorted.size(); ++n) {
+        if (!isLess(sorted[n - 1], sorted[n])) {
+            repeated[sorted[n]] = true;
+        }
     }
 
-    // check for multiple entries with the same key
-    if (m_bAllowMultiKey && a_pHasMultiple) {
-        typename TKeyVal::const_iterator iTemp = iKeyVal;
-        if (++iTemp != iSection->second.end()) {
-            if (!IsLess(a_pKey, iTemp->first.pItem)) {
-                *a_pHasMultiple = true;
+    // a callback may unsubscribe any subscription, so each one is found
+    // again before it is called
+    for (size_t n = 0; n < changes.size(); ++n) {
+        if (repeated[n]) {
+            continue;
+        }
+        const Change & oChange = changes[n];
+        const SI_CHAR * pKey = oChange.bKey ? oChange.key.c_str() : NULL;
+        unsigned uLastId = 0;
+        for (;;) {
+            size_t m = 0;
+            while (m < m_subscriptions.size() && m_subscriptions[m].uId <= uLastId) {
+                ++m;
+            }
+            if (m == m_subscriptions.size()) {
+                break;
+            }
+            uLastId = m_subscriptions[m].uId;
+            if (IsSubscribed(m_subscriptions[m], oChange.section.c_str(), pKey)) {
+                ChangeCallback fnCallback(m_subscriptions[m].fnCallback);
+                fnCallback(oChange.section.c_str(), pKey);
             }
         }
     }
-
-    return iKeyVal->second;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-long
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetLongValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    long            a_nDefault,
-    bool *          a_pHasMultiple
-    ) const
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::DeleteString(
+    const SI_CHAR * a_pString
+    )
 {
-    // return the default if we don't have a value
-    const SI_CHAR * pszValue = GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple);
-    if (!pszValue || !*pszValue) return a_nDefault;
-
-    // convert to UTF-8/MBCS which for a numeric value will be the same as ASCII
-    char szValue[64] = { 0 };
-    SI_CONVERTER c(m_bStoreIsUtf8);
-    if (!c.ConvertToStore(pszValue, szValue, sizeof(szValue))) {
-        return a_nDefault;
+    if (m_bTypedCache) {
+        m_typedCache.erase(a_pString);
     }
 
-    // handle the value as hex if prefaced with "0x"
-    long nValue = a_nDefault;
-    char * pszSuffix = szValue;
-    if (szValue[0] == '0' && (szValue[1] == 'x' || szValue[1] == 'X')) {
-        if (!szValue[2]) return a_nDefault;
-        nValue = strtol(&szValue[2], &pszSuffix, 16);
-    }
-    else {
-        nValue = strtol(szValue, &pszSuffix, 10);
+    // strings may exist either inside the data block, or they will be
+    // allocated from the blocks in m_strings. We only free those stored in
+    // m_strings, their space is put on the free list for reuse.
+    if (!IsCopiedString(a_pString)) {
+        return;
     }
 
-    // any invalid strings will return the default value
-    if (*pszSuffix) { 
-        return a_nDefault; 
+    unsigned int uCapacity;
+    memcpy(&uCapacity, a_pString - SI_STRING_HEADER, sizeof(uCapacity));
+    int nClass = 0;
+    while (nClass + 1 < SI_STRING_CLASSES && ((size_t) 2 << nClass) <= uCapacity) {
+        ++nClass;
     }
-
-    return nValue;
+    m_freeStrings[nClass].push_back(const_cast<SI_CHAR *>(a_pString));
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error 
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetLongValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    long            a_nValue,
-    const SI_CHAR * a_pComment,
-    bool            a_bUseHex,
-    bool            a_bForceReplace
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TSection::iterator
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindSection(
+    const SI_CHAR * a_pSection
     )
 {
-    // use SetValue to create sections
-    if (!a_pSection || !a_pKey) return SI_FAIL;
+    if (!m_bHashIndex) {
+        return m_data.find(a_pSection);
+    }
+    size_t uSlot = FindIndexSlot(a_pSection, NULL);
+    return uSlot == (size_t) -1 ? m_data.end() : m_index[uSlot].iSection;
+}
 
-    // convert to an ASCII string
-    char szInput[64];
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    sprintf_s(szInput, a_bUseHex ? "0x%lx" : "%ld", a_nValue);
-#else // !__STDC_WANT_SECURE_LIB__
-    snprintf(szInput, sizeof(szInput), a_bUseHex ? "0x%lx" : "%ld", a_nValue);
-#endif // __STDC_WANT_SECURE_LIB__
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindKey(
+    const SI_CHAR *                     a_pSection,
+    const SI_CHAR *                     a_pKey,
+    typename TSection::const_iterator & a_iSection,
+    typename TKeyVal::const_iterator &  a_iKey
+    ) const
+{
+    if (!a_pSection || !a_pKey) {
+        return false;
+    }
 
-    // convert to output text
-    SI_CHAR szOutput[64];
-    SI_CONVERTER c(m_bStoreIsUtf8);
-    c.ConvertFromStore(szInput, strlen(szInput) + 1, 
-        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
+    if (m_bHashIndex) {
+        size_t uSlot = FindIndexSlot(a_pSection, a_pKey);
+        if (uSlot == (size_t) -1) {
+            return false;
+        }
+        a_iSection = m_index[uSlot].iSection;
+        a_iKey = m_index[uSlot].iKey;
+        return true;
+    }
 
-    // actually add it
-    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+    a_iSection = m_data.find(a_pSection);
+    if (a_iSection == m_data.end()) {
+        return false;
+    }
+    a_iKey = a_iSection->second.find(a_pKey);
+    return a_iKey != a_iSection->second.end();
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-double
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetDoubleValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    double          a_nDefault,
-    bool *          a_pHasMultiple
+size_t
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindIndexSlot(
+    const SI_CHAR *     a_pSection,
+    const SI_CHAR *     a_pKey,
+    unsigned long long  a_uHash
     ) const
 {
-    // return the default if we don't have a value
-    const SI_CHAR * pszValue = GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple);
-    if (!pszValue || !*pszValue) return a_nDefault;
+    if (m_index.empty()) {
+        return (size_t) -1;
+    }
 
-    // convert to UTF-8/MBCS which for a numeric value will be the same as ASCII
-    char szValue[64] = { 0 };
-    SI_CONVERTER c(m_bStoreIsUtf8);
-    if (!c.ConvertToStore(pszValue, szValue, sizeof(szValue))) {
-        return a_nDefault;
+    size_t uMask = m_index.size() - 1;
+    for (size_t uSlot = (size_t) a_uHash & uMask; m_index[uSlot].uHash; uSlot = (uSlot + 1) & uMask) {
+        const IndexSlot & slot = m_index[uSlot];
+        if (slot.uHash != a_uHash || slot.bKey != (a_pKey != NULL)) {
+            continue;
+        }
+        const SI_CHAR * pSection = slot.iSection->first.pItem;
+        if (IsLess(a_pSection, pSection) || IsLess(pSection, a_pSection)) {
+            continue;
+        }
+        if (a_pKey) {
+            const SI_CHAR * pKey = slot.iKey->first.pItem;
+            if (IsLess(a_pKey, pKey) || IsLess(pKey, a_pKey)) {
+                continue;
+            }
+        }
+        return uSlot;
     }
+    return (size_t) -1;
+}
 
-    char * pszSuffix = szValue;
-    double nValue = strtod(szValue, &pszSuffix);
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IndexInsert(
+    typename TSection::iterator a_iSection,
+    typename TKeyVal::iterator  a_iKey,
+    bool                        a_bKey
+    )
+{
+    IndexReserve(m_uIndexCount + 1);
+
+    IndexSlot slot;
+    slot.uHash = HashName(a_iSection->first.pItem, a_bKey ? a_iKey->first.pItem : NULL);
+    slot.iSection = a_iSection;
+    slot.iKey = a_iKey;
+    slot.bKey = a_bKey;
+
+    size_t uMask = m_index.size() - 1;
+    size_t uSlot = (size_t) slot.uHash & uMask;
+    while (m_index[uSlot].uHash) {
+        uSlot = (uSlot + 1) & uMask;
+    }
+    m_index[uSlot] = slot;
+    ++m_uIndexCount;
+}
 
-    // any invalid strings will return the default value
-    // check if no conversion was performed or if there are trailing characters
-    if (pszSuffix == szValue || *pszSuffix) {
-        return a_nDefault;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IndexReserve(
+    size_t a_uCount
+    )
+{
+    // keep the load factor at or below 1/2
+    if (a_uCount * 2 <= m_index.size()) {
+        return;
+    }
+    size_t uSize = m_index.empty() ? 64 : m_index.size() * 2;
+    while (uSize < a_uCount * 2) {
+        uSize *= 2;
     }
 
-    return nValue;
+    std::vector<IndexSlot> oldIndex;
+    oldIndex.swap(m_index);
+    IndexSlot empty = IndexSlot();
+    m_index.assign(uSize, empty);
+    m_uIndexCount = 0;
+    for (size_t n = 0; n < oldIndex.size(); ++n) {
+        if (oldIndex[n].uHash) {
+            IndexInsert(oldIndex[n].iSection, oldIndex[n].iKey, oldIndex[n].bKey);
+        }
+    }
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error 
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetDoubleValue(
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::IndexErase(
     const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    double          a_nValue,
-    const SI_CHAR * a_pComment,
-    bool            a_bForceReplace
+    const SI_CHAR * a_pKey
     )
 {
-    // use SetValue to create sections
-    if (!a_pSection || !a_pKey) return SI_FAIL;
-
-    // convert to an ASCII string
-    char szInput[64];
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    sprintf_s(szInput, "%f", a_nValue);
-#else // !__STDC_WANT_SECURE_LIB__
-    snprintf(szInput, sizeof(szInput), "%f", a_nValue);
-#endif // __STDC_WANT_SECURE_LIB__
-
-    // convert to output text
-    SI_CHAR szOutput[64];
-    SI_CONVERTER c(m_bStoreIsUtf8);
-    c.ConvertFromStore(szInput, strlen(szInput) + 1, 
-        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
+    size_t uSlot = FindIndexSlot(a_pSection, a_pKey);
+    if (uSlot == (size_t) -1) {
+        return;
+    }
 
-    // actually add it
-    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+    // shift following entries of the probe sequence back into the hole so
+    // that no tombstones are needed
+    size_t uMask = m_index.size() - 1;
+    size_t uNext = uSlot;
+    for (;;) {
+        m_index[uSlot].uHash = 0;
+        for (;;) {
+            uNext = (uNext + 1) & uMask;
+            if (!m_index[uNext].uHash) {
+                --m_uIndexCount;
+                return;
+            }
+            size_t uHome = (size_t) m_index[uNext].uHash & uMask;
+            bool bMove = (uSlot <= uNext)
+                ? (uHome <= uSlot || uHome > uNext)
+                : (uHome <= uSlot && uHome > uNext);
+            if (bMove) {
+                break;
+            }
+        }
+        m_index[uSlot] = m_index[uNext];
+        uSlot = uNext;
+    }
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetBoolValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    bool            a_bDefault,
-    bool *          a_pHasMultiple
-    ) const
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::RebuildIndex()
 {
-    // return the default if we don't have a value
-    const SI_CHAR * pszValue = GetValue(a_pSection, a_pKey, NULL, a_pHasMultiple);
-    if (!pszValue || !*pszValue) return a_bDefault;
-
-    // we only look at the minimum number of characters
-    switch (pszValue[0]) {
-    case 't': case 'T': // true
-    case 'y': case 'Y': // yes
-    case '1':           // 1 (one)
-        return true;
+    m_index.clear();
+    m_uIndexCount = 0;
+    if (!m_bHashIndex) {
+        return;
+    }
 
-    case 'f': case 'F': // false
-    case 'n': case 'N': // no
-    case '0':           // 0 (zero)
-        return false;
+    typename TSection::iterator iSection = m_data.begin();
+    for ( ; iSection != m_data.end(); ++iSection) {
+        IndexInsert(iSection, typename TKeyVal::iterator(), false);
+        const SI_CHAR * pLastKey = NULL;
+        typename TKeyVal::iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            if (!pLastKey || IsLess(pLastKey, iKeyVal->first.pItem)) {
+                IndexInsert(iSection, iKeyVal, true);
+                pLastKey = iKeyVal->first.pItem;
+            }
+        }
+    }
+}
 
-    case 'o': case 'O':
-        if (pszValue[1] == 'n' || pszValue[1] == 'N') return true;  // on
-        if (pszValue[1] == 'f' || pszValue[1] == 'F') return false; // off
-        break;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OrderLink(
+    typename TSection::iterator a_iSection,
+    typename TKeyVal::iterator  a_iKey,
+    bool                        a_bKey
+    )
+{
+    int nOrder = a_bKey ? a_iKey->first.nOrder : a_iSection->first.nOrder;
+    if (m_order.size() <= (size_t) nOrder) {
+        m_order.resize((size_t) nOrder + 1);
+    }
+    OrderSlot & oSlot = m_order[nOrder];
+    oSlot.iSection = a_iSection;
+    oSlot.iKey     = a_iKey;
+    oSlot.bKey     = a_bKey;
+    oSlot.bUsed    = true;
+    oSlot.nParent  = a_bKey ? a_iSection->first.nOrder : 0;
+    ++m_uOrderUsed;
+
+    // entries are nearly always added at the end, only a replaced multi-key
+    // value goes back to the order of the entries that it replaces
+    OrderSlot & oParent = m_order[oSlot.nParent];
+    int nPrev = oParent.nLast;
+    while (nPrev > nOrder) {
+        nPrev = m_order[nPrev].nPrev;
     }
+    oSlot.nPrev = nPrev;
+    oSlot.nNext = nPrev ? m_order[nPrev].nNext : oParent.nFirst;
+    if (nPrev) m_order[nPrev].nNext = nOrder;
+    else oParent.nFirst = nOrder;
+    if (oSlot.nNext) m_order[oSlot.nNext].nPrev = nOrder;
+    else oParent.nLast = nOrder;
+}
 
-    // no recognized value, return the default
-    return a_bDefault;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OrderUnlink(
+    int a_nOrder
+    )
+{
+    OrderSlot & oSlot = m_order[a_nOrder];
+    OrderSlot & oParent = m_order[oSlot.nParent];
+    if (oSlot.nPrev) m_order[oSlot.nPrev].nNext = oSlot.nNext;
+    else oParent.nFirst = oSlot.nNext;
+    if (oSlot.nNext) m_order[oSlot.nNext].nPrev = oSlot.nPrev;
+    else oParent.nLast = oSlot.nPrev;
+    if (oSlot.uHandle) {
+        FreeHandle(oSlot.uHandle - 1);
+    }
+    oSlot = OrderSlot();
+    --m_uOrderUsed;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error 
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SetBoolValue(
+typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Handle
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetHandle(
     const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    bool            a_bValue,
-    const SI_CHAR * a_pComment,
-    bool            a_bForceReplace
+    const SI_CHAR * a_pKey
     )
 {
-    // use SetValue to create sections
-    if (!a_pSection || !a_pKey) return SI_FAIL;
-
-    // convert to an ASCII string
-    const char * pszInput = a_bValue ? "true" : "false";
+    if (!a_pSection || !a_pKey) {
+        return Handle();
+    }
+    (void) ParseLazySection(a_pSection);
+
+    // the slot is found from the value so that each value has one handle
+    unsigned * pHandle = NULL;
+    unsigned uFrozen = 0;
+    typename TSection::const_iterator iSection;
+    typename TKeyVal::const_iterator iKeyVal;
+    if (m_bFrozen) {
+        const FrozenSlot * pSlot = FindFrozen(a_pSection, a_pKey);
+        if (!pSlot) {
+            return Handle();
+        }
+        if (m_frozenHandles.empty()) {
+            m_frozenHandles.resize(m_frozenKeys.size(), 0);
+        }
+        uFrozen = pSlot->uKey;
+        pHandle = &m_frozenHandles[uFrozen];
+    }
+    else {
+        if (!FindKey(a_pSection, a_pKey, iSection, iKeyVal)) {
+            return Handle();
+        }
+        pHandle = &m_order[iKeyVal->first.nOrder].uHandle;
+    }
 
-    // convert to output text
-    SI_CHAR szOutput[64];
-    SI_CONVERTER c(m_bStoreIsUtf8);
-    c.ConvertFromStore(pszInput, strlen(pszInput) + 1, 
-        szOutput, sizeof(szOutput) / sizeof(SI_CHAR));
+    if (!*pHandle) {
+        unsigned uSlot = NewHandle();
+        m_handles[uSlot].iKey    = iKeyVal;
+        m_handles[uSlot].uFrozen = uFrozen;
+        *pHandle = uSlot + 1;
+    }
+    Handle hValue;
+    hValue.uSlot = *pHandle - 1;
+    hValue.uGeneration = m_handles[hValue.uSlot].uGeneration;
+    return hValue;
+}
 
-    // actually add it
-    return AddEntry(a_pSection, a_pKey, szOutput, a_pComment, a_bForceReplace, true);
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+unsigned
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::NewHandle()
+{
+    unsigned uSlot;
+    if (m_freeHandles.empty()) {
+        uSlot = (unsigned) m_handles.size();
+        m_handles.push_back(HandleSlot());
+    }
+    else {
+        uSlot = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+    m_handles[uSlot].bUsed = true;
+    return uSlot;
 }
-    
+
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllValues(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    TNamesDepend &  a_values
-    ) const
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FreeHandle(
+    unsigned a_uSlot
+    )
 {
-    a_values.clear();
+    HandleSlot & oSlot = m_handles[a_uSlot];
+    oSlot.iKey = typename TKeyVal::const_iterator();
+    oSlot.bUsed = false;
+    if (++oSlot.uGeneration == 0) {
+        oSlot.uGeneration = 1;
+    }
+    m_freeHandles.push_back(a_uSlot);
+}
 
-    if (!a_pSection || !a_pKey) {
-        return false;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FreeHandles()
+{
+    for (size_t n = 0; n < m_handles.size(); ++n) {
+        if (m_handles[n].bUsed) {
+            FreeHandle((unsigned) n);
+        }
     }
-    typename TSection::const_iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        return false;
+    for (size_t n = 0; n < m_order.size(); ++n) {
+        m_order[n].uHandle = 0;
     }
-    typename TKeyVal::const_iterator iKeyVal = iSection->second.find(a_pKey);
-    if (iKeyVal == iSection->second.end()) {
-        return false;
+    std::vector<unsigned>().swap(m_frozenHandles);
+}
+
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CompactOrder()
+{
+    // entries keep their relative order so the lists stay the same, only
+    // the numbers in them change
+    std::vector<int> remap(m_order.size(), 0);
+    int nOrder = 0;
+    for (size_t n = 1; n < m_order.size(); ++n) {
+        if (m_order[n].bUsed) {
+            remap[n] = ++nOrder;
+        }
     }
 
-    // insert all values for this key
-    a_values.push_back(Entry(iKeyVal->second, iKeyVal->first.pComment, iKeyVal->first.nOrder));
-    if (m_bAllowMultiKey) {
-        ++iKeyVal;
-        while (iKeyVal != iSection->second.end() && !IsLess(a_pKey, iKeyVal->first.pItem)) {
-            a_values.push_back(Entry(iKeyVal->second, iKeyVal->first.pComment, iKeyVal->first.nOrder));
-            ++iKeyVal;
+    // every slot moves down (or stays) so the slots can be moved in place
+    for (size_t n = 0; n < m_order.size(); ++n) {
+        if (n > 0 && !m_order[n].bUsed) {
+            continue;
+        }
+        OrderSlot oSlot = m_order[n];
+        oSlot.nParent = remap[oSlot.nParent];
+        oSlot.nPrev   = remap[oSlot.nPrev];
+        oSlot.nNext   = remap[oSlot.nNext];
+        oSlot.nFirst  = remap[oSlot.nFirst];
+        oSlot.nLast   = remap[oSlot.nLast];
+        if (n > 0) {
+            const Entry & entry = oSlot.bKey ? oSlot.iKey->first : oSlot.iSection->first;
+            entry.nOrder = remap[n];
         }
+        m_order[remap[n]] = oSlot;
     }
-
-    return true;
+    m_order.resize((size_t) nOrder + 1);
+    m_nOrder = nOrder;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-int
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetSectionSize(
-    const SI_CHAR * a_pSection
-    ) const
+void
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::RebuildOrder()
 {
-    if (!a_pSection) {
-        return -1;
+    FreeHandles();
+    m_order.clear();
+    m_uOrderUsed = 0;
+    m_nOrder = 0;
+
+    std::vector<OrderSlot> entries;
+    int nMax = 0;
+    typename TSection::iterator iSection = m_data.begin();
+    for ( ; iSection != m_data.end(); ++iSection) {
+        OrderSlot oSlot;
+        oSlot.iSection = iSection;
+        oSlot.bUsed = true;
+        entries.push_back(oSlot);
+        nMax = std::max(nMax, iSection->first.nOrder);
+        typename TKeyVal::iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            oSlot.iKey = iKeyVal;
+            oSlot.bKey = true;
+            entries.push_back(oSlot);
+            nMax = std::max(nMax, iKeyVal->first.nOrder);
+        }
     }
-
-    typename TSection::const_iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        return -1;
+    if (entries.empty()) {
+        return;
     }
-    const TKeyVal & section = iSection->second;
 
-    // if multi-key isn't permitted then the section size is
-    // the number of keys that we have.
-    if (!m_bAllowMultiKey || section.empty()) {
-        return (int) section.size();
+    // the stored orders are normally dense enough to place each entry at
+    // its order directly, otherwise (or if any order is repeated) they are
+    // sorted
+    auto orderOf = [](const OrderSlot & a_oSlot) -> int {
+        return a_oSlot.bKey ? a_oSlot.iKey->first.nOrder : a_oSlot.iSection->first.nOrder;
+    };
+    std::vector<OrderSlot> placed;
+    bool bPlaced = (size_t) nMax <= entries.size() * 2;
+    if (bPlaced) {
+        placed.resize((size_t) nMax + 1);
+        for (size_t n = 0; bPlaced && n < entries.size(); ++n) {
+            int nOrder = orderOf(entries[n]);
+            if (nOrder <= 0 || placed[nOrder].bUsed) {
+                bPlaced = false;
+            }
+            else {
+                placed[nOrder] = entries[n];
+            }
+        }
+    }
+    if (!bPlaced) {
+        std::stable_sort(entries.begin(), entries.end(),
+            [&](const OrderSlot & a, const OrderSlot & b) {
+                return orderOf(a) < orderOf(b);
+            });
+        placed.swap(entries);
     }
 
-    // otherwise we need to count them
-    int nCount = 0;
-    const SI_CHAR * pLastKey = NULL;
-    typename TKeyVal::const_iterator iKeyVal = section.begin();
-    for (; iKeyVal != section.end(); ++iKeyVal) {
-        if (!pLastKey || IsLess(pLastKey, iKeyVal->first.pItem)) {
-            ++nCount;
-            pLastKey = iKeyVal->first.pItem;
+    // renumber everything before linking so that the order of each section
+    // is known when its keys are linked
+    for (size_t n = 0; n < placed.size(); ++n) {
+        if (placed[n].bUsed) {
+            const Entry & entry = placed[n].bKey
+                ? placed[n].iKey->first : placed[n].iSection->first;
+            entry.nOrder = ++m_nOrder;
+        }
+    }
+    m_order.resize((size_t) m_nOrder + 1);
+    for (size_t n = 0; n < placed.size(); ++n) {
+        if (placed[n].bUsed) {
+            OrderLink(placed[n].iSection, placed[n].iKey, placed[n].bKey);
         }
     }
-    return nCount;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-const typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::TKeyVal *
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetSection(
-    const SI_CHAR * a_pSection
-    ) const
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CopyFrom(
+    const CSimpleIniTempl & a_oSource
+    )
 {
-    if (a_pSection) {
-        typename TSection::const_iterator i = m_data.find(a_pSection);
-        if (i != m_data.end()) {
-            return &(i->second);
-        }
+    if (&a_oSource == this) {
+        return SI_OK;
     }
-    return 0;
+
+    Reset();
+    CopySettings(a_oSource);
+
+    SI_Error rc = SI_OK;
+    if (a_oSource.m_pFileComment) {
+        m_pFileComment = a_oSource.m_pFileComment;
+        rc = CopyString(m_pFileComment);
+    }
+    if (rc >= 0) {
+        rc = AddEntries(a_oSource);
+    }
+
+    if (rc < 0) {
+        Reset();
+        return rc;
+    }
+    return SI_OK;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 void
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllSections(
-    TNamesDepend & a_names
-    ) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::CopySettings(
+    const CSimpleIniTempl & a_oSource
+    )
 {
-    a_names.clear();
-    typename TSection::const_iterator i = m_data.begin();
-    for (; i != m_data.end(); ++i) {
-        a_names.push_back(i->first);
-    }
+    m_bStoreIsUtf8    = a_oSource.m_bStoreIsUtf8;
+    m_bAllowMultiKey  = a_oSource.m_bAllowMultiKey;
+    m_bAllowMultiLine = a_oSource.m_bAllowMultiLine;
+    m_bSpaces         = a_oSource.m_bSpaces;
+    m_bParseQuotes    = a_oSource.m_bParseQuotes;
+    m_bAllowKeyOnly   = a_oSource.m_bAllowKeyOnly;
+    m_bMemoryMap      = a_oSource.m_bMemoryMap;
+    m_bStripComments  = a_oSource.m_bStripComments;
+    m_uLoadThreads    = a_oSource.m_uLoadThreads;
+    m_bTypedCache     = a_oSource.m_bTypedCache;
+    m_bHashIndex      = a_oSource.m_bHashIndex;
+    m_bLazyLoad       = a_oSource.m_bLazyLoad;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::GetAllKeys(
-    const SI_CHAR * a_pSection,
-    TNamesDepend &  a_names
-    ) const
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AddEntries(
+    const CSimpleIniTempl & a_oSource
+    )
 {
-    a_names.clear();
+    SI_Error rc = a_oSource.ParseLazySections();
+    if (rc >= 0 && a_oSource.m_bFrozen) {
+        rc = AddFrozen(a_oSource, true);
+    }
 
-    if (!a_pSection) {
-        return false;
+    // adding the entries in load order recreates the same order, with every
+    // value of a multi-key added as a new entry
+    const std::vector<OrderSlot> & order = a_oSource.m_order;
+    int nSection = order.empty() ? 0 : order[0].nFirst;
+    for ( ; rc >= 0 && nSection; nSection = order[nSection].nNext) {
+        const Entry & section = order[nSection].iSection->first;
+        rc = AddEntry(section.pItem, NULL, NULL, section.pComment, false, true);
+        int nKey = order[nSection].nFirst;
+        for ( ; rc >= 0 && nKey; nKey = order[nKey].nNext) {
+            typename TKeyVal::const_iterator iKey = order[nKey].iKey;
+            rc = AddEntry(section.pItem, iKey->first.pItem, iKey->second,
+                iKey->first.pComment, false, true);
+        }
     }
+    return rc < 0 ? rc : SI_OK;
+}
 
-    typename TSection::const_iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        return false;
+template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
+SI_Error
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Freeze()
+{
+    if (m_bFrozen) {
+        return SI_OK;
+    }
+    SI_Error rc = ParseLazySections();
+    if (rc < 0) {
+        return rc;
     }
 
-    const TKeyVal & section = iSection->second;
-    const SI_CHAR * pLastKey = NULL;
-    typename TKeyVal::const_iterator iKeyVal = section.begin();
-    for (; iKeyVal != section.end(); ++iKeyVal) {
-        if (!pLastKey || IsLess(pLastKey, iKeyVal->first.pItem)) {
-            a_names.push_back(iKeyVal->first);
-            pLastKey = iKeyVal->first.pItem;
+    // copy the table in its own order, so each value of a multi-key stays
+    // after the ones added before it
+    size_t uKeys = 0;
+    typename TSection::const_iterator iSection = m_data.begin();
+    for ( ; iSection != m_data.end(); ++iSection) {
+        uKeys += iSection->second.size();
+    }
+    if (m_data.size() + uKeys >= SI_FROZEN_DIRECT) {
+        return SI_FAIL;
+    }
+    m_frozenSections.reserve(m_data.size());
+    m_frozenKeys.reserve(uKeys);
+    for (iSection = m_data.begin(); iSection != m_data.end(); ++iSection) {
+        FrozenSection section = { iSection->first, (unsigned) m_frozenKeys.size(), 0 };
+        typename TKeyVal::const_iterator iKeyVal = iSection->second.begin();
+        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
+            FrozenKey key = { iKeyVal->first, iKeyVal->second };
+            m_frozenKeys.push_back(key);
         }
+        section.uEndKey = (unsigned) m_frozenKeys.size();
+        m_frozenSections.push_back(section);
     }
 
-    return true;
+    // the load order of the sections, then of the values of each section
+    const size_t uSections = m_frozenSections.size();
+    m_frozenOrder.resize(uSections + uKeys);
+    for (size_t n = 0; n < m_frozenOrder.size(); ++n) {
+        m_frozenOrder[n] = (unsigned) (n < uSections ? n : n - uSections);
+    }
+    std::sort(m_frozenOrder.begin(), m_frozenOrder.begin() + uSections,
+        [this](unsigned a_uLeft, unsigned a_uRight) {
+            return m_frozenSections[a_uLeft].section.nOrder
+                < m_frozenSections[a_uRight].section.nOrder;
+        });
+    for (size_t n = 0; n < uSections; ++n) {
+        const FrozenSection & section = m_frozenSections[n];
+        std::sort(m_frozenOrder.begin() + uSections + section.uFirstKey,
+            m_frozenOrder.begin() + uSections + section.uEndKey,
+            [this](unsigned a_uLeft, unsigned a_uRight) {
+                return m_frozenKeys[a_uLeft].key.nOrder
+                    < m_frozenKeys[a_uRight].key.nOrder;
+            });
+    }
+
+    if (!BuildFrozenHash()) {
+        std::vector<FrozenSection>().swap(m_frozenSections);
+        std::vector<FrozenKey>().swap(m_frozenKeys);
+        std::vector<unsigned>().swap(m_frozenOrder);
+        std::vector<unsigned>().swap(m_frozenSeeds);
+        std::vector<FrozenSlot>().swap(m_frozenSlots);
+        return SI_FAIL;
+    }
+
+    // the strings stay where they are, only the tables are released
+    FreeHandles();
+    m_bFrozen = true;
+    m_data.clear();
+    std::vector<IndexSlot>().swap(m_index);
+    m_uIndexCount = 0;
+    std::vector<OrderSlot>().swap(m_order);
+    m_uOrderUsed = 0;
+    return SI_OK;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
-    const char *    a_pszFile,
-    bool            a_bAddSignature
-    ) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Thaw()
 {
-    FILE * fp = NULL;
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    fopen_s(&fp, a_pszFile, "wb");
-#else // !__STDC_WANT_SECURE_LIB__
-    fp = fopen(a_pszFile, "wb");
-#endif // __STDC_WANT_SECURE_LIB__
-    if (!fp) return SI_FILE;
-    SI_Error rc = SaveFile(fp, a_bAddSignature);
-    fclose(fp);
-    return rc;
+    if (!m_bFrozen) {
+        return SI_OK;
+    }
+
+    FreeHandles();
+    m_bFrozen = false;
+    m_nOrder = 0;
+    SI_Error rc = AddFrozen(*this, false);
+    if (rc < 0) {
+        // put back the frozen data, which is still complete
+        m_data.clear();
+        RebuildIndex();
+        m_order.clear();
+        m_uOrderUsed = 0;
+        m_bFrozen = true;
+        return rc;
+    }
+    std::vector<FrozenSection>().swap(m_frozenSections);
+    std::vector<FrozenKey>().swap(m_frozenKeys);
+    std::vector<unsigned>().swap(m_frozenOrder);
+    std::vector<unsigned>().swap(m_frozenSeeds);
+    std::vector<FrozenSlot>().swap(m_frozenSlots);
+    return SI_OK;
 }
 
-#ifdef SI_HAS_WIDE_FILE
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
 SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
-    const SI_WCHAR_T *  a_pwszFile,
-    bool                a_bAddSignature
-    ) const
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::AddFrozen(
+    const CSimpleIniTempl & a_oSource,
+    bool                    a_bCopyStrings
+    )
 {
-#ifdef _WIN32
-    FILE * fp = NULL;
-#if __STDC_WANT_SECURE_LIB__ && !_WIN32_WCE
-    _wfopen_s(&fp, a_pwszFile, L"wb");
-#else // !__STDC_WANT_SECURE_LIB__
-    fp = _wfopen(a_pwszFile, L"wb");
-#endif // __STDC_WANT_SECURE_LIB__
-    if (!fp) return SI_FILE;
-    SI_Error rc = SaveFile(fp, a_bAddSignature);
-    fclose(fp);
+    const size_t uSections = a_oSource.m_frozenSections.size();
+    SI_Error rc = SI_OK;
+    for (size_t n = 0; rc >= 0 && n < uSections; ++n) {
+        const FrozenSection & section = a_oSource.m_frozenSections[a_oSource.m_frozenOrder[n]];
+        rc = AddEntry(section.section.pItem, NULL, NULL, section.section.pComment,
+            false, a_bCopyStrings);
+        for (size_t uPos = section.uFirstKey; rc >= 0 && uPos < section.uEndKey; ++uPos) {
+            const FrozenKey & key = a_oSource.m_frozenKeys[a_oSource.m_frozenOrder[uSections + uPos]];
+            rc = AddEntry(section.section.pItem, key.key.pItem, key.pValue,
+                key.key.pComment, false, a_bCopyStrings);
+        }
+    }
     return rc;
-#else // !_WIN32 (therefore SI_CONVERT_ICU)
-    char szFile[256];
-    u_austrncpy(szFile, a_pwszFile, sizeof(szFile));
-    return SaveFile(szFile, a_bAddSignature);
-#endif // _WIN32
 }
-#endif // SI_HAS_WIDE_FILE
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::SaveFile(
-    FILE *  a_pFile,
-    bool    a_bAddSignature
-    ) const
+bool
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::BuildFrozenHash()
 {
-    FileWriter writer(a_pFile);
-    return Save(writer, a_bAddSignature);
+    // every section and the first value of every key is a name
+    std::vector<std::pair<unsigned long long, FrozenSlot> > names;
+    for (size_t n = 0; n < m_frozenSections.size(); ++n) {
+        const FrozenSection & section = m_frozenSections[n];
+        FrozenSlot slot = { section.section.pItem, (unsigned) n, SI_FROZEN_NONE };
+        names.push_back(std::make_pair(HashName(section.section.pItem, NULL), slot));
+        for (unsigned uKey = section.uFirstKey; uKey < section.uEndKey; ++uKey) {
+            if (uKey == section.uFirstKey || IsLess(m_frozenKeys[uKey - 1].key.pItem,
+                m_frozenKeys[uKey].key.pItem))
+            {
+                slot.uKey = uKey;
+                names.push_back(std::make_pair(
+                    HashName(section.section.pItem, m_frozenKeys[uKey].key.pItem), slot));
+            }
+        }
+    }
+    const size_t uNames = names.size();
+    m_frozenSlots.assign(uNames, FrozenSlot());
+    m_frozenSeeds.assign(uNames / 2 + 1, 0);
+    if (uNames == 0) {
+        return true;
+    }
+
+    // names that the hash can't match are kept in table order and searched
+    if (SI_HashFold<SI_STRLESS>::value < 0) {
+        for (size_t n = 0; n < uNames; ++n) {
+            m_frozenSlots[n] = names[n].second;
+        }
+        return true;
+    }
+
+    // hash and displace: the names are split into buckets, and the largest
+    // buckets are placed first while most slots are free, each by searching
+    // for a seed that moves all of its names into free slots
+    const size_t uBuckets = m_frozenSeeds.size();
+    std::vector<unsigned> bucketSize(uBuckets, 0);
+    std::vector<unsigned> bucketOf(uNames);
+    for (size_t n = 0; n < uNames; ++n) {
+        bucketOf[n] = (unsigned) GetFrozenSlot(names[n].first, 0, uBuckets);
+        ++bucketSize[bucketOf[n]];
+    }
+    std::vector<unsigned> placeOrder(uNames);
+    for (size_t n = 0; n < uNames; ++n) {
+        placeOrder[n] = (unsigned) n;
+    }
+    std::sort(placeOrder.begin(), placeOrder.end(), [&](unsigned a_uLeft, unsigned a_uRight) {
+        if (bucketSize[bucketOf[a_uLeft]] != bucketSize[bucketOf[a_uRight]]) {
+            return bucketSize[bucketOf[a_uLeft]] > bucketSize[bucketOf[a_uRight]];
+        }
+        if (bucketOf[a_uLeft] != bucketOf[a_uRight]) {
+            return bucketOf[a_uLeft] < bucketOf[a_uRight];
+        }
+        return names[a_uLeft].first < names[a_uRight].first;
+    });
+
+    std::vector<bool> slotUsed(uNames, false);
+    std::vector<size_t> bucketSlots;
+    size_t uFree = 0;
+    for (size_t n = 0; n < uNames; ) {
+        const unsigned uBucket = bucketOf[placeOrder[n]];
+        const size_t uCount = bucketSize[uBucket];
+
+        // a bucket with a single name takes the next free slot directly
+        if (uCount == 1) {
+            while (slotUsed[uFree]) ++uFree;
+            slotUsed[uFree] = true;
+            m_frozenSeeds[uBucket] = SI_FROZEN_DIRECT | (unsigned) uFree;
+            m_frozenSlots[uFree] = names[placeOrder[n++]].second;
+            continue;
+        }
+
+        // names with the same hash can never be separated
+        for (size_t i = n + 1; i < n + uCount; ++i) {
+            if (names[placeOrder[i]].first == names[placeOrder[i - 1]].first) {
+                return false;
+            }
+        }
+
+        unsigned uSeed = 0;
+        do {
+            if (++uSeed == SI_FROZEN_DIRECT) {
+                return false;
+            }
+            bucketSlots.clear();
+            for (size_t i = n; i < n + uCount; ++i) {
+                size_t uSlot = GetFrozenSlot(names[placeOrder[i]].first, uSeed, uNames);
+                if (slotUsed[uSlot] || std::find(bucketSlots.begin(),
+                    bucketSlots.end(), uSlot) != bucketSlots.end())
+                {
+                    break;
+                }
+                bucketSlots.push_back(uSlot);
+            }
+        }
+        while (bucketSlots.size() != uCount);
+
+        m_frozenSeeds[uBucket] = uSeed;
+        for (size_t i = 0; i < uCount; ++i) {
+            slotUsed[bucketSlots[i]] = true;
+            m_frozenSlots[bucketSlots[i]] = names[placeOrder[n + i]].second;
+        }
+        n += uCount;
+    }
+    return true;
 }
 
 template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-SI_Error
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Save(
-    OutputWriter &  a_oOutput,
-    bool            a_bAddSignature
+const typename CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FrozenSlot *
+CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::FindFrozen(
+    const SI_CHAR *     a_pSection,
+    const SI_CHAR *     a_pKey,
+    unsigned long long  a_uHash
     ) const
 {
-    Converter convert(m_bStoreIsUtf8);
+    if (m_frozenSlots.empty()) {
+        return NULL;
+    }
 
-    // add the UTF-8 signature if it is desired
-    if (m_bStoreIsUtf8 && a_bAddSignature) {
-        a_oOutput.Write(SI_UTF8_SIGNATURE);
+    size_t uSlot;
+    if (SI_HashFold<SI_STRLESS>::value < 0) {
+        // table order, each section comes before its keys
+        auto isBefore = [&](const FrozenSlot & a_slot) {
+            if (IsLess(a_slot.pSection, a_pSection)) return true;
+            if (IsLess(a_pSection, a_slot.pSection)) return false;
+            if (a_slot.uKey == SI_FROZEN_NONE) return a_pKey != NULL;
+            return a_pKey && IsLess(m_frozenKeys[a_slot.uKey].key.pItem, a_pKey);
+        };
+        uSlot = (size_t) (std::partition_point(m_frozenSlots.begin(),
+            m_frozenSlots.end(), isBefore) - m_frozenSlots.begin());
+        if (uSlot == m_frozenSlots.size()) {
+            return NULL;
+        }
+    }
+    else {
+        unsigned uSeed = m_frozenSeeds[GetFrozenSlot(a_uHash, 0, m_frozenSeeds.size())];
+        uSlot = (uSeed & SI_FROZEN_DIRECT) ? (size_t) (uSeed & ~(unsigned) SI_FROZEN_DIRECT)
+            : GetFrozenSlot(a_uHash, uSeed, m_frozenSlots.size());
+    }
+    const FrozenSlot & slot = m_frozenSlots[uSlot];
+
+    // any name leads to a slot, so the name in it must be checked
+    if (IsLess(a_pSection, slot.pSection) || IsLess(slot.pSection, a_pSection)) {
+        return NULL;
+    }
+    if (!a_pKey || slot.uKey == SI_FROZEN_NONE) {
+        return (!a_pKey && slot.uKey == SI_FROZEN_NONE) ? &slot : NULL;
+    }
+    const SI_CHAR * pKey = m_frozenKeys[slot.uKey].key.pItem;
+    if (IsLess(a_pKey, pKey) || IsLess(pKey, a_pKey)) {
+        return NULL;
+    }
+    return &slot;
+}
+
+// ---------------------------------------------------------------------------
+//                              SHARED DATA
+// ---------------------------------------------------------------------------
+
+#ifdef SI_HAS_THREADS
+
+/** Shares the data of an INI object between threads without locking the
+    readers. Every version of the data is immutable once published. A writer
+    builds a new version and swaps it in with an atomic pointer exchange,
+    while each reader pins the version that was current when it started
+    with a hazard pointer, so it sees a consistent version for as long as it
+    holds it. Replaced versions are deleted by the writers once no reader
+    holds them.
+
+    The number of readers that can hold a version at the same time is fixed
+    when the object is created. Further readers wait for a reader to finish.
+    Writers are serialised with a mutex, they are expected to be rare.
+
+    @param SI_INI   The INI class, e.g. CSimpleIniA.
+ */
+template<class SI_INI>
+class CSimpleIniShared
+{
+public:
+    typedef SI_INI TIni;
+
+    /** A version of the data pinned for reading. The version stays valid
+        until the Reader is destroyed, Readers must not outlive the
+        CSimpleIniShared object.
+     */
+    class Reader {
+    public:
+        Reader(Reader && rhs)
+            : m_pOwner(rhs.m_pOwner), m_uSlot(rhs.m_uSlot), m_pIni(rhs.m_pIni)
+        {
+            rhs.m_pIni = NULL;
+        }
+        ~Reader() {
+            if (m_pIni) {
+                m_pOwner->m_hazards[m_uSlot].store(NULL, std::memory_order_release);
+            }
+        }
+        const TIni & operator*() const { return *m_pIni; }
+        const TIni * operator->() const { return m_pIni; }
+        const TIni * Get() const { return m_pIni; }
+    private:
+        friend class CSimpleIniShared;
+        Reader(const CSimpleIniShared * a_pOwner, size_t a_uSlot, const TIni * a_pIni)
+            : m_pOwner(a_pOwner), m_uSlot(a_uSlot), m_pIni(a_pIni)
+        { }
+        Reader(const Reader &);             // disable
+        Reader & operator=(const Reader &); // disable
+
+        const CSimpleIniShared *    m_pOwner;
+        size_t                      m_uSlot;
+        const TIni *                m_pIni;
+    };
+
+    /** Create with an empty version of the data.
+
+        @param a_uMaxReaders    Number of readers that can hold a version at
+                                the same time.
+     */
+    CSimpleIniShared(size_t a_uMaxReaders = SI_SHARED_READERS)
+        : m_pCurrent(new TIni())
+        , m_hazards(new std::atomic<const TIni *>[a_uMaxReaders ? a_uMaxReaders : 1])
+        , m_uHazards(a_uMaxReaders ? a_uMaxReaders : 1)
+    {
+        for (size_t n = 0; n < m_uHazards; ++n) {
+            m_hazards[n].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    /** Destructor. No Reader may still be held. */
+    ~CSimpleIniShared() {
+        delete m_pCurrent.load();
+        for (size_t n = 0; n < m_retired.size(); ++n) {
+            delete m_retired[n];
+        }
+    }
+
+    /** Pin the current version of the data for reading. This never takes a
+        lock, it only waits if the maximum number of readers are already
+        holding versions.
+     */
+    Reader Read() const {
+        // claim a free hazard slot for the version we are about to read
+        const TIni * pIni = m_pCurrent.load();
+        size_t n = 0;
+        for (;;) {
+            const TIni * pFree = NULL;
+            if (m_hazards[n].load(std::memory_order_relaxed) == NULL
+                && m_hazards[n].compare_exchange_strong(pFree, pIni))
+            {
+                break;
+            }
+            if (++n == m_uHazards) {
+                n = 0;
+                std::this_thread::yield();
+            }
+        }
+
+        // the version may have been replaced before the slot was set, in
+        // which case a writer may not have seen it, move on to the new one
+        for (;;) {
+            const TIni * pNow = m_pCurrent.load();
+            if (pNow == pIni) {
+                return Reader(this, n, pIni);
+            }
+            pIni = pNow;
+            m_hazards[n].store(pIni);
+        }
+    }
+
+    /** Publish a new version of the data, taking ownership of it. The typed
+        cache of the object is turned off and the sections left by a lazy
+        load are parsed, as the getters of a published version may be called
+        by several threads at once.
+
+        @param a_pIni       New version, allocated with new. It is deleted
+                            if it can't be published.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error Publish(TIni * a_pIni) {
+        std::lock_guard<std::mutex> lock(m_writer);
+        return PublishLocked(a_pIni);
     }
 
-    // get all of the sections sorted in load order
-    TNamesDepend oSections;
-    GetAllSections(oSections);
-#if defined(_MSC_VER) && _MSC_VER <= 1200
-    oSections.sort();
-#elif defined(__BORLANDC__)
-    oSections.sort(Entry::LoadOrder());
-#else
-    oSections.sort(typename Entry::LoadOrder());
-#endif
+    /** Build a new version from a copy of the current one and publish it.
 
-    // if there is an empty section name, then it must be written out first
-    // regardless of the load order
-    typename TNamesDepend::iterator is = oSections.begin();
-    for (; is != oSections.end(); ++is) {
-        if (!*is->pItem) {
-            // move the empty section name to the front of the section list
-            if (is != oSections.begin()) {
-                oSections.splice(oSections.begin(), oSections, is, std::next(is));
-            }
-            break;
+        @param a_fnUpdate   Called with the copy as `SI_Error (TIni &)`. The
+                            version is only published if it returns success.
+
+        @return SI_Error    See error definitions
+     */
+    template<class SI_UPDATE>
+    SI_Error Update(SI_UPDATE a_fnUpdate) {
+        std::lock_guard<std::mutex> lock(m_writer);
+        TIni * pIni = new(std::nothrow) TIni();
+        if (!pIni) {
+            return SI_NOMEM;
         }
+        SI_Error rc = pIni->CopyFrom(*m_pCurrent.load());
+        if (rc >= 0) {
+            rc = a_fnUpdate(*pIni);
+        }
+        if (rc < 0) {
+            delete pIni;
+            return rc;
+        }
+        SI_Error rcPublish = PublishLocked(pIni);
+        return rcPublish < 0 ? rcPublish : rc;
     }
 
-    // write the file comment if we have one
-    bool bNeedNewLine = false;
-    if (m_pFileComment) {
-        if (!OutputMultiLineText(a_oOutput, convert, m_pFileComment)) {
-            return SI_FAIL;
+    /** Delete the replaced versions that are no longer being read. This is
+        done by every publish, call it to release memory sooner.
+
+        @return Number of replaced versions still being read.
+     */
+    size_t Reclaim() {
+        std::lock_guard<std::mutex> lock(m_writer);
+        return ReclaimLocked();
+    }
+
+private:
+    CSimpleIniShared(const CSimpleIniShared &);             // disable
+    CSimpleIniShared & operator=(const CSimpleIniShared &); // disable
+
+    SI_Error PublishLocked(TIni * a_pIni) {
+        SI_Error rc = a_pIni->ParseLazySections();
+        if (rc < 0) {
+            delete a_pIni;
+            return rc;
         }
-        bNeedNewLine = true;
+        a_pIni->SetTypedCache(false);
+        m_retired.push_back(m_pCurrent.exchange(a_pIni));
+        ReclaimLocked();
+        return SI_OK;
     }
 
-    // iterate through our sections and output the data
-    typename TNamesDepend::const_iterator iSection = oSections.begin();
-    for ( ; iSection != oSections.end(); ++iSection ) {
-        // write out the comment if there is one
-        if (iSection->pComment) {
-            if (bNeedNewLine) {
-                a_oOutput.Write(SI_NEWLINE_A);
-                a_oOutput.Write(SI_NEWLINE_A);
+    size_t ReclaimLocked() {
+        size_t uKept = 0;
+        for (size_t n = 0; n < m_retired.size(); ++n) {
+            bool bHeld = false;
+            for (size_t h = 0; !bHeld && h < m_uHazards; ++h) {
+                bHeld = m_hazards[h].load() == m_retired[n];
             }
-            if (!OutputMultiLineText(a_oOutput, convert, iSection->pComment)) {
-                return SI_FAIL;
+            if (bHeld) {
+                m_retired[uKept++] = m_retired[n];
+            }
+            else {
+                delete m_retired[n];
             }
-            bNeedNewLine = false;
         }
+        m_retired.resize(uKept);
+        return uKept;
+    }
 
-        if (bNeedNewLine) {
-            a_oOutput.Write(SI_NEWLINE_A);
-            a_oOutput.Write(SI_NEWLINE_A);
-            bNeedNewLine = false;
-        }
+    /** Current version */
+    std::atomic<TIni *> m_pCurrent;
 
-        // write the section (unless there is no section name)
-        if (*iSection->pItem) {
-            if (!convert.ConvertToStore(iSection->pItem)) {
-                return SI_FAIL;
-            }
-            a_oOutput.Write("[");
-            a_oOutput.Write(convert.Data());
-            a_oOutput.Write("]");
-            a_oOutput.Write(SI_NEWLINE_A);
-        }
+    /** Version pinned by each reader, NULL for a free slot */
+    std::unique_ptr<std::atomic<const TIni *>[]> m_hazards;
 
-        // get all of the keys sorted in load order
-        TNamesDepend oKeys;
-        GetAllKeys(iSection->pItem, oKeys);
-#if defined(_MSC_VER) && _MSC_VER <= 1200
-        oKeys.sort();
-#elif defined(__BORLANDC__)
-        oKeys.sort(Entry::LoadOrder());
-#else
-        oKeys.sort(typename Entry::LoadOrder());
-#endif
+    /** Number of hazard slots */
+    size_t m_uHazards;
 
-        // write all keys and values
-        typename TNamesDepend::const_iterator iKey = oKeys.begin();
-        for ( ; iKey != oKeys.end(); ++iKey) {
-            // get all values for this key
-            TNamesDepend oValues;
-            GetAllValues(iSection->pItem, iKey->pItem, oValues);
-
-            typename TNamesDepend::const_iterator iValue = oValues.begin();
-            for ( ; iValue != oValues.end(); ++iValue) {
-                // write out the comment if there is one
-                if (iValue->pComment) {
-                    a_oOutput.Write(SI_NEWLINE_A);
-                    if (!OutputMultiLineText(a_oOutput, convert, iValue->pComment)) {
-                        return SI_FAIL;
-                    }
-                }
+    /** Serialises the writers */
+    std::mutex m_writer;
 
-                // write the key
-                if (!convert.ConvertToStore(iKey->pItem)) {
-                    return SI_FAIL;
-                }
-                a_oOutput.Write(convert.Data());
+    /** Replaced versions that were still being read when last checked */
+    std::vector<TIni *> m_retired;
+};
 
-                // write the value as long 
-                if (*iValue->pItem || !m_bAllowKeyOnly) {
-                    if (!convert.ConvertToStore(iValue->pItem)) {
-                        return SI_FAIL;
-                    }
-                    a_oOutput.Write(m_bSpaces ? " = " : "=");
-                    if (m_bParseQuotes && IsSingleLineQuotedValue(iValue->pItem)) {
-                        // the only way to preserve external whitespace on a value (i.e. before or after)
-                        // is to quote it. This is simple quoting, we don't escape quotes within the data. 
-                        a_oOutput.Write("\"");
-                        a_oOutput.Write(convert.Data());
-                        a_oOutput.Write("\"");
-                    }
-                    else if (m_bAllowMultiLine && IsMultiLineData(iValue->pItem)) {
-                        // multi-line data needs to be processed specially to ensure
-                        // that we use the correct newline format for the current system
-                        a_oOutput.Write("<<<END_OF_TEXT" SI_NEWLINE_A);
-                        if (!OutputMultiLineText(a_oOutput, convert, iValue->pItem)) {
-                            return SI_FAIL;
-                        }
-                        a_oOutput.Write("END_OF_TEXT");
-                    }
-                    else {
-                        a_oOutput.Write(convert.Data());
-                    }
-                }
-                a_oOutput.Write(SI_NEWLINE_A);
-            }
-        }
+#endif // SI_HAS_THREADS
 
-        bNeedNewLine = true;
-    }
+// ---------------------------------------------------------------------------
+//                              LAYERED DATA
+// ---------------------------------------------------------------------------
 
-    return SI_OK;
-}
+/** Looks up values through a stack of INI objects without copying them. The
+    top layer receives every change and is the only one that is saved, the
+    layers below it are read-only and are used for the keys that no layer
+    above them has. A typical stack is the user's settings over the defaults.
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::OutputMultiLineText(
-    OutputWriter &  a_oOutput,
-    Converter &     a_oConverter,
-    const SI_CHAR * a_pText
-    ) const
+    The layers are not owned and must outlive this object.
+ */
+template<class SI_INI>
+class CSimpleIniLayered
 {
-    const SI_CHAR * pEndOfLine;
-    SI_CHAR cEndOfLineChar = *a_pText;
-    while (cEndOfLineChar) {
-        // find the end of this line
-        pEndOfLine = a_pText;
-        for (; *pEndOfLine && *pEndOfLine != '\n'; ++pEndOfLine) /*loop*/ ;
-        cEndOfLineChar = *pEndOfLine;
+public:
+    typedef SI_INI TIni;
+    typedef typename SI_INI::SI_CHAR_T SI_CHAR;
 
-        // temporarily null terminate, convert and output the line
-        *const_cast<SI_CHAR*>(pEndOfLine) = 0;
-        if (!a_oConverter.ConvertToStore(a_pText)) {
-            return false;
-        }
-        *const_cast<SI_CHAR*>(pEndOfLine) = cEndOfLineChar;
-        a_pText += (pEndOfLine - a_pText) + 1;
-        a_oOutput.Write(a_oConverter.Data());
-        a_oOutput.Write(SI_NEWLINE_A);
-    }
-    return true;
-}
+    /** Create with only the top layer.
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::Delete(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    bool            a_bRemoveEmpty
-    )
-{
-    return DeleteValue(a_pSection, a_pKey, NULL, a_bRemoveEmpty);
-}
+        @param a_oTop       Layer that receives all changes.
+     */
+    explicit CSimpleIniLayered(TIni & a_oTop) : m_pTop(&a_oTop) { }
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-bool
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::DeleteValue(
-    const SI_CHAR * a_pSection,
-    const SI_CHAR * a_pKey,
-    const SI_CHAR * a_pValue,
-    bool            a_bRemoveEmpty
-    )
-{
-    if (!a_pSection) {
-        return false;
-    }
+    /** Add a read-only layer below all of the existing layers. */
+    void AddLayer(const TIni & a_oLayer) { m_layers.push_back(&a_oLayer); }
 
-    typename TSection::iterator iSection = m_data.find(a_pSection);
-    if (iSection == m_data.end()) {
-        return false;
+    /** Remove all of the read-only layers. */
+    void RemoveLayers() { m_layers.clear(); }
+
+    /** Number of layers, including the top layer. */
+    size_t GetLayerCount() const { return m_layers.size() + 1; }
+
+    /** Get a layer, 0 is the top layer. */
+    const TIni & GetLayer(size_t a_uLayer) const {
+        return a_uLayer ? *m_layers[a_uLayer - 1] : *m_pTop;
     }
 
-    // remove a single key if we have a keyname
-    if (a_pKey) {
-        typename TKeyVal::iterator iKeyVal = iSection->second.find(a_pKey);
-        if (iKeyVal == iSection->second.end()) {
-            return false;
-        }
+    /** The layer that receives all changes. */
+    TIni & GetTop() { return *m_pTop; }
+    const TIni & GetTop() const { return *m_pTop; }
 
-        const static SI_STRLESS isLess = SI_STRLESS();
+    /** Find the highest layer that has a key.
 
-        // remove any copied strings and then the key
-        typename TKeyVal::iterator iDelete;
-        bool bDeleted = false;
-        do {
-            iDelete = iKeyVal++;
+        @return NULL        No layer has the key.
+     */
+    const TIni * FindLayer(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey
+        ) const
+    {
+        if (m_pTop->KeyExists(a_pSection, a_pKey)) {
+            return m_pTop;
+        }
+        for (size_t n = 0; n < m_layers.size(); ++n) {
+            if (m_layers[n]->KeyExists(a_pSection, a_pKey)) {
+                return m_layers[n];
+            }
+        }
+        return NULL;
+    }
 
-            if(a_pValue == NULL ||
-            (isLess(a_pValue, iDelete->second) == false &&
-            isLess(iDelete->second, a_pValue) == false)) {
-                DeleteString(iDelete->first.pItem);
-                DeleteString(iDelete->second);
-                iSection->second.erase(iDelete);
-                bDeleted = true;
+    /** Does any layer have the section? */
+    bool SectionExists(const SI_CHAR * a_pSection) const {
+        if (m_pTop->SectionExists(a_pSection)) {
+            return true;
+        }
+        for (size_t n = 0; n < m_layers.size(); ++n) {
+            if (m_layers[n]->SectionExists(a_pSection)) {
+                return true;
             }
         }
-        while (iKeyVal != iSection->second.end()
-            && !IsLess(a_pKey, iKeyVal->first.pItem));
+        return false;
+    }
 
-        if(!bDeleted) {
-            return false;
+    /** Does any layer have the key? */
+    bool KeyExists(const SI_CHAR * a_pSection, const SI_CHAR * a_pKey) const {
+        return FindLayer(a_pSection, a_pKey) != NULL;
+    }
+
+    /** Retrieve a value from the highest layer that has the key, see
+        CSimpleIniTempl::GetValue().
+     */
+    const SI_CHAR * GetValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        const SI_CHAR * a_pDefault     = NULL,
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        const TIni * pLayer = FindLayer(a_pSection, a_pKey);
+        if (!pLayer) {
+            if (a_pHasMultiple) *a_pHasMultiple = false;
+            return a_pDefault;
         }
+        return pLayer->GetValue(a_pSection, a_pKey, a_pDefault, a_pHasMultiple);
+    }
 
-        // done now if the section is not empty or we are not pruning away
-        // the empty sections. Otherwise let it fall through into the section
-        // deletion code
-        if (!a_bRemoveEmpty || !iSection->second.empty()) {
-            return true;
+    /** Retrieve a numeric value from the highest layer that has the key, see
+        CSimpleIniTempl::GetLongValue(). A value that isn't a number gives the
+        default, the layers below it are not used.
+     */
+    long GetLongValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        long            a_nDefault     = 0,
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        const TIni * pLayer = FindLayer(a_pSection, a_pKey);
+        if (!pLayer) {
+            if (a_pHasMultiple) *a_pHasMultiple = false;
+            return a_nDefault;
         }
+        return pLayer->GetLongValue(a_pSection, a_pKey, a_nDefault, a_pHasMultiple);
     }
-    else {
-        // delete all copied strings from this section. The actual
-        // entries will be removed when the section is removed.
-        typename TKeyVal::iterator iKeyVal = iSection->second.begin();
-        for ( ; iKeyVal != iSection->second.end(); ++iKeyVal) {
-            DeleteString(iKeyVal->first.pItem);
-            DeleteString(iKeyVal->second);
+
+    /** Retrieve a numeric value from the highest layer that has the key, see
+        CSimpleIniTempl::GetDoubleValue().
+     */
+    double GetDoubleValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        double          a_nDefault     = 0,
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        const TIni * pLayer = FindLayer(a_pSection, a_pKey);
+        if (!pLayer) {
+            if (a_pHasMultiple) *a_pHasMultiple = false;
+            return a_nDefault;
         }
+        return pLayer->GetDoubleValue(a_pSection, a_pKey, a_nDefault, a_pHasMultiple);
     }
 
-    // delete the section itself
-    DeleteString(iSection->first.pItem);
-    m_data.erase(iSection);
+    /** Retrieve a boolean value from the highest layer that has the key, see
+        CSimpleIniTempl::GetBoolValue().
+     */
+    bool GetBoolValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        bool            a_bDefault     = false,
+        bool *          a_pHasMultiple = NULL
+        ) const
+    {
+        const TIni * pLayer = FindLayer(a_pSection, a_pKey);
+        if (!pLayer) {
+            if (a_pHasMultiple) *a_pHasMultiple = false;
+            return a_bDefault;
+        }
+        return pLayer->GetBoolValue(a_pSection, a_pKey, a_bDefault, a_pHasMultiple);
+    }
 
-    return true;
-}
+    /** Add or update a value in the top layer, see CSimpleIniTempl::SetValue(). */
+    SI_Error SetValue(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        const SI_CHAR * a_pValue,
+        const SI_CHAR * a_pComment      = NULL,
+        bool            a_bForceReplace = false
+        )
+    {
+        return m_pTop->SetValue(a_pSection, a_pKey, a_pValue, a_pComment, a_bForceReplace);
+    }
 
-template<class SI_CHAR, class SI_STRLESS, class SI_CONVERTER>
-void
-CSimpleIniTempl<SI_CHAR,SI_STRLESS,SI_CONVERTER>::DeleteString(
-    const SI_CHAR * a_pString
-    )
-{
-    // strings may exist either inside the data block, or they will be
-    // individually allocated and stored in m_strings. We only physically
-    // delete those stored in m_strings.
-    if (!m_pData || a_pString < m_pData || a_pString >= m_pData + m_uDataLen) {
-        typename TNamesDepend::iterator i = m_strings.begin();
-        for (;i != m_strings.end(); ++i) {
-            if (a_pString == i->pItem) {
-                delete[] const_cast<SI_CHAR*>(i->pItem);
-                m_strings.erase(i);
-                break;
+    /** Delete a section or key from the top layer, see
+        CSimpleIniTempl::Delete(). The value of a lower layer, if there is
+        one, is then used again.
+     */
+    bool Delete(
+        const SI_CHAR * a_pSection,
+        const SI_CHAR * a_pKey,
+        bool            a_bRemoveEmpty = false
+        )
+    {
+        return m_pTop->Delete(a_pSection, a_pKey, a_bRemoveEmpty);
+    }
+
+    /** Copy the combined data of all layers into a single object, as if each
+        layer had been loaded over the ones below it. All values of a key come
+        from the highest layer that has the key. The settings of a_oIni are
+        those of the lowest layer.
+
+        @param a_oIni       Object to receive the data, it is reset first.
+
+        @return SI_Error    See error definitions
+     */
+    SI_Error Flatten(TIni & a_oIni) const {
+        SI_Error rc = a_oIni.CopyFrom(GetLayer(m_layers.size()));
+        for (size_t n = m_layers.size(); rc >= 0 && n-- > 0; ) {
+            const TIni & layer = GetLayer(n);
+            for (const auto & section : layer.Sections(true)) {
+                rc = a_oIni.SetValue(section.pItem, NULL, NULL, section.pComment);
+                for (const auto & key : layer.Keys(section.pItem, true)) {
+                    if (rc < 0) break;
+
+                    // a multi-key object would add to the lower values
+                    if (a_oIni.IsMultiKey()) {
+                        a_oIni.Delete(section.pItem, key.pItem);
+                    }
+                    for (const auto & value : layer.Values(section.pItem, key.pItem)) {
+                        rc = a_oIni.SetValue(section.pItem, key.pItem, value.pItem, value.pComment);
+                        if (rc < 0) break;
+                    }
+                }
+                if (rc < 0) break;
             }
         }
+        return rc < 0 ? rc : SI_OK;
     }
-}
+
+private:
+    CSimpleIniLayered(const CSimpleIniLayered &);             // disable
+    CSimpleIniLayered & operator=(const CSimpleIniLayered &); // disable
+
+    /** Layer that receives all changes */
+    TIni * m_pTop;
+
+    /** Read-only layers, highest first */
+    std::vector<const TIni *> m_layers;
+};
 
 // ---------------------------------------------------------------------------
 //                              CONVERSION FUNCTIONS
@@ -3121,28 +9572,55 @@ public:
         size_t          a_uOutputDataSize)
     {
         if (m_bStoreIsUtf8) {
-            // This uses the Unicode reference implementation to do the
-            // conversion from UTF-8 to wchar_t. The required files are
-            // ConvertUTF.h and ConvertUTF.c which should be included in
-            // the distribution but are publicly available from unicode.org
-            // at http://www.unicode.org/Public/PROGRAMS/CVTUTF/
-            ConversionResult retval;
+            // ASCII is copied directly and everything else is converted a
+            // run at a time using the Unicode reference implementation. The
+            // required files are ConvertUTF.h and ConvertUTF.c which should
+            // be included in the distribution but are publicly available
+            // from unicode.org at http://www.unicode.org/Public/PROGRAMS/CVTUTF/
+            // A run ends at an ASCII byte, which is never part of a valid
+            // sequence, so the result is the same as converting it whole.
             const UTF8 * pUtf8 = (const UTF8 *) a_pInputData;
-            if (sizeof(wchar_t) == sizeof(UTF32)) {
-                UTF32 * pUtf32 = (UTF32 *) a_pOutputData;
-                retval = ConvertUTF8toUTF32(
-                    &pUtf8, pUtf8 + a_uInputDataLen,
-                    &pUtf32, pUtf32 + a_uOutputDataSize,
-                    lenientConversion);
-            }
-            else if (sizeof(wchar_t) == sizeof(UTF16)) {
-                UTF16 * pUtf16 = (UTF16 *) a_pOutputData;
-                retval = ConvertUTF8toUTF16(
-                    &pUtf8, pUtf8 + a_uInputDataLen,
-                    &pUtf16, pUtf16 + a_uOutputDataSize,
-                    lenientConversion);
+            const UTF8 * pUtf8End = pUtf8 + a_uInputDataLen;
+            SI_CHAR * pOutput = a_pOutputData;
+            SI_CHAR * pOutputEnd = a_pOutputData + a_uOutputDataSize;
+            for (;;) {
+                size_t uAscii = SI_WidenAscii((const char *) pUtf8,
+                    (size_t) (pUtf8End - pUtf8), pOutput,
+                    (size_t) (pOutputEnd - pOutput));
+                pUtf8 += uAscii;
+                pOutput += uAscii;
+                if (pUtf8 == pUtf8End) {
+                    return true;
+                }
+                if (*pUtf8 < 0x80) {
+                    return false; // output buffer is full
+                }
+
+                const UTF8 * pRunEnd = pUtf8;
+                while (pRunEnd < pUtf8End && *pRunEnd >= 0x80) {
+                    ++pRunEnd;
+                }
+                ConversionResult retval = sourceIllegal;
+                if (sizeof(wchar_t) == sizeof(UTF32)) {
+                    UTF32 * pUtf32 = (UTF32 *) pOutput;
+                    retval = ConvertUTF8toUTF32(
+                        &pUtf8, pRunEnd,
+                        &pUtf32, (UTF32 *) pOutputEnd,
+                        lenientConversion);
+                    pOutput = (SI_CHAR *) pUtf32;
+                }
+                else if (sizeof(wchar_t) == sizeof(UTF16)) {
+                    UTF16 * pUtf16 = (UTF16 *) pOutput;
+                    retval = ConvertUTF8toUTF16(
+                        &pUtf8, pRunEnd,
+                        &pUtf16, (UTF16 *) pOutputEnd,
+                        lenientConversion);
+                    pOutput = (SI_CHAR *) pUtf16;
+                }
+                if (retval != conversionOK) {
+                    return false;
+                }
             }
-            return retval == conversionOK;
         }
 
         // convert to wchar_t
@@ -3217,28 +9695,58 @@ public:
             }
             ++uInputLen; // include the NULL char
 
-            // This uses the Unicode reference implementation to do the
-            // conversion from wchar_t to UTF-8. The required files are
-            // ConvertUTF.h and ConvertUTF.c which should be included in
-            // the distribution but are publicly available from unicode.org
-            // at http://www.unicode.org/Public/PROGRAMS/CVTUTF/
-            ConversionResult retval;
+            // ASCII is copied directly and everything else is converted a
+            // run at a time using the Unicode reference implementation, as
+            // in ConvertFromStore.
+            const SI_CHAR * pInput = a_pInputData;
+            const SI_CHAR * pInputEnd = a_pInputData + uInputLen;
             UTF8 * pUtf8 = (UTF8 *) a_pOutputData;
-            if (sizeof(wchar_t) == sizeof(UTF32)) {
-                const UTF32 * pUtf32 = (const UTF32 *) a_pInputData;
-                retval = ConvertUTF32toUTF8(
-                    &pUtf32, pUtf32 + uInputLen,
-                    &pUtf8, pUtf8 + a_uOutputDataSize,
-                    lenientConversion);
-            }
-            else if (sizeof(wchar_t) == sizeof(UTF16)) {
-                const UTF16 * pUtf16 = (const UTF16 *) a_pInputData;
-                retval = ConvertUTF16toUTF8(
-                    &pUtf16, pUtf16 + uInputLen,
-                    &pUtf8, pUtf8 + a_uOutputDataSize,
-                    lenientConversion);
-            }
-            return retval == conversionOK;
+            UTF8 * pUtf8End = pUtf8 + a_uOutputDataSize;
+            for (;;) {
+                size_t uAscii = SI_NarrowAscii(pInput,
+                    (size_t) (pInputEnd - pInput), (char *) pUtf8,
+                    (size_t) (pUtf8End - pUtf8));
+                pInput += uAscii;
+                pUtf8 += uAscii;
+                if (pInput == pInputEnd) {
+                    return true;
+                }
+                if ((unsigned long) *pInput < 0x80) {
+                    return false; // output buffer is full
+                }
+
+                // a high surrogate takes the next character with it, so that
+                // an unpaired one is treated as it is in the whole string
+                const SI_CHAR * pRunEnd = pInput;
+                while (pRunEnd < pInputEnd && (unsigned long) *pRunEnd >= 0x80) {
+                    ++pRunEnd;
+                }
+                if (sizeof(wchar_t) == sizeof(UTF16) && pRunEnd < pInputEnd
+                    && pRunEnd[-1] >= 0xD800 && pRunEnd[-1] <= 0xDBFF)
+                {
+                    ++pRunEnd;
+                }
+                ConversionResult retval = sourceIllegal;
+                if (sizeof(wchar_t) == sizeof(UTF32)) {
+                    const UTF32 * pUtf32 = (const UTF32 *) pInput;
+                    retval = ConvertUTF32toUTF8(
+                        &pUtf32, (const UTF32 *) pRunEnd,
+                        &pUtf8, pUtf8End,
+                        lenientConversion);
+                    pInput = (const SI_CHAR *) pUtf32;
+                }
+                else if (sizeof(wchar_t) == sizeof(UTF16)) {
+                    const UTF16 * pUtf16 = (const UTF16 *) pInput;
+                    retval = ConvertUTF16toUTF8(
+                        &pUtf16, (const UTF16 *) pRunEnd,
+                        &pUtf8, pUtf8End,
+                        lenientConversion);
+                    pInput = (const SI_CHAR *) pUtf16;
+                }
+                if (retval != conversionOK) {
+                    return false;
+                }
+            }
         }
         else {
             size_t retval = wcstombs(a_pOutputData,
@@ -3628,6 +10136,11 @@ typedef CSimpleIniTempl<char,
 typedef CSimpleIniTempl<char,
     SI_Case<char>,SI_ConvertA<char> >                   CSimpleIniCaseA;
 
+typedef CSimpleIniLayered<CSimpleIniA>                  CSimpleIniLayeredA;
+#ifdef SI_HAS_THREADS
+typedef CSimpleIniShared<CSimpleIniA>                   CSimpleIniSharedA;
+#endif
+
 #if defined(SI_NO_CONVERSION)
 // if there is no wide char conversion then we don't need to define the 
 // widechar "W" versions of CSimpleIni
@@ -3,12 +3,22 @@
 
 #include "config.h" // SimpleIni tools
 #include "gui.h"
+#include "watcher.h"
 // #include "entity.h"
 
 using namespace gui;
 
 enum class GameState { Boot, StartScreen, MainMenu, Playing, GameOver };
 
+// the [Window] section of settings.ini, see window_schema in game.cpp
+struct WindowSettings {
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned max_fps = 0;
+    bool vsync = false;
+    std::string title;
+};
+
 class Game {
 public:
     Game();
@@ -16,7 +26,8 @@ public:
     int Run();
 protected:
     void GetSettings(SI_Error rc);
-    void build_settingsINI(SI_Error rc, CSimpleIniA& def_config, SI_Error def_rc);
+    void apply_settings_changes();
+    void window_settings_changed();
     void find_clicked(sf::Event::MouseButtonEvent mouseButton);
     void find_mouse_move(sf::Event::MouseMoveEvent mouseMove);
     void get_event(sf::Event event);
@@ -81,6 +92,8 @@ private:
     gui::GuiVector ui_objects;
     sf::RenderWindow window;
     CSimpleIniA config;
+    WindowSettings window_settings;
+    std::unique_ptr<SettingsWatcher> settings_watcher;
 };
 
 #endif
@@ -3,80 +3,84 @@
 using namespace gui;
 // using namespace entity;
 
-void build_default_settingsINI(CSimpleIniA& def_config, SI_Error & def_rc) {
-    printf("\ndefault-settings.ini not found! Building...\n");
-
-    def_rc = def_config.SetValue("Window", nullptr, nullptr);
-    def_rc = def_config.SetValue("Window", "Width", "800");
-    def_rc = def_config.SetValue("Window", "Height", "600");
-    def_rc = def_config.SetValue("Window", "MaxFPS", "60");
-    def_rc = def_config.SetValue("Window", "VSync", "True");
-    def_rc = def_config.SetValue("Window", "Title", "Vector Art");
-
-    def_rc = def_config.SaveFile("default-settings.ini");
+// every window setting and its default, the names are hashed at compile time
+static constexpr auto window_schema = std::make_tuple(
+    SI_MakeSetting("Window", "Width", &WindowSettings::width, 800),
+    SI_MakeSetting("Window", "Height", &WindowSettings::height, 600),
+    SI_MakeSetting("Window", "MaxFPS", &WindowSettings::max_fps, 60),
+    SI_MakeSetting("Window", "VSync", &WindowSettings::vsync, true),
+    SI_MakeSetting("Window", "Title", &WindowSettings::title, "Vector Art")
+);
+
+SI_Error load_settingsINI(CSimpleIniA& config, const char* file, const char* snapshot) {
+    SI_Error rc = config.LoadSnapshot(snapshot, file);
+    if (rc >= 0) { return rc; }
+
+    rc = config.LoadFile(file);
+    if (rc >= 0) { config.SaveSnapshot(snapshot, file); }
+    return rc;
 }
 
-void Game::build_settingsINI(SI_Error rc, CSimpleIniA& def_config, SI_Error def_rc) {
-    printf("\nsettings.ini not found! Building from default...\n");
-
-    if (def_rc < 0) { build_default_settingsINI(def_config, def_rc); }
-
-    CSimpleIniA::TNamesDepend sections;
-    def_config.GetAllSections(sections);
-
-    for (const auto& sec : sections) {
-        const char* sectionName = sec.pItem;
-
-        CSimpleIniA::TNamesDepend keys;
-        def_config.GetAllKeys(sectionName, keys);
-
-        for (const auto& key : keys) {
-            const char* keyName = key.pItem;
-            const char* value = def_config.GetValue(sectionName, keyName, "");
-
-            this->config.SetValue(sectionName, keyName, value);
-        }
-    }
-
-    SI_Error save_rc = this->config.SaveFile("settings.ini");
-    if (save_rc < 0) {
-        printf("Failed to save settings.ini!\n");
+void Game::GetSettings(SI_Error rc) {
+    if (rc < 0) {
+        printf("\nsettings.ini not found! Using defaults...\n");
+        SI_Error saved = this->config.WriteDefaults(window_schema);
+        if (saved >= 0) { saved = this->config.SaveFileAtomic("settings.ini"); }
+        if (saved < 0) { printf("Failed to save settings.ini!\n"); }
     }
 
-    rc = this->config.LoadFile("settings.ini");
-    if (rc < 0) { this->build_settingsINI(rc, def_config, def_rc); }
-}
-
-void Game::GetSettings(SI_Error rc) {
-    CSimpleIniA def_config;
-    def_config.SetUnicode();
-    SI_Error def_rc = def_config.LoadFile("default-settings.ini");
-    if (rc < 0) { this->build_settingsINI(rc, def_config, def_rc); }
-
-    const char* def_width = def_config.GetValue("Window", "Width");
-    const char* def_height = def_config.GetValue("Window", "Height");
-    const char* def_maxfps = def_config.GetValue("Window", "MaxFPS");
-    const char* def_vsync = def_config.GetValue("Window", "VSync");
-    const char* def_title = def_config.GetValue("Window", "Title");
-
-    int width = std::stoi(this->config.GetValue("Window", "Width", def_width));
-    int height = std::stoi(this->config.GetValue("Window", "Height", def_height));
-    int max_fps = std::stoi(this->config.GetValue("Window", "MaxFPS", def_maxfps));
-    bool vsync = std::string(this->config.GetValue("Window", "VSync", def_vsync)) == "True";
-    const char* title = this->config.GetValue("Window", "Title", def_title);
-
-    this->window.create(sf::VideoMode(width, height), title);
-    this->window.setFramerateLimit(max_fps);
-    this->window.setVerticalSyncEnabled(vsync);
+    // a setting missing from settings.ini reads as its default in window_schema
+    this->config.ReadSettings(window_schema, this->window_settings);
+    const WindowSettings& ws = this->window_settings;
+    this->window.create(sf::VideoMode(ws.width, ws.height), ws.title);
+    this->window.setFramerateLimit(ws.max_fps);
+    this->window.setVerticalSyncEnabled(ws.vsync);
 }
 
 Game::Game() {
     this->config.SetUnicode();
-    SI_Error rc = this->config.LoadFile("settings.ini");
+    this->config.SetTypedCache();
+    SI_Error rc = load_settingsINI(this->config, "settings.ini", "settings.ini.snapshot");
     this->GetSettings(rc);
+    this->config.Subscribe("Window", nullptr, [this](const char*, const char* key) {
+        if (key) { this->window_settings_changed(); }
+    });
+    this->settings_watcher = std::make_unique<SettingsWatcher>("settings.ini");
     this->state = GameState::MainMenu;
 }
 
+void Game::window_settings_changed() {
+    // a removed setting reads back as its default, a batch of changes calls
+    // this once per key so only what differs is applied
+    WindowSettings old = this->window_settings;
+    this->config.ReadSettings(window_schema, this->window_settings);
+    const WindowSettings& ws = this->window_settings;
+
+    if (ws.max_fps != old.max_fps) { this->window.setFramerateLimit(ws.max_fps); }
+    if (ws.vsync != old.vsync) { this->window.setVerticalSyncEnabled(ws.vsync); }
+    if (ws.title != old.title) { this->window.setTitle(ws.title); }
+    if (ws.width != old.width || ws.height != old.height) {
+        this->window.setSize(sf::Vector2u(ws.width, ws.height));
+    }
+}
+
+void Game::apply_settings_changes() {
+    SettingChanges changes;
+    if (!this->settings_watcher || !this->settings_watcher->TakeChanges(changes)) { return; }
+
+    // removed settings fall back to their defaults in window_schema, the
+    // window is updated by the subscription on config
+    std::vector<CSimpleIniA::BatchOp> ops;
+    ops.reserve(changes.size());
+    for (const auto& change : changes) {
+        const char* value = change.value ? change.value->c_str() : nullptr;
+        ops.push_back({change.section.c_str(), change.key.c_str(), value, !change.value});
+    }
+    if (this->config.ApplyBatch(ops.data(), ops.size()) < 0) {
+        printf("\nFailed to apply settings changes!\n");
+    }
+}
+
 void Game::key_pressed(sf::Keyboard::Scancode keycode) {
     switch(keycode) {
         case sf::Keyboard::Scancode::Escape:
@@ -277,6 +281,7 @@ void Game::DrawGui() {
 
 void Game::loop() {
     while (this->window.isOpen()) {
+        this->apply_settings_changes();
         this->handle_state_change();
         this->handle_events();
         this->window.clear(sf::Color::Black);
@@ -0,0 +1,185 @@
+#include "watcher.h"
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// how long to wait for an editor to finish writing before reloading
+static const auto settle_time = std::chrono::milliseconds(50);
+
+#ifndef __linux__
+// how often the file is checked when it can't be watched
+static const auto poll_interval = std::chrono::milliseconds(500);
+#endif
+
+static std::string file_name(const std::string& path) {
+    auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::string file_dir(const std::string& path) {
+    auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+}
+
+bool diff_settings(const CSimpleIniA& from, const CSimpleIniA& to, SettingChanges& changes) {
+    CSimpleIniA::TDiff diff;
+    if (from.Diff(to, diff) < 0) { return false; }
+
+    // every key of an added or removed section is listed as well
+    for (const auto& entry : diff) {
+        if (!entry.pKey) { continue; }
+
+        std::optional<std::string> value;
+        if (entry.eType != CSimpleIniA::SI_DIFF_REMOVED) { value = entry.pNewValue; }
+        changes.push_back(SettingChange{entry.pSection, entry.pKey, std::move(value)});
+    }
+    return true;
+}
+
+SettingsWatcher::SettingsWatcher(std::string file)
+: file(std::move(file)), current(new CSimpleIniA()) {
+    this->current->SetUnicode();
+    this->current->LoadFile(this->file.c_str());
+
+#ifdef __linux__
+    // the directory is watched as the file is usually replaced rather than
+    // rewritten, by editors and by SaveFileAtomic
+    this->notify_fd = inotify_init1(IN_CLOEXEC);
+    if (this->notify_fd >= 0) {
+        int wd = inotify_add_watch(this->notify_fd, file_dir(this->file).c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0 || pipe(this->stop_pipe) != 0) {
+            close(this->notify_fd);
+            this->notify_fd = -1;
+        }
+    }
+    if (this->notify_fd < 0) {
+        printf("\nUnable to watch %s, settings won't reload\n", this->file.c_str());
+        return;
+    }
+#else
+    this->file_existed = stat(this->file.c_str(), &this->file_stat) == 0;
+#endif
+
+    this->thread = std::thread(&SettingsWatcher::watch, this);
+}
+
+SettingsWatcher::~SettingsWatcher() {
+    this->stopping = true;
+#ifdef __linux__
+    if (this->stop_pipe[1] >= 0) {
+        char c = 0;
+        (void) !write(this->stop_pipe[1], &c, 1);
+    }
+#endif
+    if (this->thread.joinable()) { this->thread.join(); }
+
+#ifdef __linux__
+    if (this->notify_fd >= 0) { close(this->notify_fd); }
+    for (int fd : this->stop_pipe) {
+        if (fd >= 0) { close(fd); }
+    }
+#endif
+}
+
+bool SettingsWatcher::TakeChanges(SettingChanges& changes) {
+    std::unique_lock<std::mutex> lock(this->pending_lock, std::try_to_lock);
+    if (!lock.owns_lock() || this->pending.empty()) { return false; }
+
+    changes.swap(this->pending);
+    this->pending.clear();
+    return true;
+}
+
+void SettingsWatcher::watch() {
+    while (this->wait_for_change()) {
+        // writes often come in bursts, only the last version matters
+        std::this_thread::sleep_for(settle_time);
+        if (this->stopping) { return; }
+
+        this->reload();
+    }
+}
+
+#ifdef __linux__
+bool SettingsWatcher::wait_for_change() {
+    const std::string name = file_name(this->file);
+    alignas(inotify_event) char buffer[4096];
+
+    for (;;) {
+        pollfd fds[2] = {
+            { this->notify_fd, POLLIN, 0 },
+            { this->stop_pipe[0], POLLIN, 0 }
+        };
+        if (poll(fds, 2, -1) < 0) { continue; }
+        if (this->stopping || fds[1].revents) { return false; }
+
+        ssize_t len = read(this->notify_fd, buffer, sizeof(buffer));
+        bool changed = false;
+        for (ssize_t pos = 0; pos < len; ) {
+            auto event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            if (event->len && name == event->name) { changed = true; }
+            pos += sizeof(inotify_event) + event->len;
+        }
+        if (changed) { return true; }
+    }
+}
+#else
+bool SettingsWatcher::wait_for_change() {
+    // compared with the file as last seen, so a write made while the
+    // previous one was being reloaded isn't missed
+    while (!this->stopping) {
+        std::this_thread::sleep_for(poll_interval);
+
+        struct stat seen = {};
+        bool exists = stat(this->file.c_str(), &seen) == 0;
+        bool changed = exists && (!this->file_existed
+            || seen.st_mtime != this->file_stat.st_mtime
+            || seen.st_size != this->file_stat.st_size);
+        this->file_existed = exists;
+        this->file_stat = seen;
+        if (changed) { return true; }
+    }
+    return false;
+}
+#endif
+
+void SettingsWatcher::reload() {
+    std::unique_ptr<CSimpleIniA> next(new CSimpleIniA());
+    next->SetUnicode();
+
+    // a file caught half written fails to load or loses keys, the write
+    // that completes it triggers another reload
+    if (next->LoadFile(this->file.c_str()) < 0) { return; }
+
+    // if the changes can't be found the next reload compares against the
+    // same version again
+    SettingChanges changes;
+    if (!diff_settings(*this->current, *next, changes)) { return; }
+    this->current.swap(next);
+    if (!changes.empty()) { this->queue(changes); }
+}
+
+void SettingsWatcher::queue(SettingChanges& changes) {
+    std::lock_guard<std::mutex> lock(this->pending_lock);
+
+    // a key changed again before the game loop took it only needs its
+    // latest value
+    for (auto& change : changes) {
+        auto same_key = [&change](const SettingChange& queued) {
+            return queued.section == change.section && queued.key == change.key;
+        };
+        auto it = std::find_if(this->pending.begin(), this->pending.end(), same_key);
+        if (it != this->pending.end()) {
+            it->value = std::move(change.value);
+            continue;
+        }
+        this->pending.push_back(std::move(change));
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef watcher_h
+#define watcher_h
+
+#include "config.h" // SimpleIni tools
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+struct SettingChange {
+    std::string section;
+    std::string key;
+    std::optional<std::string> value; // nullopt when the key was removed
+};
+
+using SettingChanges = std::vector<SettingChange>;
+
+// Watches a settings file from a background thread. Every time the file is
+// written it is parsed on that thread and compared with the previous
+// version, and the changed keys are queued for the game loop to apply.
+class SettingsWatcher {
+public:
+    explicit SettingsWatcher(std::string file);
+    ~SettingsWatcher();
+
+    SettingsWatcher(const SettingsWatcher&) = delete;
+    SettingsWatcher& operator=(const SettingsWatcher&) = delete;
+
+    // Moves the changes queued since the last call into `changes`. Never
+    // blocks, returns false when there are none or the watcher thread is
+    // busy queueing them (they are picked up on a later call).
+    bool TakeChanges(SettingChanges& changes);
+
+protected:
+    void watch();
+    bool wait_for_change();
+    void reload();
+    void queue(SettingChanges& changes);
+
+private:
+    std::string file;
+    std::unique_ptr<CSimpleIniA> current;
+
+    SettingChanges pending;
+    std::mutex pending_lock;
+
+    std::atomic<bool> stopping = false;
+    int notify_fd = -1;
+    int stop_pipe[2] = {-1, -1};
+#ifndef __linux__
+    // the file when wait_for_change() last looked at it
+    struct stat file_stat = {};
+    bool file_existed = false;
+#endif
+    std::thread thread;
+};
+
+// Appends the keys that differ between two versions of the settings.
+// Returns false when out of memory, `changes` may then be incomplete.
+bool diff_settings(const CSimpleIniA& from, const CSimpleIniA& to, SettingChanges& changes);
+
+#endif
@@ -0,0 +1,53 @@
+// Parallel load benchmark for config.h, build and run with "make bench"
+#include "config.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// about 32 MB of sections with a few keys and comments each
+static std::string make_data() {
+    std::string data;
+    data.reserve(33 * 1024 * 1024);
+    for (int n = 0; data.size() < 32 * 1024 * 1024; ++n) {
+        auto id = std::to_string(n);
+        data += "; section " + id + "\n[Section" + id + "]\n";
+        for (int k = 0; k < 8; ++k) {
+            data += "key" + std::to_string(k) + " = value " + id + "\n";
+        }
+    }
+    return data;
+}
+
+// best of a few loads, in milliseconds
+static double time_load(const std::string& data, unsigned threads) {
+    double best = 0;
+    for (int run = 0; run < 3; ++run) {
+        CSimpleIniA ini;
+        ini.SetLoadThreads(threads);
+        auto start = std::chrono::steady_clock::now();
+        if (ini.LoadData(data) < 0) {
+            std::printf("load failed\n");
+            return 0;
+        }
+        std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+        if (run == 0 || took.count() < best) {
+            best = took.count();
+        }
+    }
+    return best;
+}
+
+int main() {
+    std::string data = make_data();
+    unsigned cores = std::thread::hardware_concurrency();
+    std::printf("%zu bytes, %u hardware threads\n", data.size(), cores);
+
+    double serial = time_load(data, 1);
+    std::printf("threads  1: %8.1f ms\n", serial);
+    for (unsigned threads = 2; threads <= 8; threads *= 2) {
+        double took = time_load(data, threads);
+        std::printf("threads %2u: %8.1f ms  speedup %.2fx\n", threads, took,
+            took > 0 ? serial / took : 0.0);
+    }
+    return 0;
+}
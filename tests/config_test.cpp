@@ -0,0 +1,640 @@
+// Regression tests for config.h, build and run with "make test"
+#include "config.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            ++failures; \
+        } \
+    } while (0)
+
+// load the data into a fresh object and save it again
+static std::string round_trip(const std::string& data, unsigned threads, bool strip = false) {
+    CSimpleIniA ini;
+    ini.SetLoadThreads(threads);
+    ini.SetStripComments(strip);
+    if (ini.LoadData(data) < 0) {
+        return "ERROR";
+    }
+    std::string out;
+    ini.Save(out);
+    return out;
+}
+
+// a comment followed by an invalid line before every header, large enough
+// for several chunks so some of them start at one
+static std::string commented_sections() {
+    std::string data;
+    for (int n = 0; data.size() < 4 * SI_PARALLEL_CHUNK_SIZE; ++n) {
+        auto id = std::to_string(n);
+        data += "; section " + id + "\n = junk\n\n[S" + id + "]\nkey=" + id + "\n";
+    }
+    return data;
+}
+
+static void test_parallel_matches_serial() {
+    std::string data = commented_sections();
+    std::string serial = round_trip(data, 1);
+    CHECK(serial.find("; section 0\n") != std::string::npos);
+    CHECK(round_trip(data, 4) == serial);
+
+    // comments are dropped by every chunk
+    std::string stripped = round_trip(data, 4, true);
+    CHECK(stripped.find(';') == std::string::npos);
+    CHECK(stripped == round_trip(data, 1, true));
+
+    // an incomplete header runs onto the next line so mustn't be split after
+    std::string broken;
+    while (broken.size() < 4 * SI_PARALLEL_CHUNK_SIZE) {
+        broken += "[open\n; lost\n[S" + std::to_string(broken.size()) + "]\nkey=1\n";
+    }
+    CHECK(round_trip(broken, 4) == round_trip(broken, 1));
+}
+
+static void test_lazy_matches_eager() {
+    std::string data = commented_sections();
+    CSimpleIniA eager;
+    CHECK(eager.LoadData(data) >= 0);
+    CSimpleIniA lazy;
+    lazy.SetLazyLoad();
+    CHECK(lazy.LoadData(data) >= 0);
+    CHECK(lazy.GetValue("S1", "key") != NULL);
+
+    std::string saved, saved_lazy;
+    eager.Save(saved);
+    lazy.Save(saved_lazy);
+    CHECK(saved.find("; section 1\n[S1]") != std::string::npos);
+    CHECK(saved_lazy == saved);
+}
+
+static void test_lazy_compact() {
+    // compacting moves the section names that the lazy sections are kept by
+    CSimpleIniA ini;
+    ini.SetLazyLoad();
+    CHECK(ini.LoadData(commented_sections()) >= 0);
+    CHECK(ini.SetValue("S0", "added", "1") >= 0);
+    CHECK(ini.CompactStrings() >= 0);
+    CHECK(std::string(ini.GetValue("S2", "key", "?")) == "2");
+    CHECK(std::string(ini.GetValue("S0", "added", "?")) == "1");
+
+    std::string saved;
+    CHECK(ini.Save(saved) >= 0);
+    CHECK(saved.find("; section 3\n[S3]\nkey = 3\n") != std::string::npos);
+}
+
+static void test_numbers() {
+    CSimpleIniA ini;
+    ini.LoadData("[n]\nhex=0x10\nneg=-0x10\nsigned=0x-10\nbig=-0x8000000000000000\n"
+        "bad=0x\nhexfloat=0x1.8p1\nneghex=-0x1p-1\ninf=-inf\nword=1e\n");
+    CHECK(ini.GetLongValue("n", "hex") == 16);
+    CHECK(ini.GetLongValue("n", "neg") == -16);
+    CHECK(ini.GetLongValue("n", "signed") == -16);
+    CHECK(ini.GetLongValue("n", "big") == LONG_MIN);
+    CHECK(ini.GetLongValue("n", "bad", 7) == 7);
+    CHECK(ini.GetDoubleValue("n", "hexfloat") == 3.0);
+    CHECK(ini.GetDoubleValue("n", "neghex") == -0.5);
+    CHECK(ini.GetDoubleValue("n", "inf") == -HUGE_VAL);
+    CHECK(ini.GetDoubleValue("n", "word", 2.5) == 2.5);
+}
+
+static void test_save_output() {
+    // every value of a multi-key is written with the name of the first one
+    CSimpleIniA ini;
+    ini.SetMultiKey();
+    ini.LoadData("[s]\nkey=1\nKey=2\n");
+    ini.SetValue("s", "KEY", "3");
+    std::string out;
+    ini.Save(out);
+    CHECK(out == "[s]\nkey = 1\nkey = 2\nkey = 3\n");
+
+    // FileWriter writes straight to the file
+    FILE * fp = std::tmpfile();
+    CHECK(fp != NULL);
+    if (fp) {
+        {
+            CSimpleIniA::FileWriter writer(fp);
+            CHECK(ini.Save(writer) >= 0);
+            CHECK(std::ftell(fp) == (long) out.size());
+        }
+        std::fclose(fp);
+    }
+}
+
+static void test_publish_lazy() {
+    // readers of a published version mustn't parse lazy sections, build
+    // with -fsanitize=thread to check
+    std::string data;
+    for (int n = 0; n < 1000; ++n) {
+        data += "[S" + std::to_string(n) + "]\nkey=" + std::to_string(n) + "\n";
+    }
+    CSimpleIniA * ini = new CSimpleIniA();
+    ini->SetLazyLoad();
+    CHECK(ini->LoadData(data) >= 0);
+    CSimpleIniSharedA shared;
+    CHECK(shared.Publish(ini) >= 0);
+
+    std::vector<std::thread> readers;
+    std::atomic<int> found(0);
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&shared, &found] {
+            CSimpleIniSharedA::Reader reader = shared.Read();
+            for (int n = 0; n < 1000; ++n) {
+                auto section = "S" + std::to_string(n);
+                if (reader->GetLongValue(section.c_str(), "key", -1) == n) {
+                    ++found;
+                }
+            }
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    CHECK(found == 4000);
+}
+
+static void test_key_only() {
+    // a key without a value doesn't take the value of the key before it
+    CSimpleIniA ini;
+    ini.SetAllowKeyOnly();
+    ini.LoadData("[s]\na=1\nb\n");
+    CHECK(std::string(ini.GetValue("s", "b", "?")) == "");
+}
+
+static void test_multi_line_crlf() {
+    // the end tag is found with trailing spaces once CRLF lines have been
+    // moved down to single newlines
+    CSimpleIniA ini;
+    ini.SetMultiLine();
+    ini.LoadData("[s]\r\nk=<<<END\r\none\r\ntwo\r\nEND  \r\nx=2\r\n");
+    CHECK(std::string(ini.GetValue("s", "k", "?")) == "one\ntwo");
+    CHECK(std::string(ini.GetValue("s", "x", "?")) == "2");
+}
+
+static void test_names_list() {
+    // TNamesDepend is a std::list, or a std::pmr::list with SI_USE_PMR
+    CSimpleIniA ini;
+    ini.LoadData("[a]\nx=1\ny=2\n[b]\n");
+    CSimpleIniA::TNamesDepend names;
+    ini.GetAllSections(names);
+    CHECK(names.size() == 2);
+    ini.GetAllKeys("a", names);
+    CHECK(names.size() == 2);
+    ini.GetAllValues("a", "x", names);
+    CHECK(names.size() == 1);
+}
+
+#ifdef SI_HAS_PMR
+// forwards to another resource, counting what is still allocated
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource * upstream) : m_upstream(upstream) {}
+    size_t allocations = 0;
+    size_t outstanding = 0;
+
+private:
+    void * do_allocate(size_t bytes, size_t align) override {
+        ++allocations;
+        outstanding += bytes;
+        return m_upstream->allocate(bytes, align);
+    }
+    void do_deallocate(void * p, size_t bytes, size_t align) override {
+        outstanding -= bytes;
+        m_upstream->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource * m_upstream;
+};
+
+static void test_memory_resource() {
+    // the table and the copied strings come from the resource, and are all
+    // given back by Reset()
+    std::pmr::monotonic_buffer_resource buffer;
+    CountingResource counting(&buffer);
+    CSimpleIniA ini(false, true, false, &counting);
+    CHECK(ini.GetMemoryResource() == &counting);
+    CHECK(ini.LoadData("[a]\nx=1\nx=2\n[b]\ny=3\n") >= 0);
+    CHECK(ini.SetValue("c", "z", "4") >= 0);
+    CHECK(counting.allocations > 0 && counting.outstanding > 0);
+    CSimpleIniA::TNamesDepend names;
+    ini.GetAllValues("a", "x", names);
+    CHECK(names.size() == 2);
+    names.clear();
+    ini.Reset();
+    CHECK(counting.outstanding == 0);
+
+    // once the buffer is released the object can be loaded and used again
+    buffer.release();
+    size_t allocations = counting.allocations;
+    CHECK(ini.LoadData("[a]\nx=5\n") >= 0);
+    CHECK(ini.SetValue("a", "y", "6") >= 0);
+    CHECK(counting.allocations > allocations);
+    CHECK(std::string(ini.GetValue("a", "x", "?")) == "5");
+    CHECK(std::string(ini.GetValue("a", "y", "?")) == "6");
+    CHECK(ini.GetValue("c", "z") == NULL);
+    std::string saved;
+    CHECK(ini.Save(saved) >= 0);
+    CHECK(saved == "[a]\nx = 5\ny = 6\n");
+}
+#endif // SI_HAS_PMR
+
+static void check_merged_mode(const std::vector<std::string>& contents) {
+    std::vector<std::string> paths;
+    for (size_t n = 0; n < contents.size(); ++n) {
+        paths.push_back("config_test_merge" + std::to_string(n) + ".ini");
+        FILE * fp = std::fopen(paths.back().c_str(), "wb");
+        CHECK(fp != NULL);
+        if (fp) {
+            std::fwrite(contents[n].data(), 1, contents[n].size(), fp);
+            std::fclose(fp);
+        }
+    }
+    std::vector<const char *> files;
+    for (const auto& path : paths) {
+        files.push_back(path.c_str());
+    }
+
+    CSimpleIniA serial, merged;
+    SI_Error rc = SI_OK;
+    for (const char * file : files) {
+        if (rc >= 0) {
+            rc = serial.LoadFile(file);
+        }
+    }
+    CHECK(merged.LoadFilesMerged(files.data(), files.size(), 2) == rc);
+    CHECK(merged.IsUnicode() == serial.IsUnicode());
+    std::string serial_saved, merged_saved;
+    serial.Save(serial_saved, true);
+    merged.Save(merged_saved, true);
+    CHECK(merged_saved == serial_saved);
+    for (const auto& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+static void test_merged_unicode() {
+    // a UTF-8 BOM sets the mode until some file adds data, so it can come
+    // from a later file than the first
+    const std::string bom = "\xEF\xBB\xBF";
+    const std::string text = "[a]\nname = caf\xC3\xA9\n";
+    const std::vector<std::string> cases[] = {
+        {"", bom + text, "[b]\nx = 1\n"},
+        {bom, text, "[b]\nx = 1\n"},
+        {"", "", bom, "", text},
+        {bom + "; only a comment\n", "", text},
+        {"", text},
+    };
+    for (const auto& contents : cases) {
+        check_merged_mode(contents);
+    }
+}
+
+static void test_frozen_lookup() {
+    // every lookup on the frozen data gives what the table gave
+    std::string data;
+    for (int n = 0; n < 300; ++n) {
+        auto id = std::to_string(n);
+        data += "[Section" + id + "]\n";
+        for (int k = 0; k < n % 7; ++k) {
+            data += "Key" + std::to_string(k) + "=" + id + "." + std::to_string(k) + "\n";
+        }
+    }
+    CSimpleIniA ini;
+    CHECK(ini.LoadData(data) >= 0);
+    std::vector<std::string> values;
+    std::string saved;
+    auto lookup_all = [&ini](std::vector<std::string>& out) {
+        out.clear();
+        for (int n = 0; n < 301; ++n) {
+            auto section = "section" + std::to_string(n);
+            out.push_back(ini.SectionExists(section.c_str()) ? "+" : "-");
+            for (int k = 0; k < 8; ++k) {
+                auto key = "KEY" + std::to_string(k);
+                out.push_back(ini.GetValue(section.c_str(), key.c_str(), "?"));
+            }
+        }
+    };
+    lookup_all(values);
+    ini.Save(saved);
+
+    CHECK(ini.Freeze() >= 0);
+    CHECK(ini.IsFrozen());
+    std::vector<std::string> frozen;
+    lookup_all(frozen);
+    CHECK(frozen == values);
+    CHECK(ini.SetValue("Section1", "Key0", "x") < 0);
+    std::string saved_frozen;
+    ini.Save(saved_frozen);
+    CHECK(saved_frozen == saved);
+
+    CHECK(ini.Thaw() >= 0);
+    CHECK(!ini.IsFrozen());
+    std::vector<std::string> thawed;
+    lookup_all(thawed);
+    CHECK(thawed == values);
+    CHECK(ini.SetValue("Section1", "Key0", "x") >= 0);
+}
+
+static void test_handles() {
+    CSimpleIniA ini;
+    ini.LoadData("[s]\na=1\nb=2\n");
+    CSimpleIniA::Handle a = ini.GetHandle("s", "a");
+    CSimpleIniA::Handle b = ini.GetHandle("s", "b");
+    CHECK(ini.IsValid(a) && ini.IsValid(b));
+    CHECK(!ini.IsValid(ini.GetHandle("s", "missing")));
+    CHECK(!ini.IsValid(CSimpleIniA::Handle()));
+
+    // a changed value is seen through the handle
+    ini.SetLongValue("s", "a", 5);
+    CHECK(ini.GetLongValue(a) == 5);
+
+    // a deleted one isn't, even once the key is added again
+    CHECK(ini.Delete("s", "a"));
+    CHECK(!ini.IsValid(a));
+    CHECK(std::string(ini.GetValue(a, "gone")) == "gone");
+    ini.SetValue("s", "a", "6");
+    CHECK(!ini.IsValid(a));
+    CHECK(ini.GetLongValue(ini.GetHandle("s", "a")) == 6);
+    CHECK(ini.GetLongValue(b) == 2);
+
+    // deleting the section deletes its keys
+    CHECK(ini.Delete("s", NULL));
+    CHECK(!ini.IsValid(b));
+}
+
+static void test_batch() {
+    const char * data = "[a]\nx=1\ny=2\n[b]\nz=3\n[c]\nw=4\n";
+    CSimpleIniA::BatchOp ops[] = {
+        {"a", "x", "10", false},
+        {"a", "y", NULL, true},
+        {"b", NULL, NULL, true},
+        {"d", "new", "5", false},
+        {"a", "y", "again", false},
+        {"c", "w", NULL, false},
+    };
+
+    // the batch does what the same calls would do one by one
+    CSimpleIniA batch, calls;
+    batch.LoadData(data);
+    calls.LoadData(data);
+    CHECK(batch.ApplyBatch(ops, sizeof(ops) / sizeof(ops[0])) >= 0);
+    for (const auto& op : ops) {
+        if (op.bDelete) {
+            calls.Delete(op.pSection, op.pKey);
+        }
+        else {
+            calls.SetValue(op.pSection, op.pKey, op.pValue);
+        }
+    }
+    std::string saved_batch, saved_calls;
+    batch.Save(saved_batch);
+    calls.Save(saved_calls);
+    CHECK(saved_batch == saved_calls);
+
+    // several keys of one section at once
+    const char * keys[] = {"x", "missing", NULL, "y"};
+    const char * values[4];
+    CHECK(batch.GetValues("a", keys, 4, values, "?") == 2);
+    CHECK(std::string(values[0]) == "10");
+    CHECK(std::string(values[1]) == "?");
+    CHECK(std::string(values[3]) == "again");
+    CHECK(batch.GetValues("none", keys, 4, values, "?") == 0);
+
+    // a change without a section is rejected before anything changes
+    CSimpleIniA::BatchOp bad[] = {{"a", "x", "20", false}, {NULL, "x", "1", false}};
+    CHECK(batch.ApplyBatch(bad, 2) == SI_FAIL);
+    CHECK(std::string(batch.GetValue("a", "x", "?")) == "10");
+}
+
+static void test_subscriptions() {
+    CSimpleIniA ini;
+    ini.SetMultiKey();
+    std::vector<std::string> changes;
+    auto record = [&changes](const char * section, const char * key) {
+        changes.push_back(std::string(section) + "/" + (key ? key : "*"));
+    };
+    unsigned all = ini.Subscribe("Window", NULL, record);
+    ini.Subscribe("Audio", "vol", record, true);
+    ini.Subscribe("Net", NULL, record, true);
+
+    // a key set several times by one load is reported once
+    ini.LoadData("[Window]\nWidth=1\nWidth=2\nWidth=3\n[Audio]\nvolume=1\nmute=0\n"
+        "[Network]\nport=1\n[Other]\nx=1\n");
+    CHECK(changes.size() == 5);
+    CHECK(std::count(changes.begin(), changes.end(), "Window/Width") == 1);
+    CHECK(std::count(changes.begin(), changes.end(), "Window/*") == 1);
+    CHECK(std::count(changes.begin(), changes.end(), "Audio/volume") == 1);
+    CHECK(std::count(changes.begin(), changes.end(), "Network/*") == 1);
+    CHECK(std::count(changes.begin(), changes.end(), "Network/port") == 1);
+
+    // setting a value it already has isn't a change
+    changes.clear();
+    ini.SetValue("Audio", "volume", "1", NULL, true);
+    CHECK(changes.empty());
+    ini.SetValue("Audio", "volume", "2", NULL, true);
+    CHECK(changes.size() == 1 && changes[0] == "Audio/volume");
+
+    changes.clear();
+    ini.Unsubscribe(all);
+    ini.Delete("Window", "Width");
+    CHECK(changes.empty());
+}
+
+struct TestSettings {
+    int width = 0;
+    bool vsync = false;
+    double scale = 0;
+    std::string title;
+};
+
+static void test_schema() {
+    static constexpr auto schema = std::make_tuple(
+        SI_MakeSetting("Window", "Width", &TestSettings::width, 800),
+        SI_MakeSetting("Window", "VSync", &TestSettings::vsync, true),
+        SI_MakeSetting("Window", "Scale", &TestSettings::scale, 1.5),
+        SI_MakeSetting("Window", "Title", &TestSettings::title, "Untitled"));
+
+    // the defaults are written and read back
+    CSimpleIniA defaults;
+    CHECK(defaults.WriteDefaults(schema) >= 0);
+    CHECK(defaults.GetLongValue("Window", "Width") == 800);
+    CHECK(defaults.GetBoolValue("Window", "VSync") == true);
+    CHECK(std::string(defaults.GetValue("Window", "Title", "?")) == "Untitled");
+    TestSettings read;
+    CHECK(defaults.ReadSettings(schema, read) == 4);
+    CHECK(read.width == 800 && read.vsync && read.scale == 1.5 && read.title == "Untitled");
+
+    // misspelt keys and values of the wrong type read as the default, and
+    // names are matched without case as for GetValue()
+    CSimpleIniA ini;
+    ini.LoadData("[window]\nwidth=1024\nVSnyc=false\nScale=big\ntitle=Game\n");
+    TestSettings settings;
+    CHECK(ini.ReadSettings(schema, settings) == 3);
+    CHECK(settings.width == 1024);
+    CHECK(settings.vsync == true);
+    CHECK(settings.scale == 1.5);
+    CHECK(settings.title == "Game");
+
+    // and the struct is written back as it is
+    settings.width = 640;
+    CHECK(ini.WriteSettings(schema, settings) >= 0);
+    CHECK(ini.GetLongValue("Window", "Width") == 640);
+}
+
+static void test_lists_and_colors() {
+    // lists read back as written, including values that need all digits
+    CSimpleIniA ini;
+    const int sizes[] = {800, -600, 0};
+    const double scales[] = {0.1, -2.5e-300, 1.0 / 3};
+    CHECK(ini.SetListValue("s", "sizes", sizes, 3) >= 0);
+    CHECK(ini.SetListValue("s", "scales", scales, 3) >= 0);
+    CHECK(std::string(ini.GetValue("s", "sizes", "?")) == "800, -600, 0");
+    int sizes_read[3] = {};
+    double scales_read[3] = {};
+    CHECK(ini.GetListValue("s", "sizes", sizes_read, 3) == 3);
+    CHECK(ini.GetListValue("s", "scales", scales_read, 3) == 3);
+    CHECK(sizes_read[0] == 800 && sizes_read[1] == -600 && sizes_read[2] == 0);
+    CHECK(scales_read[0] == 0.1 && scales_read[1] == -2.5e-300 && scales_read[2] == 1.0 / 3);
+
+    // parsing stops at the first item that isn't valid, the rest keep
+    // their values
+    ini.LoadData("[l]\nshort=1, 2,\noverflow=1, 300, 3\nword=4, x\nspaces= 5 ,\t6 \n");
+    unsigned char bytes[3] = {9, 9, 9};
+    CHECK(ini.GetListValue("l", "short", bytes, 3) == 2);
+    CHECK(bytes[0] == 1 && bytes[1] == 2 && bytes[2] == 9);
+    CHECK(ini.GetListValue("l", "overflow", bytes, 3) == 1);
+    CHECK(ini.GetListValue("l", "word", sizes_read, 3) == 1 && sizes_read[0] == 4);
+    CHECK(ini.GetListValue("l", "spaces", sizes_read, 3) == 2 && sizes_read[1] == 6);
+    CHECK(ini.GetListValue("l", "missing", sizes_read, 3) == 0);
+
+    // colors
+    unsigned char rgba[4] = {1, 2, 3, 4};
+    const unsigned char red[4] = {255, 0, 0, 255};
+    CHECK(ini.SetColorValue("c", "red", red) >= 0);
+    CHECK(std::string(ini.GetValue("c", "red", "?")) == "255, 0, 0");
+    CHECK(ini.GetColorValue("c", "red", rgba));
+    CHECK(rgba[0] == 255 && rgba[1] == 0 && rgba[2] == 0 && rgba[3] == 255);
+    ini.LoadData("[c]\nhex=#102030\nhexa=#10203040\ntwo=240,180\nbig=1,2,256\n"
+        "comma=1,2,3,\nfive=1,2,3,4,5\nbadhex=#1020\nnothex=#10203g\n");
+    CHECK(ini.GetColorValue("c", "hex", rgba));
+    CHECK(rgba[0] == 0x10 && rgba[1] == 0x20 && rgba[2] == 0x30 && rgba[3] == 255);
+    CHECK(ini.GetColorValue("c", "hexa", rgba) && rgba[3] == 0x40);
+    const char * bad[] = {"two", "big", "comma", "five", "badhex", "nothex", "missing"};
+    for (const char * key : bad) {
+        CHECK(!ini.GetColorValue("c", key, rgba));
+    }
+    CHECK(rgba[0] == 0x10 && rgba[3] == 0x40);
+}
+
+// every section, key and value in name order, the values of a key in order
+static std::string dump(const CSimpleIniA& ini) {
+    std::vector<std::string> lines;
+    CSimpleIniA::TNamesDepend sections, keys, values;
+    ini.GetAllSections(sections);
+    for (const auto& section : sections) {
+        lines.push_back(std::string("[") + section.pItem + "]");
+        keys.clear();
+        ini.GetAllKeys(section.pItem, keys);
+        for (const auto& key : keys) {
+            std::string line = std::string(section.pItem) + "." + key.pItem + " =";
+            values.clear();
+            ini.GetAllValues(section.pItem, key.pItem, values);
+            for (const auto& value : values) {
+                line += std::string(" ") + value.pItem;
+            }
+            lines.push_back(line);
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+    std::string out;
+    for (const auto& line : lines) {
+        out += line + "\n";
+    }
+    return out;
+}
+
+static void test_diff() {
+    // applying the differences to the old data gives the new data
+    const char * cases[][2] = {
+        {"[a]\nx=1\ny=2\n[b]\nz=3\n", "[a]\nx=10\nw=4\n[c]\nv=5\n"},
+        {"[m]\nk=1\nk=2\nk=3\n", "[m]\nk=2\nk=4\n"},
+        {"[m]\nk=1\nk=1\nj=1\n", "[m]\nk=1\nj=1\nj=2\n"},
+        {"[m]\nk=1\n", "[m]\nk=1\nk=1\n"},
+        {"[empty]\n[m]\nk=1\n", "[m]\n[new]\n"},
+        {"", "[a]\nx=1\nx=2\n"},
+        {"[a]\nx=1\nx=2\n", ""},
+    };
+    for (const auto& pair : cases) {
+        for (int hashed = 0; hashed < 2; ++hashed) {
+            CSimpleIniA old_ini(false, true), new_ini(false, true);
+            old_ini.SetHashIndex(hashed != 0);
+            CHECK(old_ini.LoadData(pair[0]) >= 0);
+            CHECK(new_ini.LoadData(pair[1]) >= 0);
+            CSimpleIniA::TDiff diff;
+            CHECK(old_ini.Diff(new_ini, diff) >= 0);
+            CHECK(old_ini.ApplyDiff(diff.data(), diff.size()) >= 0);
+            CHECK(dump(old_ini) == dump(new_ini));
+            for (int n = 0; n < 3; ++n) {
+                auto key = std::string(1, "kjx"[n]);
+                CHECK(std::string(old_ini.GetValue("m", key.c_str(), "?"))
+                    == new_ini.GetValue("m", key.c_str(), "?"));
+            }
+
+            // nothing is left to apply
+            diff.clear();
+            CHECK(old_ini.Diff(new_ini, diff) >= 0);
+            CHECK(diff.empty());
+        }
+    }
+
+    // a difference without a section changes nothing
+    CSimpleIniA ini;
+    ini.LoadData("[a]\nx=1\n");
+    CSimpleIniA::DiffEntry bad[] = {
+        {CSimpleIniA::SI_DIFF_CHANGED, "a", "x", "1", "2"},
+        {CSimpleIniA::SI_DIFF_ADDED, NULL, "y", NULL, "3"},
+    };
+    CHECK(ini.ApplyDiff(bad, 2) == SI_FAIL);
+    CHECK(std::string(ini.GetValue("a", "x", "?")) == "1");
+}
+
+int main() {
+    test_parallel_matches_serial();
+    test_lazy_matches_eager();
+    test_lazy_compact();
+    test_numbers();
+    test_save_output();
+    test_publish_lazy();
+    test_key_only();
+    test_multi_line_crlf();
+    test_names_list();
+#ifdef SI_HAS_PMR
+    test_memory_resource();
+#endif
+    test_merged_unicode();
+    test_frozen_lookup();
+    test_handles();
+    test_batch();
+    test_subscriptions();
+    test_schema();
+    test_lists_and_colors();
+    test_diff();
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all tests passed\n");
+    return 0;
+}